@@ -484,9 +484,11 @@ AC_DEFUN([_SXE_CHECK_DFP754_SYMBOLS], [dnl
 	LDFLAGS="${LDFLAGS} -lm"
 	AC_CHECK_FUNCS([nand32])
 	AC_CHECK_FUNCS([isnand32])
+	AC_CHECK_FUNCS([isinfd32])
 
 	AC_CHECK_FUNCS([nand64])
 	AC_CHECK_FUNCS([isnand64])
+	AC_CHECK_FUNCS([isinfd64])
 	LDFLAGS="${save_LDFLAGS}"
 ])dnl _SXE_CHECK_DFP754_SYMBOLS
 
@@ -48,15 +48,34 @@
 #endif	/* HAVE_DFP754_H */
 #include "dfp754_d32.h"
 #include "dfp754_d64.h"
-#include "hash.h"
+#include "intern.h"
 #include "books.h"
 #include "xquo.h"
+#include "xin.h"
+#include "stage.h"
+#include "obuf.h"
+#include "shard.h"
 #include "nifty.h"
 
-#define strtopx		strtod64
-#define pxtostr		d64tostr
-#define strtoqx		strtod64
-#define qxtostr		d64tostr
+#if defined BOOKSI64
+# define strtopx	strtoi64
+# define pxtostr	i64tostr
+# define strtoqx	strtoi64
+# define qxtostr	i64tostr
+/* book values X of S decimal places whose last E places don't count */
+# define pxetostr(b, z, x, s, e)	\
+	i64tostr(b, z, xscale(x, s, (s) - (e)), (s) - (e))
+# define qxetostr(b, z, x, s, e)	\
+	i64tostr(b, z, xscale(x, s, (s) - (e)), (s) - (e))
+#else  /* !BOOKSI64 */
+# define strtopx(x, on, s)	strtod64(x, on)
+# define pxtostr(b, z, x, s)	((void)(s), d64tostr(b, z, x))
+# define strtoqx(x, on, s)	strtod64(x, on)
+# define qxtostr(b, z, x, s)	((void)(s), d64tostr(b, z, x))
+/* decimals know their quanta */
+# define pxetostr(b, z, x, s, e)	((void)(s), d64tostr(b, z, x))
+# define qxetostr(b, z, x, s, e)	((void)(s), d64tostr(b, z, x))
+#endif	/* BOOKSI64 */
 
 typedef struct {
 	book_t book;
@@ -74,16 +93,27 @@ typedef struct {
 			qx_t asz;
 		};
 	};
+	/* book_ntop() as of the last print */
+	size_t ntop;
+	/* decimal places of the book's prices and quantities */
+	xscl_t scl;
+	/* what the last update did to the book */
+	book_chg_t chg;
+	/* top-N views for prqn() */
+	const book_view_t *bv;
+	const book_view_t *av;
 } xbook_t;
 
-#define HX_CATCHALL	((hx_t)-1ULL)
-
 /* output mode */
 static void(*prq)(xbook_t*, book_quo_t, book_quo_t);
 /* for N-books */
 static size_t ntop;
 /* consolidation, either quantity or value (price*quantity) */
 static qx_t cqty;
+/* ladder tick size, nan for no ladder, 0 for auto */
+static px_t tick;
+/* decimal places of the above */
+static xscl_t cscl;
 
 
 static __attribute__((format(printf, 1, 2))) void
@@ -105,7 +135,7 @@ serror(const char *fmt, ...)
 static xbook_t
 make_xbook(void)
 {
-	xbook_t r = {make_book()};
+	xbook_t r = {make_book_ladder(tick), .scl = cscl};
 	if (ntop > 1U) {
 		r.bids = calloc(ntop, sizeof(*r.bids));
 		r.asks = calloc(ntop, sizeof(*r.asks));
@@ -128,10 +158,50 @@ free_xbook(xbook_t xb)
 	return xb;
 }
 
+static void
+rescale_xbook(xbook_t *xb, xscl_t to)
+{
+/* make sure XB's decimal places are at least TO's */
+	to.p = to.p > xb->scl.p ? to.p : xb->scl.p;
+	to.q = to.q > xb->scl.q ? to.q : xb->scl.q;
+
+	if (LIKELY(to.p == xb->scl.p && to.q == xb->scl.q)) {
+		/* nothing to do */
+		return;
+	}
+	xb->book = rescale_book(
+		xb->book, xscale(tick, cscl.p, to.p), xb->scl, to);
+	if (xb->bv != NULL) {
+		/* views went with the old book, their rows print the same
+		 * in the new one though, so they start out acked */
+		xb->bv = book_view(xb->book, BOOK_SIDE_BID, ntop);
+		xb->av = book_view(xb->book, BOOK_SIDE_ASK, ntop);
+		book_view_ack(xb->book, BOOK_SIDE_BID);
+		book_view_ack(xb->book, BOOK_SIDE_ASK);
+	}
+	/* bring the copies of the last print in line */
+	if (ntop > 1U) {
+		for (size_t i = 0U; i < ntop; i++) {
+			xb->bids[i] = xscale(xb->bids[i], xb->scl.p, to.p);
+			xb->asks[i] = xscale(xb->asks[i], xb->scl.p, to.p);
+			xb->bszs[i] = xscale(xb->bszs[i], xb->scl.q, to.q);
+			xb->aszs[i] = xscale(xb->aszs[i], xb->scl.q, to.q);
+		}
+	} else {
+		xb->bid = xscale(xb->bid, xb->scl.p, to.p);
+		xb->ask = xscale(xb->ask, xb->scl.p, to.p);
+		xb->bsz = xscale(xb->bsz, xb->scl.q, to.q);
+		xb->asz = xscale(xb->asz, xb->scl.q, to.q);
+	}
+	xb->ntop = book_ntop(xb->book);
+	xb->scl = to;
+	return;
+}
+
 
-/* per-run variables */
-static const char *prfx;
-static size_t prfz;
+/* per-run variables, per shard */
+static __thread const char *prfx;
+static __thread size_t prfz;
 
 static void
 prq1(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
@@ -141,6 +211,12 @@ prq1(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 	char buf[256U];
 	size_t len = 0U;
 
+	if (book_ntop(xb->book) == xb->ntop) {
+		/* top level's untouched */
+		return;
+	}
+	xb->ntop = book_ntop(xb->book);
+
 	b = book_top(xb->book, BOOK_SIDE_BID);
 	a = book_top(xb->book, BOOK_SIDE_ASK);
 
@@ -158,29 +234,33 @@ prq1(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 	buf[len++] = '1';
 	buf[len++] = '\t';
 	if (b.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, b.p);
+		len += pxetostr(buf + len, sizeof(buf) - len,
+				b.p, xb->scl.p, b.pe);
 	}
 	buf[len++] = '\t';
 	if (a.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, a.p);
+		len += pxetostr(buf + len, sizeof(buf) - len,
+				a.p, xb->scl.p, a.pe);
 	}
 	buf[len++] = '\t';
 	if (b.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, b.q);
+		len += qxetostr(buf + len, sizeof(buf) - len,
+				b.q, xb->scl.q, b.qe);
 	}
 	buf[len++] = '\t';
 	if (a.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, a.q);
+		len += qxetostr(buf + len, sizeof(buf) - len,
+				a.q, xb->scl.q, a.qe);
 	}
 	buf[len++] = '\n';
 
-	fwrite(prfx, 1, prfz, stdout);
-	fwrite(buf, 1, len, stdout);
+	obuf_write(prfx, prfz);
+	obuf_write(buf, len);
 	return;
 }
 
 static void
-prq2(xbook_t *UNUSED(xb), book_quo_t q, book_quo_t UNUSED(o))
+prq2(xbook_t *xb, book_quo_t q, book_quo_t UNUSED(o))
 {
 /* print 2-books */
 	char buf[256U];
@@ -189,33 +269,39 @@ prq2(xbook_t *UNUSED(xb), book_quo_t q, book_quo_t UNUSED(o))
 	buf[len++] = (char)(q.s ^ '@');
 	buf[len++] = '2';
 	buf[len++] = '\t';
-	len += pxtostr(buf + len, sizeof(buf) - len, q.p);
+	len += pxetostr(buf + len, sizeof(buf) - len, q.p, xb->scl.p, q.pe);
 	buf[len++] = '\t';
-	len += qxtostr(buf + len, sizeof(buf) - len, q.q);
+	len += qxetostr(buf + len, sizeof(buf) - len, q.q, xb->scl.q, q.qe);
 	buf[len++] = '\n';
 
-	fwrite(prfx, 1, prfz, stdout);
-	fwrite(buf, 1, len, stdout);
+	obuf_write(prfx, prfz);
+	obuf_write(buf, len);
 	return;
 }
 
 static void
-prq3(xbook_t *UNUSED(xb), book_quo_t q, book_quo_t o)
+prq3(xbook_t *xb, book_quo_t q, book_quo_t o)
 {
 /* convert to 3-books */
 	char buf[256U];
 	size_t len = 0U;
 
+#if defined BOOKSI64
+	/* the difference is as fine as the finer of the two */
+	q.qe = o.q && o.qe < q.qe ? o.qe : q.qe;
+#endif	/* BOOKSI64 */
+
 	buf[len++] = (char)(q.s ^ '@');
 	buf[len++] = '3';
 	buf[len++] = '\t';
-	len += pxtostr(buf + len, sizeof(buf) - len, q.p);
+	len += pxetostr(buf + len, sizeof(buf) - len, q.p, xb->scl.p, q.pe);
 	buf[len++] = '\t';
-	len += qxtostr(buf + len, sizeof(buf) - len, q.q - o.q);
+	len += qxetostr(
+		buf + len, sizeof(buf) - len, q.q - o.q, xb->scl.q, q.qe);
 	buf[len++] = '\n';
 
-	fwrite(prfx, 1, prfz, stdout);
-	fwrite(buf, 1, len, stdout);
+	obuf_write(prfx, prfz);
+	obuf_write(buf, len);
 	return;
 }
 
@@ -223,27 +309,25 @@ static void
 prqn(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 {
 /* convert to n-books, aligned */
-	px_t b[ntop];
-	qx_t B[ntop];
-	px_t a[ntop];
-	qx_t A[ntop];
-
-	memset(b, 0, sizeof(b));
-	memset(B, 0, sizeof(B));
-	memset(a, 0, sizeof(a));
-	memset(A, 0, sizeof(A));
+	if (UNLIKELY(xb->bv == NULL || xb->av == NULL)) {
+		/* views are kept up to date by the book from now on */
+		xb->bv = book_view(xb->book, BOOK_SIDE_BID, ntop);
+		xb->av = book_view(xb->book, BOOK_SIDE_ASK, ntop);
+		if (UNLIKELY(xb->bv == NULL || xb->av == NULL)) {
+			return;
+		}
+	}
 
-	size_t bn = book_tops(b, B, xb->book, BOOK_SIDE_BID, ntop);
-	size_t an = book_tops(a, A, xb->book, BOOK_SIDE_ASK, ntop);
+	const book_view_t *b = xb->bv;
+	const book_view_t *a = xb->av;
 
-	if (!memcmp(B, xb->bszs, sizeof(B)) &&
-	    !memcmp(A, xb->aszs, sizeof(A)) &&
-	    !memcmp(b, xb->bids, sizeof(b)) &&
-	    !memcmp(a, xb->asks, sizeof(a))) {
+	if (b->lo >= b->hi && a->lo >= a->hi) {
 		/* nothing's changed, sod off */
 		return;
 	}
 
+	size_t bn = b->n;
+	size_t an = a->n;
 	size_t n = ntop < bn && ntop < an ? ntop : bn < an ? an : bn;
 	for (size_t i = 0U; i < n; i++) {
 		char buf[256U];
@@ -253,35 +337,32 @@ prqn(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 				"c%zu", i + 1U);
 		buf[len++] = '\t';
 		if (i < bn) {
-			len += pxtostr(
-				buf + len, sizeof(buf) - len, b[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					b->p[i], xb->scl.p, b->pe[i]);
 		}
 		buf[len++] = '\t';
 		if (i < an) {
-			len += pxtostr(
-				buf + len, sizeof(buf) - len, a[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					a->p[i], xb->scl.p, a->pe[i]);
 		}
 		buf[len++] = '\t';
 		if (i < bn) {
-			len += qxtostr(
-				buf + len, sizeof(buf) - len, B[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					b->q[i], xb->scl.q, b->qe[i]);
 		}
 		buf[len++] = '\t';
 		if (i < an) {
-			len += qxtostr(
-				buf + len, sizeof(buf) - len, A[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					a->q[i], xb->scl.q, a->qe[i]);
 		}
 		buf[len++] = '\n';
 
-		fwrite(prfx, 1, prfz, stdout);
-		fwrite(buf, 1, len, stdout);
+		obuf_write(prfx, prfz);
+		obuf_write(buf, len);
 	}
 
-	/* keep a copy for next time */
-	memcpy(xb->bids, b, sizeof(b));
-	memcpy(xb->asks, a, sizeof(a));
-	memcpy(xb->bszs, B, sizeof(B));
-	memcpy(xb->aszs, A, sizeof(A));
+	book_view_ack(xb->book, BOOK_SIDE_BID);
+	book_view_ack(xb->book, BOOK_SIDE_ASK);
 	return;
 }
 
@@ -293,8 +374,15 @@ prqc(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 	char buf[256U];
 	size_t len = 0U;
 
-	bc = book_ctop(xb->book, BOOK_SIDE_BID, cqty);
-	ac = book_ctop(xb->book, BOOK_SIDE_ASK, cqty);
+	if (!xb->chg.lvlp) {
+		/* book's unchanged */
+		return;
+	}
+
+	const qx_t c = xscale(cqty, cscl.q, xb->scl.q);
+
+	bc = book_ctop(xb->book, BOOK_SIDE_BID, c);
+	ac = book_ctop(xb->book, BOOK_SIDE_ASK, c);
 
 	if (bc.p == xb->bid && ac.p == xb->ask) {
 		return;
@@ -307,24 +395,28 @@ prqc(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 	buf[len++] = '1';
 	buf[len++] = '\t';
 	if (bc.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, bc.p);
+		len += pxetostr(buf + len, sizeof(buf) - len,
+				bc.p, xb->scl.p, bc.pe);
 	}
 	buf[len++] = '\t';
 	if (ac.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, ac.p);
+		len += pxetostr(buf + len, sizeof(buf) - len,
+				ac.p, xb->scl.p, ac.pe);
 	}
 	buf[len++] = '\t';
 	if (bc.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, bc.q);
+		len += qxetostr(buf + len, sizeof(buf) - len,
+				bc.q, xb->scl.q, bc.qe);
 	}
 	buf[len++] = '\t';
 	if (ac.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, ac.q);
+		len += qxetostr(buf + len, sizeof(buf) - len,
+				ac.q, xb->scl.q, ac.qe);
 	}
 	buf[len++] = '\n';
 
-	fwrite(prfx, 1, prfz, stdout);
-	fwrite(buf, 1, len, stdout);
+	obuf_write(prfx, prfz);
+	obuf_write(buf, len);
 	return;
 }
 
@@ -332,18 +424,36 @@ static void
 prqcn(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 {
 /* convert to n-books, aligned */
+	book_quo_t bc[ntop];
+	book_quo_t ac[ntop];
 	px_t b[ntop];
-	qx_t B[ntop];
 	px_t a[ntop];
-	qx_t A[ntop];
+	size_t bn, an;
+
+	if (!xb->chg.lvlp) {
+		/* book's unchanged */
+		return;
+	}
 
 	memset(b, 0, sizeof(b));
-	memset(B, 0, sizeof(B));
 	memset(a, 0, sizeof(a));
-	memset(A, 0, sizeof(A));
 
-	size_t bn = book_ctops(b, B, xb->book, BOOK_SIDE_BID, cqty, ntop);
-	size_t an = book_ctops(a, A, xb->book, BOOK_SIDE_ASK, cqty, ntop);
+	const qx_t c = xscale(cqty, cscl.q, xb->scl.q);
+	/* level i is at (i + 1) * c, with quanta, unlike book_ctops() */
+	for (bn = 0U; bn < ntop; bn++) {
+		bc[bn] = book_ctop(xb->book, BOOK_SIDE_BID, c * (qx_t)(bn + 1U));
+		if (NOT_A_QUO_P(bc[bn])) {
+			break;
+		}
+		b[bn] = bc[bn].p;
+	}
+	for (an = 0U; an < ntop; an++) {
+		ac[an] = book_ctop(xb->book, BOOK_SIDE_ASK, c * (qx_t)(an + 1U));
+		if (NOT_A_QUO_P(ac[an])) {
+			break;
+		}
+		a[an] = ac[an].p;
+	}
 
 	if (!memcmp(b, xb->bids, sizeof(b)) &&
 	    !memcmp(a, xb->asks, sizeof(a))) {
@@ -351,9 +461,8 @@ prqcn(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 		return;
 	}
 
-	qx_t eoc = cqty;
 	size_t n = ntop < bn && ntop < an ? ntop : bn < an ? an : bn;
-	for (size_t i = 0U; i < n; i++, eoc += cqty) {
+	for (size_t i = 0U; i < n; i++) {
 		char buf[256U];
 		size_t len = 0U;
 
@@ -361,28 +470,28 @@ prqcn(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 				"c%zu", i + 1U);
 		buf[len++] = '\t';
 		if (i < bn) {
-			len += pxtostr(
-				buf + len, sizeof(buf) - len, b[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					bc[i].p, xb->scl.p, bc[i].pe);
 		}
 		buf[len++] = '\t';
 		if (i < an) {
-			len += pxtostr(
-				buf + len, sizeof(buf) - len, a[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					ac[i].p, xb->scl.p, ac[i].pe);
 		}
 		buf[len++] = '\t';
 		if (i < bn) {
-			len += qxtostr(
-				buf + len, sizeof(buf) - len, B[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					bc[i].q, xb->scl.q, bc[i].qe);
 		}
 		buf[len++] = '\t';
 		if (i < an) {
-			len += qxtostr(
-				buf + len, sizeof(buf) - len, A[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					ac[i].q, xb->scl.q, ac[i].qe);
 		}
 		buf[len++] = '\n';
 
-		fwrite(prfx, 1, prfz, stdout);
-		fwrite(buf, 1, len, stdout);
+		obuf_write(prfx, prfz);
+		obuf_write(buf, len);
 	}
 
 	memcpy(xb->bids, b, sizeof(b));
@@ -398,8 +507,15 @@ prqv(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 	char buf[256U];
 	size_t len = 0U;
 
-	bc = book_vtop(xb->book, BOOK_SIDE_BID, cqty);
-	ac = book_vtop(xb->book, BOOK_SIDE_ASK, cqty);
+	if (!xb->chg.lvlp) {
+		/* book's unchanged */
+		return;
+	}
+
+	const qx_t c = xscale(cqty, cscl.q, xb->scl.p + xb->scl.q);
+
+	bc = book_vtop(xb->book, BOOK_SIDE_BID, c);
+	ac = book_vtop(xb->book, BOOK_SIDE_ASK, c);
 
 	if (bc.p == xb->bid && ac.p == xb->ask) {
 		return;
@@ -412,24 +528,28 @@ prqv(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 	buf[len++] = '1';
 	buf[len++] = '\t';
 	if (bc.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, bc.p);
+		len += pxetostr(buf + len, sizeof(buf) - len,
+				bc.p, xb->scl.p, bc.pe);
 	}
 	buf[len++] = '\t';
 	if (ac.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, ac.p);
+		len += pxetostr(buf + len, sizeof(buf) - len,
+				ac.p, xb->scl.p, ac.pe);
 	}
 	buf[len++] = '\t';
 	if (bc.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, bc.q);
+		len += qxetostr(buf + len, sizeof(buf) - len,
+				bc.q, xb->scl.q, bc.qe);
 	}
 	buf[len++] = '\t';
 	if (ac.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, ac.q);
+		len += qxetostr(buf + len, sizeof(buf) - len,
+				ac.q, xb->scl.q, ac.qe);
 	}
 	buf[len++] = '\n';
 
-	fwrite(prfx, 1, prfz, stdout);
-	fwrite(buf, 1, len, stdout);
+	obuf_write(prfx, prfz);
+	obuf_write(buf, len);
 	return;
 }
 
@@ -437,18 +557,36 @@ static void
 prqvn(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 {
 /* convert to n-books, aligned */
+	book_quo_t bc[ntop];
+	book_quo_t ac[ntop];
 	px_t b[ntop];
-	qx_t B[ntop];
 	px_t a[ntop];
-	qx_t A[ntop];
+	size_t bn, an;
+
+	if (!xb->chg.lvlp) {
+		/* book's unchanged */
+		return;
+	}
 
 	memset(b, 0, sizeof(b));
-	memset(B, 0, sizeof(B));
 	memset(a, 0, sizeof(a));
-	memset(A, 0, sizeof(A));
 
-	size_t bn = book_vtops(b, B, xb->book, BOOK_SIDE_BID, cqty, ntop);
-	size_t an = book_vtops(a, A, xb->book, BOOK_SIDE_ASK, cqty, ntop);
+	const qx_t c = xscale(cqty, cscl.q, xb->scl.p + xb->scl.q);
+	/* level i is at (i + 1) * c, with quanta, unlike book_vtops() */
+	for (bn = 0U; bn < ntop; bn++) {
+		bc[bn] = book_vtop(xb->book, BOOK_SIDE_BID, c * (qx_t)(bn + 1U));
+		if (NOT_A_QUO_P(bc[bn])) {
+			break;
+		}
+		b[bn] = bc[bn].p;
+	}
+	for (an = 0U; an < ntop; an++) {
+		ac[an] = book_vtop(xb->book, BOOK_SIDE_ASK, c * (qx_t)(an + 1U));
+		if (NOT_A_QUO_P(ac[an])) {
+			break;
+		}
+		a[an] = ac[an].p;
+	}
 
 	if (!memcmp(b, xb->bids, sizeof(b)) &&
 	    !memcmp(a, xb->asks, sizeof(a))) {
@@ -456,9 +594,8 @@ prqvn(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 		return;
 	}
 
-	qx_t eoc = cqty;
 	size_t n = ntop < bn && ntop < an ? ntop : bn < an ? an : bn;
-	for (size_t i = 0U; i < n; i++, eoc += cqty) {
+	for (size_t i = 0U; i < n; i++) {
 		char buf[256U];
 		size_t len = 0U;
 
@@ -466,28 +603,28 @@ prqvn(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 				"c%zu", i + 1U);
 		buf[len++] = '\t';
 		if (i < bn) {
-			len += pxtostr(
-				buf + len, sizeof(buf) - len, b[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					bc[i].p, xb->scl.p, bc[i].pe);
 		}
 		buf[len++] = '\t';
 		if (i < an) {
-			len += pxtostr(
-				buf + len, sizeof(buf) - len, a[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					ac[i].p, xb->scl.p, ac[i].pe);
 		}
 		buf[len++] = '\t';
 		if (i < bn) {
-			len += qxtostr(
-				buf + len, sizeof(buf) - len, B[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					bc[i].q, xb->scl.q, bc[i].qe);
 		}
 		buf[len++] = '\t';
 		if (i < an) {
-			len += qxtostr(
-				buf + len, sizeof(buf) - len, A[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					ac[i].q, xb->scl.q, ac[i].qe);
 		}
 		buf[len++] = '\n';
 
-		fwrite(prfx, 1, prfz, stdout);
-		fwrite(buf, 1, len, stdout);
+		obuf_write(prfx, prfz);
+		obuf_write(buf, len);
 	}
 
 	memcpy(xb->bids, b, sizeof(b));
@@ -495,6 +632,130 @@ prqvn(xbook_t *xb, book_quo_t UNUSED(q), book_quo_t UNUSED(o))
 	return;
 }
 
+
+/* books by id, or by id / NSHRD in the shards */
+struct shelf_s {
+	xbook_t *book;
+	size_t n;
+	size_t z;
+};
+static struct shelf_s *shlf;
+static size_t nshrd = 1U;
+/* set when books couldn't be set up */
+static _Atomic int werr;
+
+static book_quo_t
+lvl_del(const xbook_t *xb, book_side_t s, book_iter_t i)
+{
+/* quote that takes level I off side S, its 0 has no decimal places */
+	book_quo_t r = {s, BOOK_LVL_2, .p = i.p, .q = 0};
+
+#if defined BOOKSI64
+	r.pe = i.pe;
+	r.qe = xb->scl.q;
+#else  /* !BOOKSI64 */
+	(void)xb;
+#endif	/* BOOKSI64 */
+	return r;
+}
+
+static void
+work(size_t w, const shev_t *ev)
+{
+/* bring quote EV to its book, in shard W */
+	struct shelf_s *sh = shlf + w;
+	size_t j;
+	xquo_t q;
+	xbook_t *xb;
+	book_quo_t o;
+
+	if (UNLIKELY(ev == NULL)) {
+		/* shard's stopping */
+		return;
+	}
+	j = ev->k / nshrd;
+	q = ev->q;
+	while (UNLIKELY(j >= sh->n)) {
+		/* initialise the book, and the ones before */
+		if (UNLIKELY(sh->n >= sh->z)) {
+			const size_t nuz = 2U * sh->z ?: 8U;
+			xbook_t *nu = realloc(sh->book, nuz * sizeof(*nu));
+
+			if (UNLIKELY(nu == NULL)) {
+				/* no book, no quote */
+				werr = -1;
+				return;
+			}
+			sh->book = nu;
+			sh->z = nuz;
+		}
+		sh->book[sh->n++] = make_xbook();
+	}
+	xb = sh->book + j;
+	prfx = ev->ln;
+	prfz = ev->lz;
+	/* bring quote and book to the same decimal places */
+	rescale_xbook(xb, q.scl);
+	q.q = rescale_quo(q, xb->scl);
+	/* we have to unwind second levels manually
+	 * because we need to print the interim steps,
+	 * a level-1 quote without price unwinds nothing, and neither
+	 * do trades */
+	if (UNLIKELY(q.q.f == BOOK_LVL_1 && !isnanpx(q.q.p) &&
+		     (q.q.s == BOOK_SIDE_BID || q.q.s == BOOK_SIDE_ASK) &&
+		     (prq == prq2 || prq == prq3))) {
+		book_iter_t i = book_iter(xb->book, q.q.s);
+		while (book_iter_next(&i) &&
+		       (q.q.s == BOOK_SIDE_BID && i.p > q.q.p ||
+			q.q.s == BOOK_SIDE_ASK && i.p < q.q.p)) {
+			book_quo_t r = lvl_del(xb, q.q.s, i);
+
+			o = book_add(xb->book, r);
+			prq(xb, r, o);
+		}
+	} else if (UNLIKELY(q.q.s == BOOK_SIDE_CLR)) {
+		if (UNLIKELY(prq == prq2 || prq == prq3)) {
+			/* do it manually so we can print
+			 * the interim steps */
+			book_iter_t i;
+
+			i = book_iter(xb->book, BOOK_SIDE_BID);
+			while (book_iter_next(&i)) {
+				book_quo_t r = lvl_del(xb, BOOK_SIDE_BID, i);
+
+				o = book_add(xb->book, r);
+				prq(xb, r, o);
+			}
+
+			i = book_iter(xb->book, BOOK_SIDE_ASK);
+			while (book_iter_next(&i)) {
+				book_quo_t r = lvl_del(xb, BOOK_SIDE_ASK, i);
+
+				o = book_add(xb->book, r);
+				prq(xb, r, o);
+			}
+			return;
+		}
+	}
+	/* add to book */
+	o = book_add_ex(xb->book, q.q, 0U, &xb->chg);
+	/* printx */
+	prq(xb, q.q, o);
+	return;
+}
+
+static void
+dispatch(shard_t s, shev_t ev)
+{
+/* hand EV to the shards, or do it ourselves */
+	if (s != NULL) {
+		shard_send(s, ev);
+	} else {
+		work(0U, &ev);
+	}
+	return;
+}
+
 
 #include "book2book.yucc"
 
@@ -503,10 +764,12 @@ main(int argc, char *argv[])
 {
 	static yuck_t argi[1U];
 	int rc = EXIT_SUCCESS;
-	static hx_t *conx;
-	static xbook_t *book;
+	static intern_t ins;
+	static xin_t in;
+	static shard_t shrd;
 	static size_t nbook;
-	static size_t zbook;
+	/* whether every instrument gets a book */
+	bool allp = false;
 	size_t nctch = 0U;
 
 	if (yuck_parse(argi, argc, argv) < 0) {
@@ -560,7 +823,7 @@ Error: cannot read number of levels for top-N book");
 		/* advance S if value consolidation */
 		s += *s == '/';
 
-		if ((cqty = strtoqx(s, NULL)) <= 0.dd) {
+		if ((cqty = strtoqx(s, NULL, &cscl.q)) <= 0) {
 			errno = 0, serror("\
 Error: cannot read consolidated quantity");
 			rc = EXIT_FAILURE;
@@ -568,145 +831,174 @@ Error: cannot read consolidated quantity");
 		}
 	}
 
-	if ((nbook = argi->instr_nargs)) {
-		const char *const *cont = argi->instr_args;
-		size_t j = 0U;
+	tick = NANPX;
+	if (argi->ladder_arg == YUCK_OPTARG_NONE) {
+		tick = 0;
+	} else if (argi->ladder_arg &&
+		   !((tick = strtopx(
+				argi->ladder_arg, NULL, &cscl.p)) > 0)) {
+		errno = 0, serror("\
+Error: cannot read ladder tick size");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
 
-		/* initialise hash array and books */
-		conx = malloc(nbook * sizeof(*conx));
-		book = malloc(nbook * sizeof(*book));
+	ins = make_intern();
+	if (argi->instr_nargs || argi->instr_file_arg) {
+		const char *const *cont = argi->instr_args;
 
-		for (size_t i = 0U; i < nbook; i++) {
+		for (size_t i = 0U; i < argi->instr_nargs; i++) {
 			const size_t conz = strlen(cont[i]);
 
 			if (UNLIKELY(conz == 0U ||
 				     conz == 1U && *cont[i] == '*')) {
-				/* catch-all hash */
+				/* catch-all */
+				nctch = 1U;
 				continue;
 			}
-			conx[j] = hash(cont[i], strlen(cont[i]));
-			book[j] = make_xbook();
-			j++;
-		}
-		if (j < nbook) {
-			/* oh, there's been catch-alls,
-			 * shrink NBOOK and initialise last cell */
-			nbook = j;
-			conx[nbook] = HX_CATCHALL;
-			book[nbook] = make_xbook();
-			nctch = 1U;
+			intern(ins, cont[i], conz);
 		}
+		if (argi->instr_file_arg) {
+			ssize_t n = read_instrs(ins, argi->instr_file_arg);
+
+			if (UNLIKELY(n < 0)) {
+				serror("\
+Error: cannot read instruments from `%s'", argi->instr_file_arg);
+				free_intern(ins);
+				rc = EXIT_FAILURE;
+				goto out;
+			}
+			nctch |= n > 0;
+		}
+		/* duplicates have been folded, books are by id,
+		 * the catch-all book goes last */
+		nbook = intern_cnt(ins);
 	} else {
-		/* allocate some 8U books */
-		zbook = 8U;
-		conx = malloc(zbook * sizeof(*conx));
-		book = malloc(zbook * sizeof(*book));
+		allp = true;
+	}
+
+	if (argi->threads_arg) {
+		if (!(nshrd = strtoul(argi->threads_arg, NULL, 10))) {
+			errno = 0, serror("\
+Error: cannot read number of threads");
+			rc = EXIT_FAILURE;
+			goto out;
+		}
+	}
+	shlf = calloc(nshrd, sizeof(*shlf));
+
+	/* open the inputs */
+	size_t nprs = 0U;
+	int cpu = -1;
+	if (argi->parsers_arg &&
+	    !(nprs = strtoul(argi->parsers_arg, NULL, 10))) {
+		errno = 0, serror("\
+Error: cannot read number of parsers");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+	if (argi->pipeline_arg || nprs) {
+		/* reader, parsers, books and writer go to CPU, CPU+1, ... */
+		if (argi->pipeline_arg &&
+		    argi->pipeline_arg != YUCK_OPTARG_NONE) {
+			cpu = strtol(argi->pipeline_arg, NULL, 10);
+		}
+		nprs += !nprs;
+		if (UNLIKELY((in = make_xin(
+				      argi->nargs, argi->args,
+				      nprs, cpu)) == NULL ||
+			     obuf_async(cpu >= 0
+					? cpu + (int)nprs + 2 : -1) < 0)) {
+			serror("\
+Error: cannot set up pipeline");
+			rc = EXIT_FAILURE;
+			goto out;
+		}
+		pin_stage(cpu >= 0 ? cpu + (int)nprs + 1 : -1);
+	} else if (UNLIKELY((in = make_xin(
+				     argi->nargs, argi->args,
+				     0U, -1)) == NULL)) {
+		serror("\
+Error: cannot set up input");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+	/* shards go after that */
+	if (nshrd > 1U &&
+	    UNLIKELY((shrd = make_shard(
+			      nshrd, work,
+			      cpu >= 0 ? cpu + (int)nprs + 3 : -1)) == NULL)) {
+		serror("\
+Error: cannot set up threads");
+		rc = EXIT_FAILURE;
+		goto out;
 	}
 
 	/* initialise the processor */
 	{
-		char *line = NULL;
-		size_t llen = 0UL;
+		const char *line;
+		xquo_t q;
+		size_t k = NOT_AN_ID;
 
-		for (ssize_t nrd; (nrd = getline(&line, &llen, stdin)) > 0;) {
-			xquo_t q;
-			size_t k;
-			book_quo_t o;
-			hx_t hx;
-
-			if (NOT_A_XQUO_P(q = read_xquo(line, nrd))) {
-				/* invalid quote line */
+		/* without catch-alls lines can be filtered early */
+		if (!allp && !nctch) {
+			xin_filter(in, ins);
+		}
+		for (int st;
+		     (st = next_xquo(in, &q, &line, &k)); k = NOT_AN_ID) {
+			/* prefix from BOL till end of q.INS */
+			size_t lz;
+
+			if (UNLIKELY(st < 0)) {
+				serror("Error: cannot open file `%s'", line);
+				rc = EXIT_FAILURE;
 				continue;
 			}
-			/* set prefix from BOL till end of q.INS */
-			prfx = line;
-			prfz = q.ins + q.inz + !!q.inz - line ;
+			lz = q.ins + q.inz + !!q.inz - line;
 			/* check if we've got him in our books */
-			if (nbook || zbook) {
-				hx = hash(q.ins, q.inz);
-				for (k = 0U; k < nbook; k++) {
-					if (conx[k] == hx) {
-						goto unwnd;
-					}
+			if (k < nbook) {
+				/* read_xquo_ins() has looked him up */
+				goto work;
+			} else if (!allp) {
+				if ((k = intern_get(ins, q.ins, q.inz)) < nbook) {
+					goto work;
+				} else if (nctch) {
+					k = nbook;
+					goto work;
 				}
-			}
-			if (nctch) {
-				goto unwnd;
-			} else if (!zbook) {
 				/* ok, it's not for us */
 				continue;
-			} else if (UNLIKELY(nbook >= zbook)) {
-				/* resize */
-				zbook *= 2U;
-				conx = realloc(conx, zbook * sizeof(*conx));
-				book = realloc(book, zbook * sizeof(*book));
-			}
-			/* initialise the book */
-			conx[nbook] = hx, book[nbook] = make_xbook(), nbook++;
-		unwnd:
-			/* we have to unwind second levels manually
-			 * because we need to print the interim steps */
-			if (UNLIKELY(q.q.f == BOOK_LVL_1 &&
-				     (prq == prq2 || prq == prq3))) {
-				book_iter_t i = book_iter(book[k].book, q.q.s);
-				while (book_iter_next(&i) &&
-				       (q.q.s == BOOK_SIDE_BID && i.p > q.q.p ||
-					q.q.s == BOOK_SIDE_ASK && i.p < q.q.p)) {
-					book_quo_t r = {
-						q.q.s, BOOK_LVL_2,
-						.p = i.p,
-						.q = 0.dd
-					};
-					o = book_add(book[k].book, r);
-					prq(book + k, r, o);
-				}
-			} else if (UNLIKELY(q.q.s == BOOK_SIDE_CLR)) {
-				if (UNLIKELY(prq == prq2 || prq == prq3)) {
-					/* do it manually so we can print
-					 * the interim steps */
-					book_iter_t i;
-
-					i = book_iter(book[k].book, BOOK_SIDE_BID);
-					while (book_iter_next(&i)) {
-						book_quo_t r = {
-							BOOK_SIDE_BID,
-							BOOK_LVL_2,
-							.p = i.p,
-							.q = 0.dd,
-						};
-						o = book_add(book[k].book, r);
-						prq(book + k, r, o);
-					}
-
-					i = book_iter(book[k].book, BOOK_SIDE_ASK);
-					while (book_iter_next(&i)) {
-						book_quo_t r = {
-							BOOK_SIDE_ASK,
-							BOOK_LVL_2,
-							.p = i.p,
-							.q = 0.dd,
-						};
-						o = book_add(book[k].book, r);
-						prq(book + k, r, o);
-					}
-					continue;
-				}
+			} else if (LIKELY((k = intern(ins, q.ins, q.inz)) < nbook)) {
+				goto work;
+			} else if (UNLIKELY(k == NOT_AN_ID)) {
+				continue;
 			}
-			/* add to book */
-			o = book_add(book[k].book, q.q);
-			/* printx */
-			prq(book + k, q.q, o);
+			/* it's a new book, work() will set it up */
+			nbook++;
+		work:
+			dispatch(shrd, (shev_t){
+					 k, .q = q, .ln = line, .lz = lz});
+		}
+		if (shrd != NULL && UNLIKELY(free_shard(shrd) < 0)) {
+			werr = -1;
+		}
+		obuf_flush();
+		if (UNLIKELY(werr)) {
+			serror("\
+Error: out of memory, output is incomplete");
+			rc = EXIT_FAILURE;
 		}
-		free(line);
 	}
+	free_xin(in);
 
-	if (nbook + nctch) {
-		for (size_t i = 0U; i < nbook + nctch; i++) {
-			book[i] = free_xbook(book[i]);
+	for (size_t w = 0U; w < nshrd; w++) {
+		for (size_t i = 0U; i < shlf[w].n; i++) {
+			shlf[w].book[i] = free_xbook(shlf[w].book[i]);
 		}
-		free(conx);
-		free(book);
+		free(shlf[w].book);
 	}
+	free(shlf);
+	free_intern(ins);
 
 out:
 	yuck_free(argi);
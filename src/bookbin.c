@@ -0,0 +1,289 @@
+/*** bookbin.c -- convert quotes to binary and back
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined HAVE_DFP754_H
+# include <dfp754.h>
+#endif	/* HAVE_DFP754_H */
+#include "dfp754_d32.h"
+#include "dfp754_d64.h"
+#include "intern.h"
+#include "books.h"
+#include "xquo.h"
+#include "xin.h"
+#include "obuf.h"
+#include "bq.h"
+#include "nifty.h"
+
+#if defined BOOKSI64
+# define pxtostr	i64tostr
+# define qxtostr	i64tostr
+#else  /* !BOOKSI64 */
+# define pxtostr(b, z, x, s)	((void)(s), d64tostr(b, z, x))
+# define qxtostr(b, z, x, s)	((void)(s), d64tostr(b, z, x))
+#endif	/* BOOKSI64 */
+
+
+static __attribute__((format(printf, 1, 2))) void
+serror(const char *fmt, ...)
+{
+	va_list vap;
+	va_start(vap, fmt);
+	vfprintf(stderr, fmt, vap);
+	va_end(vap);
+	if (errno) {
+		fputc(':', stderr);
+		fputc(' ', stderr);
+		fputs(strerror(errno), stderr);
+	}
+	fputc('\n', stderr);
+	return;
+}
+
+static void
+prtxt(xquo_t q, const char *ln, size_t lz)
+{
+/* print Q as text, LN being the stamp and instrument */
+	char buf[256U];
+	size_t len = 0U;
+
+	buf[len++] = (char)(q.q.s ^ '@');
+	if (q.q.f) {
+		buf[len++] = (char)(q.q.f ^ '0');
+	}
+	buf[len++] = '\t';
+	if (!isnanpx(q.q.p)) {
+		len += pxtostr(buf + len, sizeof(buf) - len, q.q.p, q.scl.p);
+	}
+	buf[len++] = '\t';
+	len += qxtostr(buf + len, sizeof(buf) - len, q.q.q, q.scl.q);
+	buf[len++] = '\n';
+
+	obuf_write(ln, lz);
+	obuf_write(buf, len);
+	return;
+}
+
+/* archive blocks in the making, and the block index */
+static bq_t *blkr;
+static size_t nblkr;
+static uint8_t *blkb;
+static bqblk_t *bidx;
+static size_t nbidx;
+static size_t zbidx;
+static uint64_t boff;
+
+static void
+prblk(void)
+{
+/* pack and print the quotes collected so far */
+	size_t z;
+
+	if (!nblkr) {
+		return;
+	} else if (UNLIKELY(nbidx >= zbidx)) {
+		zbidx = 2U * zbidx ?: 64U;
+		bidx = realloc(bidx, zbidx * sizeof(*bidx));
+	}
+	z = bq_pack(blkb, bidx + nbidx, blkr, nblkr);
+	bidx[nbidx++].off = boff;
+	obuf_write((const char*)blkb, z);
+	boff += z;
+	nblkr = 0U;
+	return;
+}
+
+static void
+prbin(xquo_t q, size_t k)
+{
+/* print Q as record for instrument K */
+	bq_t r;
+
+	/* records go to disk, no stray bytes please */
+	memset(&r, 0, sizeof(r));
+	r.t = q.q.t;
+	r.k = k < BQ_NOINS ? (uint32_t)k : BQ_NOINS;
+	r.s = (uint8_t)q.q.s;
+	r.f = (uint8_t)q.q.f;
+	r.scl = q.scl;
+	r.p = q.q.p;
+	r.q = q.q.q;
+
+	if (blkr == NULL) {
+		obuf_write((const char*)&r, sizeof(r));
+		return;
+	}
+	blkr[nblkr++] = r;
+	if (nblkr >= BQ_BLKN) {
+		prblk();
+	}
+	return;
+}
+
+
+#include "bookbin.yucc"
+
+int
+main(int argc, char *argv[])
+{
+	static yuck_t argi[1U];
+	int rc = EXIT_SUCCESS;
+	static intern_t ins;
+	static xin_t in;
+	bqhdr_t h = {BQ_MAGIC, BQ_FLAV, .nrec = 0U};
+	bool binp;
+
+	if (yuck_parse(argi, argc, argv) < 0) {
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+
+	if ((binp = !argi->decode_flag) && argi->archive_flag) {
+		memcpy(h.magic, BQ_MAGIC_ARC, sizeof(h.magic));
+		blkr = malloc(BQ_BLKN * sizeof(*blkr));
+		blkb = malloc(BQ_BLKZ(BQ_BLKN));
+		boff = sizeof(h);
+	}
+	if (binp) {
+		/* the header is written last, at offset 0 */
+		struct stat st;
+
+		if (fstat(STDOUT_FILENO, &st) < 0 || !S_ISREG(st.st_mode) ||
+		    lseek(STDOUT_FILENO, 0, SEEK_CUR) != 0) {
+			errno = 0, serror("\
+Error: binary output must go to a regular file");
+			rc = EXIT_FAILURE;
+			goto out;
+		}
+		obuf_write((const char*)&(bqhdr_t){}, sizeof(h));
+	}
+
+	if (UNLIKELY((in = make_xin(argi->nargs, argi->args, 0U, -1)) == NULL)) {
+		serror("\
+Error: cannot set up input");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+	if (argi->from_arg || argi->till_arg) {
+		tv_t from = 0U, till = NATV;
+
+		if (argi->from_arg) {
+			from = strtotv(argi->from_arg, NULL);
+		}
+		if (argi->till_arg) {
+			till = strtotv(argi->till_arg, NULL);
+		}
+		if (UNLIKELY(from == NATV ||
+			     till == NATV && argi->till_arg)) {
+			errno = 0, serror("\
+Error: cannot read time window");
+			rc = EXIT_FAILURE;
+			goto fin;
+		}
+		xin_window(in, from, till);
+	}
+
+	ins = make_intern();
+	{
+		const char *line;
+		xquo_t q;
+		size_t k = NOT_AN_ID;
+
+		for (int st;
+		     (st = next_xquo(in, &q, &line, &k)); k = NOT_AN_ID) {
+			if (UNLIKELY(st < 0)) {
+				serror("Error: cannot open file `%s'", line);
+				rc = EXIT_FAILURE;
+				continue;
+			} else if (!binp) {
+				prtxt(q, line, q.ins + q.inz + !!q.inz - line);
+				continue;
+			}
+			k = q.inz ? intern(ins, q.ins, q.inz) : NOT_AN_ID;
+			prbin(q, k);
+			h.nrec++;
+		}
+	}
+
+	if (binp) {
+		/* dictionary, block index, then the header */
+		prblk();
+		h.nins = intern_cnt(ins);
+		h.dict = blkr == NULL ? sizeof(h) + h.nrec * sizeof(bq_t) : boff;
+		for (size_t i = 0U; i < h.nins; i++) {
+			const size_t z = intern_len(ins, i);
+
+			obuf_write(intern_str(ins, i), z);
+			obuf_write("\n", 1U);
+			h.dicz += z + 1U;
+		}
+		if (blkr != NULL) {
+			h.blks = h.dict + h.dicz;
+			h.nblk = nbidx;
+			obuf_write((const char*)bidx, nbidx * sizeof(*bidx));
+		}
+		if (UNLIKELY(obuf_flush() < 0 ||
+			     pwrite(STDOUT_FILENO, &h, sizeof(h), 0) <
+			     (ssize_t)sizeof(h))) {
+			serror("\
+Error: cannot write binary output");
+			rc = EXIT_FAILURE;
+		}
+	} else {
+		obuf_flush();
+	}
+	free_intern(ins);
+	free(blkr);
+	free(blkb);
+	free(bidx);
+fin:
+	free_xin(in);
+
+out:
+	yuck_free(argi);
+	return rc;
+}
+
+/* bookbin.c ends here */
@@ -37,15 +37,19 @@
 #if defined HAVE_CONFIG_H
 # include "config.h"
 #endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 #if defined HAVE_DFP754_H
 # include <dfp754.h>
 #endif	/* HAVE_DFP754_H */
 #include "dfp754_d32.h"
 #include "dfp754_d64.h"
-#if !defined BOOKSD64 && !defined BOOKSD32
+#if !defined BOOKSD64 && !defined BOOKSD32 && !defined BOOKSI64
 # define BOOKS_MULTI
 # define BOOKSD64
-#endif	/* !BOOKSD64 && !BOOKSD32 */
+#endif	/* !BOOKSD64 && !BOOKSD32 && !BOOKSI64 */
 #include "books.h"
 #include "btree.h"
 #include "nifty.h"
@@ -54,87 +58,1133 @@
 # define books_c_once
 #endif
 
+#undef side_s
+#undef expq_s
+#undef ladder_s
+#undef lvl_sum
+#undef lvl_vwap
+#undef ladder_idx
+#undef ladder_next
+#undef ladder_prev
+#undef ladder_seek
+#undef ladder_put
+#undef ladder_drop
+#undef ladder_move
+#undef ladder_fail
+#undef expq_push
+#undef expq_pop
+#undef expq_fill
+#undef side_get
+#undef side_compact
+#undef side_newtop
+#undef side_fix
+#undef side_retop
+#undef side_depth
+#undef side_iter_at
+#undef view_same
+#undef view_mark
+#undef view_fill
+#undef view_upd
+#undef view_set
+#undef view_mov
+#undef side_set
+#undef side_upd
+#undef side_top
+#undef side_find
+#undef make_side
+#undef book_clr1
+#undef book_iter_prev
+#undef quantizeqx
+#undef divpx
+#undef lvl_val
+#undef cpyqex
+#undef minqex
+#undef INFQX
+#undef INFVX
+
 #if 0
 
+#elif defined BOOKSI64
+# define side_s		sidei64_s
+# define expq_s		expqi64_s
+# define ladder_s	ladderi64_s
+# define lvl_sum	lvli64_sum
+# define lvl_vwap	lvli64_vwap
+# define ladder_idx	ladderi64_idx
+# define ladder_next	ladderi64_next
+# define ladder_prev	ladderi64_prev
+# define ladder_seek	ladderi64_seek
+# define ladder_put	ladderi64_put
+# define ladder_drop	ladderi64_drop
+# define ladder_move	ladderi64_move
+# define ladder_fail	ladderi64_fail
+# define expq_push	expqi64_push
+# define expq_pop	expqi64_pop
+# define expq_fill	expqi64_fill
+# define side_get	sidei64_get
+# define side_compact	sidei64_compact
+# define side_newtop	sidei64_newtop
+# define side_fix	sidei64_fix
+# define side_retop	sidei64_retop
+# define side_depth	sidei64_depth
+# define side_iter_at	sidei64_iter_at
+# define view_same	viewi64_same
+# define view_mark	viewi64_mark
+# define view_fill	viewi64_fill
+# define view_upd	viewi64_upd
+# define view_set	viewi64_set
+# define view_mov	viewi64_mov
+# define side_set	sidei64_set
+# define side_upd	sidei64_upd
+# define side_top	sidei64_top
+# define side_find	sidei64_find
+# define make_side	make_sidei64
+# define book_clr1	booki64_clr1
+# define book_iter_prev	booki64_iter_prev
 #elif defined BOOKSD32
 #define quantizepx	quantized32
+#define quantexppx	quantexpd32
+#define scalbnpx	scalbnd32
+# define side_s		sided32_s
+# define expq_s		expqd32_s
+# define ladder_s	ladderd32_s
+# define lvl_sum	lvld32_sum
+# define lvl_vwap	lvld32_vwap
+# define ladder_idx	ladderd32_idx
+# define ladder_next	ladderd32_next
+# define ladder_prev	ladderd32_prev
+# define ladder_seek	ladderd32_seek
+# define ladder_put	ladderd32_put
+# define ladder_drop	ladderd32_drop
+# define ladder_move	ladderd32_move
+# define ladder_fail	ladderd32_fail
+# define expq_push	expqd32_push
+# define expq_pop	expqd32_pop
+# define expq_fill	expqd32_fill
+# define side_get	sided32_get
+# define side_compact	sided32_compact
+# define side_newtop	sided32_newtop
+# define side_fix	sided32_fix
+# define side_retop	sided32_retop
+# define side_depth	sided32_depth
+# define side_iter_at	sided32_iter_at
+# define view_same	viewd32_same
+# define view_mark	viewd32_mark
+# define view_fill	viewd32_fill
+# define view_upd	viewd32_upd
+# define view_set	viewd32_set
+# define view_mov	viewd32_mov
+# define side_set	sided32_set
+# define side_upd	sided32_upd
+# define side_top	sided32_top
+# define side_find	sided32_find
+# define make_side	make_sided32
+# define book_clr1	bookd32_clr1
+# define book_iter_prev	bookd32_iter_prev
 #elif defined BOOKSD64
 #define quantizepx	quantized64
+#define quantexppx	quantexpd64
+#define scalbnpx	scalbnd64
+# define side_s		sided64_s
+# define expq_s		expqd64_s
+# define ladder_s	ladderd64_s
+# define lvl_sum	lvld64_sum
+# define lvl_vwap	lvld64_vwap
+# define ladder_idx	ladderd64_idx
+# define ladder_next	ladderd64_next
+# define ladder_prev	ladderd64_prev
+# define ladder_seek	ladderd64_seek
+# define ladder_put	ladderd64_put
+# define ladder_drop	ladderd64_drop
+# define ladder_move	ladderd64_move
+# define ladder_fail	ladderd64_fail
+# define expq_push	expqd64_push
+# define expq_pop	expqd64_pop
+# define expq_fill	expqd64_fill
+# define side_get	sided64_get
+# define side_compact	sided64_compact
+# define side_newtop	sided64_newtop
+# define side_fix	sided64_fix
+# define side_retop	sided64_retop
+# define side_depth	sided64_depth
+# define side_iter_at	sided64_iter_at
+# define view_same	viewd64_same
+# define view_mark	viewd64_mark
+# define view_fill	viewd64_fill
+# define view_upd	viewd64_upd
+# define view_set	viewd64_set
+# define view_mov	viewd64_mov
+# define side_set	sided64_set
+# define side_upd	sided64_upd
+# define side_top	sided64_top
+# define side_find	sided64_find
+# define make_side	make_sided64
+# define book_clr1	bookd64_clr1
+# define book_iter_prev	bookd64_iter_prev
 #endif
-#define quantizeqx	quantized64
 
-
+#if defined BOOKSI64
+/* results are rounded to the quantum of the level V they end in,
+ * in whole ticks and lots */
+# define divpx(n, d, k, v)	((px_t)quantvx(divvx(n, d), (v).pe))
+# define quantizeqx(x, v)	((qx_t)quantvx(x, (v).qe))
+/* level values from quotes or iterators, and back, quanta included */
+# define lvl_val(x)	((btree_val_t){(x).q, (x).t, (x).pe, (x).qe})
+# define cpyqex(x, v)	((x).pe = (v).pe, (x).qe = (v).qe)
+# define minqex(x, v)	((x).qe = (v).qe < (x).qe ? (v).qe : (x).qe)
+# define INFQX		INT64_MAX
+# define INFVX		((btree_vx_t)INT64_MAX << 62U)
+#else  /* !BOOKSI64 */
+/* results are rounded to the quantum of the level they end in */
+# define divpx(n, d, k, v)	quantizepx((px_t)((n) / (d)), k)
+# define quantizeqx(x, v)	quantized64(x, (v).q)
+/* decimals carry their quanta themselves */
+# define lvl_val(x)	((btree_val_t){(x).q, (x).t})
+# define cpyqex(x, v)	((void)(v))
+# define minqex(x, v)	((void)(v))
+# define INFQX		INFD64
+# define INFVX		((btree_vx_t)INFD64)
+#endif	/* BOOKSI64 */
+
+#if defined books_c_once
+/* ladders span this many ticks, multiple of 64 please */
+# define NLADDER	256U
+/* room to leave in front of the top when re-centring */
+# define NHEADRM	(NLADDER / 8U)
+#endif	/* books_c_once */
+
+/* a ladder is a ring of NLADDER slots, the level at tick index X lives
+ * in slot X mod NLADDER, and the window covers the tick indices
+ * TOP .. TOP + NLADDER - 1, for bids tick indices are negated so
+ * the better levels come first either way
+ * levels beyond the window are kept in the btree which never holds
+ * anything better than what's in the ladder */
+struct ladder_s {
+	/* tick size, and whether we're to infer it from the prices */
+	px_t tick;
+	bool autop;
+	/* tick index of the window's first slot */
+	int64_t top;
+	/* number of live slots and the sums over them */
+	size_t n;
+	btree_sum_t sum;
+	uint64_t live[NLADDER / 64U];
+	px_t key[NLADDER];
+	btree_val_t val[NLADDER];
+};
+
+/* min-heap of level time stamps, for expiry
+ * entries aren't removed when their level changes, instead they're
+ * checked against the level when they come out */
+struct expq_s {
+	size_t n;
+	size_t z;
+	/* number of entries after the last refill */
+	size_t m;
+	/* set when levels couldn't be queued, expiry must scan the side */
+	bool lossp;
+	struct {
+		tv_t t;
+		px_t p;
+	} *e;
+};
+
+struct side_s {
+	btree_t t;
+	struct ladder_s *l;
+	/* expiry queue, built on the first book_exp() */
+	struct expq_s *x;
+	bool descp;
+	/* levels expired since the last compaction and levels left then */
+	size_t nexp;
+	size_t nlive;
+	/* cached top level, nil value if the side is empty,
+	 * and the number of times its price or quantity changed */
+	px_t topp;
+	btree_val_t topv;
+	size_t ntop;
+	/* top-N view, if asked for, its rows as of the last ack go
+	 * after its Z rows, there were VACK of them */
+	book_view_t *v;
+	size_t vack;
+};
+
+
 #if defined books_c_once
-static inline __attribute__((pure, const)) tv_t
+static inline __attribute__((const)) tv_t
 min_tv(tv_t t1, tv_t t2)
 {
 	return t1 <= t2 ? t1 : t2;
 }
 
-static inline __attribute__((pure, const)) tv_t
+static inline __attribute__((const)) tv_t
 max_tv(tv_t t1, tv_t t2)
 {
 	return t1 >= t2 ? t1 : t2;
 }
+
+static inline __attribute__((const)) __int128
+divvx(__int128 n, __int128 d)
+{
+/* N / D in whole units, D > 0, rounded the way the decimal flavours
+ * get there: the quotient has 16 significant digits (rounded half to
+ * even) and quantized64() then rounds it digit by digit (half up) */
+	const bool negp = n < 0;
+	__int128 q, r;
+	uint_least64_t f = 0U;
+	unsigned int nd = 0U, nf = 0U;
+
+	n = negp ? -n : n;
+	q = n / d;
+	r = n % d;
+	for (__int128 x = q; x > 0; x /= 10, nd++);
+	/* fractional digits up to the 16th significant one */
+	for (unsigned int ns = nd; ns < 16U && r && nf < 38U; nf++) {
+		r *= 10;
+		f = f * 10U + (uint_least64_t)(r / d);
+		r %= d;
+		ns += q > 0 || f > 0U;
+	}
+	if (2 * r > d || 2 * r == d && (nf ? f % 2U : q % 2)) {
+		f++;
+	}
+	for (; nf > 0U; nf--) {
+		f = f / 10U + (f % 10U >= 5U);
+	}
+	q += f;
+	return negp ? -q : q;
+}
+
+static inline __attribute__((const)) __int128
+quantvx(__int128 x, unsigned int e)
+{
+/* X rounded to a multiple of 10^E, digit by digit (half up) like
+ * quantized64() does it */
+	const bool negp = x < 0;
+	__int128 m = 1;
+
+	x = negp ? -x : x;
+	for (; e > 0U && x; e--, m *= 10) {
+		x = x / 10 + (x % 10 >= 5);
+	}
+	x *= m;
+	return negp ? -x : x;
+}
 #endif
 
-
+static inline btree_sum_t
+lvl_sum(px_t k, btree_val_t v)
+{
+/* like the btree's idea of it */
+	if (btree_val_nil_p(v) || !(v.q > 0)) {
+		return btree_sum_nil;
+	}
+	return (btree_sum_t){v.q, (btree_vx_t)k * v.q};
+}
+
+static inline px_t
+lvl_vwap(qx_t *restrict q, btree_sum_t c, px_t k, btree_vx_t V, btree_val_t v)
+{
+/* C holds the running sums up to and including level K, the one at which
+ * value V is reached, return V's average price and put its quantity
+ * into Q, both in the quanta of K's level value V */
+#if defined BOOKSI64
+	/* stay exact by counting in units of 1/K */
+	const btree_vx_t Q = (btree_vx_t)c.q * k - (c.v - V);
+
+	*q = quantizeqx(divvx(Q, k), v);
+	return divpx(V * k, Q, k, v);
+#else  /* !BOOKSI64 */
+	/* c.v - V is exactly what we open too much */
+	const qx_t Q = c.q - (c.v - V) / k;
+
+	*q = quantizeqx(Q, v);
+	return divpx(V, Q, k, v);
+#endif	/* BOOKSI64 */
+}
+
+static int
+ladder_idx(int64_t *restrict x, const struct ladder_s *l, px_t p, bool descp)
+{
+/* put P's tick index into X, return -1 if P is off the grid */
+#if defined BOOKSI64
+	long long int i;
+
+	if (UNLIKELY(isnanpx(p) || l->tick <= 0 || p % l->tick)) {
+		return -1;
+	}
+	i = p / l->tick;
+#else  /* !BOOKSI64 */
+	const _Decimal64 r = (_Decimal64)p / (_Decimal64)l->tick;
+	long long int i;
+
+	if (UNLIKELY(!(r > -1e18dd && r < 1e18dd))) {
+		return -1;
+	} else if (UNLIKELY((_Decimal64)(i = (long long int)r) != r)) {
+		return -1;
+	}
+#endif	/* BOOKSI64 */
+	*x = descp ? -i : i;
+	return 0;
+}
+
+static size_t
+ladder_next(const struct ladder_s *l, size_t d)
+{
+/* return the depth of the first live slot at depth D or beyond */
+	while (d < NLADDER) {
+		const size_t s = (uint64_t)(l->top + d) % NLADDER;
+		const uint64_t w = l->live[s / 64U] >> (s % 64U);
+
+		if (w) {
+			d += __builtin_ctzll(w);
+			return d < NLADDER ? d : NLADDER;
+		}
+		d += 64U - s % 64U;
+	}
+	return NLADDER;
+}
+
+static size_t
+ladder_prev(const struct ladder_s *l, size_t d)
+{
+/* return the depth of the last live slot before depth D, or NLADDER */
+	while (d > 0U) {
+		const size_t s = (uint64_t)(l->top + d - 1U) % NLADDER;
+		const uint64_t w = l->live[s / 64U] << (63U - s % 64U);
+
+		if (w) {
+			const size_t k = __builtin_clzll(w);
+			return k < d ? d - 1U - k : NLADDER;
+		}
+		d = d > s % 64U ? d - s % 64U - 1U : 0U;
+	}
+	return NLADDER;
+}
+
+static btree_val_t
+ladder_put(struct ladder_s *l, int64_t x, px_t p, btree_val_t v, bool addp)
+{
+/* put V (or add it if ADDP) under tick index X, return the old value */
+	const size_t s = (uint64_t)x % NLADDER;
+	const uint64_t b = 1ULL << (s % 64U);
+	const bool livep = (l->live[s / 64U] & b) != 0U;
+	const btree_val_t o = livep ? l->val[s] : btree_val_nil;
+	btree_sum_t so, sn;
+
+	v = !addp ? v : btree_val_add(o, v);
+	so = livep ? lvl_sum(l->key[s], o) : btree_sum_nil;
+	l->key[s] = livep ? l->key[s] : p;
+	l->val[s] = v;
+	if (!btree_val_nil_p(v)) {
+		l->live[s / 64U] |= b;
+		l->n += !livep;
+		sn = lvl_sum(l->key[s], v);
+	} else {
+		l->live[s / 64U] &= ~b;
+		l->n -= livep;
+		sn = btree_sum_nil;
+	}
+	if (LIKELY(l->n)) {
+		l->sum.q += sn.q - so.q;
+		l->sum.v += sn.v - so.v;
+	} else {
+		l->sum = btree_sum_nil;
+	}
+	return o;
+}
+
+static void
+ladder_drop(struct side_s *s, size_t d)
+{
+/* move the ladder's levels from depth D onwards to the tree */
+	struct ladder_s *l = s->l;
+
+	for (; (d = ladder_next(l, d)) < NLADDER; d++) {
+		const size_t i = (uint64_t)(l->top + d) % NLADDER;
+
+		btree_set(s->t, l->key[i], l->val[i]);
+		ladder_put(l, l->top + d, l->key[i], btree_val_nil, false);
+	}
+	return;
+}
+
+static void
+ladder_move(struct side_s *s, int64_t top)
+{
+/* move the window to start at TOP, what ends up behind the window goes
+ * to the tree and what the tree has inside the window is reeled in,
+ * the caller makes sure nothing ends up in front of it */
+	struct ladder_s *l = s->l;
+
+	if (top < l->top) {
+		const uint64_t k = l->top - top;
+
+		ladder_drop(s, k < NLADDER ? NLADDER - k : 0U);
+	}
+	l->top = top;
+	for (btree_iter_t i = {.t = s->t}; btree_iter_next(&i);) {
+		int64_t x;
+
+		if (ladder_idx(&x, l, i.k, s->descp) < 0 ||
+		    x - top >= (int64_t)NLADDER) {
+			break;
+		}
+		ladder_put(l, x, i.k, *i.v, false);
+		btree_upd(s->t, i.k, btree_val_nil);
+	}
+	return;
+}
+
+static bool
+ladder_fail(struct side_s *s, px_t p)
+{
+/* P is off the grid, so everything goes to the tree,
+ * then either refine the tick and return true, or bin the ladder */
+	struct ladder_s *l = s->l;
+
+	ladder_drop(s, 0U);
+	if (l->autop && !isinfpx(p)) {
+#if defined BOOKSI64
+		/* nothing's finer than a tick */
+		l->tick = 1;
+#else  /* !BOOKSI64 */
+		l->tick = scalbnpx((px_t)1, quantexppx(p));
+#endif	/* BOOKSI64 */
+		return true;
+	}
+	free(l);
+	s->l = NULL;
+	return false;
+}
+
+static btree_val_t*
+side_top(struct side_s *s, px_t *k)
+{
+	const struct ladder_s *l = s->l;
+
+	if (l != NULL && l->n) {
+		const size_t i =
+			(uint64_t)(l->top + ladder_next(l, 0U)) % NLADDER;
+
+		*k = l->key[i];
+		return s->l->val + i;
+	}
+	return btree_top(s->t, k);
+}
+
+static btree_val_t*
+side_get(struct side_s *s, px_t p)
+{
+	struct ladder_s *l = s->l;
+	int64_t x;
+
+	if (l != NULL && !isnanpx(p) && !(ladder_idx(&x, l, p, s->descp) < 0) &&
+	    x >= l->top && x - l->top < (int64_t)NLADDER) {
+		const size_t i = (uint64_t)x % NLADDER;
+
+		return l->live[i / 64U] >> (i % 64U) & 1U ? l->val + i : NULL;
+	}
+	return btree_get(s->t, p);
+}
+
+static void
+side_compact(struct side_s *s)
+{
+	s->nlive = btree_compact(s->t);
+	s->nexp = 0U;
+	return;
+}
+
+static int
+expq_push(struct expq_s *x, tv_t t, px_t p)
+{
+	size_t i;
+
+	if (UNLIKELY(x->n >= x->z)) {
+		const size_t nuz = (x->z * 2U) ?: 64U;
+		void *nux = realloc(x->e, nuz * sizeof(*x->e));
+
+		if (UNLIKELY(nux == NULL)) {
+			/* the level goes unqueued, make that known */
+			x->lossp = true;
+			return -1;
+		}
+		x->e = nux;
+		x->z = nuz;
+	}
+	/* sift up */
+	for (i = x->n++; i > 0U; i = (i - 1U) / 2U) {
+		if (x->e[(i - 1U) / 2U].t <= t) {
+			break;
+		}
+		x->e[i] = x->e[(i - 1U) / 2U];
+	}
+	x->e[i].t = t;
+	x->e[i].p = p;
+	return 0;
+}
+
+static void
+expq_pop(struct expq_s *x)
+{
+/* drop the oldest entry */
+	const size_t n = --x->n;
+	size_t i = 0U;
+
+	/* sift the last one down from the root */
+	for (size_t c; (c = 2U * i + 1U) < n; i = c) {
+		c += c + 1U < n && x->e[c + 1U].t < x->e[c].t;
+		if (x->e[n].t <= x->e[c].t) {
+			break;
+		}
+		x->e[i] = x->e[c];
+	}
+	x->e[i] = x->e[n];
+	return;
+}
+
+static void
+expq_fill(struct side_s *s)
+{
+/* (re)build S's expiry queue from scratch */
+	s->x->n = 0U;
+	s->x->lossp = false;
+	for (book_iter_t i = {.b = s}; book_iter_next(&i);) {
+		if (UNLIKELY(expq_push(s->x, i.t, i.p) < 0)) {
+			break;
+		}
+	}
+	s->x->m = s->x->n;
+	return;
+}
+
+static void
+side_newtop(struct side_s *s, px_t p, btree_val_t v)
+{
+	if (btree_val_nil_p(v)) {
+		s->ntop += !btree_val_nil_p(s->topv);
+		s->topv = btree_val_nil;
+		return;
+	}
+	s->ntop += btree_val_nil_p(s->topv) ||
+		!(p == s->topp && v.q == s->topv.q);
+	s->topp = p;
+	s->topv = v;
+	return;
+}
+
+static void
+side_retop(struct side_s *s)
+{
+/* look the top up again */
+	btree_val_t *v;
+	px_t k;
+
+	if ((v = side_top(s, &k)) == NULL) {
+		side_newtop(s, NANPX, btree_val_nil);
+		return;
+	}
+	side_newtop(s, k, *v);
+	return;
+}
+
+static void
+side_fix(struct side_s *s, px_t p, btree_val_t v)
+{
+/* P's level has become V, keep the cached top in line */
+	const px_t k = s->topp;
+
+	if (btree_val_nil_p(s->topv) ||
+	    (UNLIKELY(isnanpx(k)) ? !isnanpx(p)
+	     : !isnanpx(p) && (s->descp ? p > k : p < k))) {
+		/* better than the top (nans sort last), or the first level */
+		if (!btree_val_nil_p(v)) {
+			side_newtop(s, p, v);
+		}
+	} else if (p == k && !btree_val_nil_p(v)) {
+		/* the top itself, keep its key though */
+		side_newtop(s, k, v);
+	} else if (p == k || isnanpx(p) && isnanpx(k)) {
+		/* top's gone, or nans which we can't tell apart */
+		side_retop(s);
+	}
+	return;
+}
+
+static size_t
+ladder_seek(const struct side_s *s, px_t p)
+{
+/* return the depth of P, or of the first level after P, or NLADDER */
+	const struct ladder_s *l = s->l;
+	int64_t x;
+	size_t d;
+
+	if (!(ladder_idx(&x, l, p, s->descp) < 0)) {
+		return x <= l->top ? 0U
+			: x - l->top < (int64_t)NLADDER ? x - l->top
+			: NLADDER;
+	} else if (UNLIKELY(isnanpx(p))) {
+		/* nans come after anything on the ladder */
+		return NLADDER;
+	}
+	/* off the grid, just look */
+	for (d = 0U; (d = ladder_next(l, d)) < NLADDER; d++) {
+		const px_t k = l->key[(uint64_t)(l->top + d) % NLADDER];
+
+		if (s->descp ? k <= p : k >= p) {
+			break;
+		}
+	}
+	return d;
+}
+
+static book_iter_t
+side_iter_at(const struct side_s *s, px_t p)
+{
+/* iterator over S starting at P, or the first level after it */
+	book_iter_t r = {.b = deconst(s)};
+	btree_iter_t i;
+
+	if (s->l != NULL && s->l->n && (r.i = ladder_seek(s, p)) < NLADDER) {
+		/* the tree is worse than the ladder, so worse than P too */
+		return r;
+	}
+	/* skip the ladder altogether */
+	i = btree_seek(s->t, p);
+	r.c = i.t;
+	r.i = i.i;
+	return r;
+}
+
+static inline bool
+view_same(const struct side_s *s, size_t i)
+{
+/* whether row I is as it was at the last ack */
+	const book_view_t *v = s->v;
+
+	if (i >= v->n || i >= s->vack) {
+		return i >= v->n && i >= s->vack;
+	}
+#if defined BOOKSI64
+	if (v->pe[i] != v->pe[v->z + i] || v->qe[i] != v->qe[v->z + i]) {
+		return false;
+	}
+#endif	/* BOOKSI64 */
+	return !memcmp(v->p + i, v->p + v->z + i, sizeof(*v->p)) &&
+		!memcmp(v->q + i, v->q + v->z + i, sizeof(*v->q));
+}
+
+static void
+view_mark(struct side_s *s, size_t lo, size_t hi)
+{
+/* mark rows LO up to HI, rows that are back to what was acked
+ * at either end of the marks don't count */
+	book_view_t *v = s->v;
+
+	lo = lo < v->lo ? lo : v->lo;
+	hi = hi > v->hi ? hi : v->hi;
+	for (; lo < hi && view_same(s, lo); lo++);
+	for (; hi > lo && view_same(s, hi - 1U); hi--);
+	if (lo >= hi) {
+		lo = v->z;
+		hi = 0U;
+	}
+	v->lo = lo;
+	v->hi = hi;
+	return;
+}
+
+static inline void
+view_set(book_view_t *v, size_t i, px_t p, btree_val_t x)
+{
+/* make row I the level at P with value X */
+	v->p[i] = p;
+	v->q[i] = x.q;
+#if defined BOOKSI64
+	v->pe[i] = x.pe;
+	v->qe[i] = x.qe;
+#endif	/* BOOKSI64 */
+	return;
+}
+
+static inline void
+view_mov(book_view_t *v, size_t to, size_t from, size_t n)
+{
+/* move N rows from row FROM to row TO */
+	memmove(v->p + to, v->p + from, n * sizeof(*v->p));
+	memmove(v->q + to, v->q + from, n * sizeof(*v->q));
+#if defined BOOKSI64
+	memmove(v->pe + to, v->pe + from, n * sizeof(*v->pe));
+	memmove(v->qe + to, v->qe + from, n * sizeof(*v->qe));
+#endif	/* BOOKSI64 */
+	return;
+}
+
+static void
+view_fill(struct side_s *s)
+{
+/* build the view from scratch */
+	book_view_t *v = s->v;
+	const size_t o = v->n;
+
+	v->n = 0U;
+	for (book_iter_t i = {.b = s};
+	     v->n < v->z && book_iter_next(&i); v->n++) {
+		view_set(v, v->n, i.p, lvl_val(i));
+	}
+	view_mark(s, 0U, o > v->n ? o : v->n);
+	return;
+}
+
+static void
+view_upd(struct side_s *s, px_t p, btree_val_t x)
+{
+/* P's level has become X, keep the view in line */
+	book_view_t *v = s->v;
+	size_t lo = 0U, hi = v->n;
+
+	/* rows are sorted best first, bisect */
+	while (lo < hi) {
+		const size_t m = (lo + hi) / 2U;
+		const px_t k = v->p[m];
+
+		if (!isnanpx(k) &&
+		    (isnanpx(p) || (s->descp ? k > p : k < p))) {
+			lo = m + 1U;
+		} else {
+			hi = m;
+		}
+	}
+	if (lo < v->n && (v->p[lo] == p || isnanpx(v->p[lo]) && isnanpx(p))) {
+		if (!btree_val_nil_p(x)) {
+			/* just a new quantity, which might be the acked one */
+			view_set(v, lo, v->p[lo], x);
+			view_mark(s, lo, lo + 1U);
+			return;
+		}
+		/* level's gone, move the others up */
+		view_mov(v, lo, lo + 1U, v->n - lo - 1U);
+		if (v->n-- < v->z) {
+			/* view had all there is */
+			view_mark(s, lo, v->n + 1U);
+			return;
+		}
+		/* fill the last row with the level after the last row */
+		with (book_iter_t i = {.b = s}) {
+			if (v->n) {
+				i = side_iter_at(s, v->p[v->n - 1U]);
+			}
+			while (book_iter_next(&i)) {
+				if (v->n && (i.p == v->p[v->n - 1U] ||
+					     isnanpx(i.p) &&
+					     isnanpx(v->p[v->n - 1U]))) {
+					continue;
+				}
+				view_set(v, v->n++, i.p, lvl_val(i));
+				break;
+			}
+		}
+		view_mark(s, lo, v->z);
+	} else if (!btree_val_nil_p(x) && lo < v->z) {
+		/* new level, move the others down, the last one might drop */
+		const size_t n = v->n - (v->n >= v->z);
+
+		view_mov(v, lo + 1U, lo, n - lo);
+		view_set(v, lo, p, x);
+		v->n = n + 1U;
+		view_mark(s, lo, v->n);
+	}
+	return;
+}
+
+static btree_val_t
+side_set(struct side_s *s, px_t p, btree_val_t v, bool addp)
+{
+	struct ladder_s *l = s->l;
+	btree_val_t o;
+	int64_t x = 0;
+
+	if (l == NULL || UNLIKELY(isnanpx(p))) {
+		/* nans sort last anyway */
+		goto tree;
+	} else if (UNLIKELY(ladder_idx(&x, l, p, s->descp) < 0)) {
+		/* even the refined tick can leave P off the grid, huge
+		 * prices for instance, the tree will have to do then */
+		if (!ladder_fail(s, p) ||
+		    UNLIKELY(ladder_idx(&x, l, p, s->descp) < 0)) {
+			goto tree;
+		}
+	}
+
+	if (UNLIKELY(!l->n)) {
+		/* centre on X or on the tree's best, whichever is better */
+		btree_key_t k;
+		int64_t y;
+
+		if (btree_top(s->t, &k) == NULL ||
+		    ladder_idx(&y, l, k, s->descp) < 0 || y > x) {
+			y = x;
+		}
+		ladder_move(s, y - (int64_t)NHEADRM);
+	} else if (x < l->top) {
+		/* new best level */
+		ladder_move(s, x - (int64_t)NHEADRM);
+	} else if (x - l->top >= (int64_t)NLADDER) {
+		/* see if the top drifted off */
+		const size_t d = ladder_next(l, 0U);
+
+		if (d >= NLADDER / 2U) {
+			ladder_move(s, l->top + (int64_t)(d - NHEADRM));
+		}
+	}
+	if (x - l->top < (int64_t)NLADDER) {
+		o = ladder_put(l, x, p, v, addp);
+		goto fix;
+	}
+tree:
+	o = !addp ? btree_set(s->t, p, v) : btree_add(s->t, p, v);
+fix:
+	v = !addp ? v : btree_val_add(o, v);
+#if defined BOOKSI64
+	if (!btree_val_nil_p(o) && !btree_val_nil_p(v) && v.pe != o.pe) {
+		/* live levels keep their keys, like the decimal flavours */
+		side_get(s, p)->pe = v.pe = o.pe;
+	}
+#endif	/* BOOKSI64 */
+	side_fix(s, p, v);
+	if (UNLIKELY(s->v != NULL)) {
+		view_upd(s, p, v);
+	}
+	if (s->x != NULL && !btree_val_nil_p(v) &&
+	    (btree_val_nil_p(o) || o.t != v.t)) {
+		/* queue the level under its new time stamp, unless the
+		 * queue is mostly stale entries, then start afresh */
+		if (UNLIKELY(s->x->n >= 2U * s->x->m + 1024U)) {
+			expq_fill(s);
+		} else {
+			expq_push(s->x, v.t, p);
+		}
+	}
+	return o;
+}
+
+static btree_val_t
+side_upd(struct side_s *s, px_t p, btree_val_t v)
+{
+/* like side_set() but without creating levels or moving the window */
+	struct ladder_s *l = s->l;
+	int64_t x;
+
+	if (l != NULL && !isnanpx(p) && !(ladder_idx(&x, l, p, s->descp) < 0) &&
+	    x >= l->top && x - l->top < (int64_t)NLADDER) {
+		return ladder_put(l, x, p, v, false);
+	}
+	return btree_upd(s->t, p, v);
+}
+
+static size_t
+side_depth(struct side_s *s, px_t p, size_t n)
+{
+/* count levels better than P, at most N of them */
+	size_t d = 0U;
+
+	for (book_iter_t i = {.b = s}; d < n && book_iter_next(&i); d++) {
+		if (isnanpx(i.p) ||
+		    !isnanpx(p) && (s->descp ? i.p <= p : i.p >= p)) {
+			break;
+		}
+	}
+	return d;
+}
+
+static btree_val_t*
+side_find(struct side_s *s, btree_sum_t lim, px_t *k, btree_sum_t *c)
+{
+/* like btree_find() but start in the ladder */
+	struct ladder_s *l = s->l;
+	btree_sum_t r = btree_sum_nil;
+
+	if (l == NULL || !l->n) {
+		;
+	} else if (l->sum.q < lim.q && l->sum.v < lim.v) {
+		/* skip the whole ladder */
+		r = l->sum;
+	} else {
+		for (size_t d = 0U; (d = ladder_next(l, d)) < NLADDER; d++) {
+			const size_t i = (uint64_t)(l->top + d) % NLADDER;
+			const btree_sum_t x = lvl_sum(l->key[i], l->val[i]);
+
+			if (!(x.q > 0)) {
+				continue;
+			} else if (r.q + x.q >= lim.q || r.v + x.v >= lim.v) {
+				*k = l->key[i];
+				*c = r;
+				return l->val + i;
+			}
+			r.q += x.q;
+			r.v += x.v;
+		}
+	}
+	*c = r;
+	return btree_find(s->t, lim, k, c);
+}
+
+static struct side_s*
+make_side(struct side_s *s, bool descp, px_t tick)
+{
+	if (UNLIKELY((s->t = make_btree(descp)) == NULL)) {
+		return NULL;
+	}
+	s->descp = descp;
+	s->topp = NANPX;
+	s->topv = btree_val_nil;
+	if (!isnanpx(tick)) {
+		struct ladder_s *l = calloc(1U, sizeof(*l));
+
+		if (UNLIKELY(l == NULL)) {
+			return NULL;
+		}
+		l->tick = tick;
+		l->autop = !(tick > (px_t)0);
+		s->l = l;
+	}
+	return s;
+}
+
+static void
+book_clr1(struct side_s *s)
+{
+	struct ladder_s *l = s->l;
+
+	btree_clr(s->t);
+	if (l != NULL) {
+		for (size_t i = 0U; i < countof(l->val); i++) {
+			l->val[i] = btree_val_nil;
+		}
+		memset(l->live, 0, sizeof(l->live));
+		l->n = 0U;
+		l->sum = btree_sum_nil;
+	}
+	if (s->x != NULL) {
+		s->x->n = s->x->m = 0U;
+	}
+	side_newtop(s, NANPX, btree_val_nil);
+	if (UNLIKELY(s->v != NULL)) {
+		view_fill(s);
+	}
+	return;
+}
+
+
 book_t
 make_book(void)
 {
-	book_t r = {
+	return make_book_ladder(NANPX);
+}
+
+book_t
+make_book_ladder(px_t tick)
+{
+	struct side_s *s = calloc(2U, sizeof(*s));
+	book_t r;
+
+	if (UNLIKELY(s == NULL)) {
+		return (book_t){};
+	}
+	r = (book_t){
 		.quos = {
-			[BIDX(BOOK_SIDE_ASK)] = make_btree(false),
-			[BIDX(BOOK_SIDE_BID)] = make_btree(true),
+			[BIDX(BOOK_SIDE_ASK)] = s + 0U,
+			[BIDX(BOOK_SIDE_BID)] = s + 1U,
 		}
 	};
+	if (UNLIKELY(make_side(s + 0U, false, tick) == NULL ||
+		     make_side(s + 1U, true, tick) == NULL)) {
+		/* free_book() copes with half-made sides */
+		return free_book(r);
+	}
 	return r;
 }
 
 book_t
 free_book(book_t b)
 {
-	free_btree(b.quos[0U]);
-	free_btree(b.quos[1U]);
+	struct side_s *s = b.quos[0U];
+
+	if (UNLIKELY(s == NULL)) {
+		return (book_t){};
+	}
+	for (size_t i = 0U; i < countof(b.quos); i++) {
+		if (s[i].t != NULL) {
+			free_btree(s[i].t);
+		}
+		free(s[i].l);
+		if (s[i].x != NULL) {
+			free(s[i].x->e);
+			free(s[i].x);
+		}
+		if (s[i].v != NULL) {
+			free(s[i].v->p);
+			free(s[i].v->q);
+#if defined BOOKSI64
+			free(s[i].v->pe);
+			free(s[i].v->qe);
+#endif	/* BOOKSI64 */
+			free(s[i].v);
+		}
+	}
+	free(s);
 	return (book_t){};
 }
 
+int
+book_prealloc(book_t b, size_t nlvl)
+{
+/* leaves are at least half full after a split, i.e. 31 levels a piece,
+ * and the same goes for the twigs above them, plus one spare root for
+ * the root split */
+	struct side_s *s = b.quos[0U];
+	size_t m = 1U;
+	int rc = 0;
+
+	for (size_t k = (nlvl + 30U) / 31U; k > 1U; k = (k + 30U) / 31U) {
+		m += k;
+	}
+	for (size_t i = 0U; i < countof(b.quos); i++) {
+		rc |= btree_prealloc(s[i].t, m + 1U);
+	}
+	return rc;
+}
+
 book_quo_t
 book_add(book_t b, book_quo_t q)
 {
 	switch (q.s) {
+		struct side_s *s;
 	case BOOK_SIDE_BID:
 	case BOOK_SIDE_ASK:
+		s = b.BOOK(q.s);
 		/* proceed with level treatment */
 		switch (q.f) {
-			btree_val_t *tmp;
-			qx_t o;
-			tv_t t;
+			btree_val_t o;
 		case BOOK_LVL_3:
-			tmp = btree_put(b.BOOK(q.s), q.p);
-			o = tmp->q;
-			t = tmp->t;
-			q.q += o;
-			tmp->q = q.q >= 0.df ? q.q : 0.df;
-			tmp->t = q.t;
-			q.q = o;
-			q.t = t;
+			o = side_set(s, q.p, lvl_val(q), true);
+			q.q = o.q;
+			q.t = o.t;
+			cpyqex(q, o);
 			break;
 		case BOOK_LVL_2:
-			tmp = btree_put(b.BOOK(q.s), q.p);
-			o = tmp->q;
-			t = tmp->t;
-			tmp->q = q.q;
-			tmp->t = q.t;
-			q.q = o;
-			q.t = t;
+			o = side_set(s, q.p, lvl_val(q), false);
+			q.q = o.q;
+			q.t = o.t;
+			cpyqex(q, o);
 			break;
 		case BOOK_LVL_1:
-			if (UNLIKELY(q.q < 0.df)) {
+			if (UNLIKELY(q.q < 0)) {
 				/* what an odd level-1 quote */
 				return NOT_A_QUO;
 			}
-			btree_clr(b.BOOK(q.s));
+			book_clr1(s);
 			if (UNLIKELY(isnanpx(q.p))) {
 				break;
 			}
@@ -142,30 +1192,49 @@ book_add(book_t b, book_quo_t q)
 			 * in the books ...
 			 * we put the value first so it's guaranteed
 			 * to be in there */
-			tmp = btree_put(b.BOOK(q.s), q.p);
-			o = tmp->q;
-			t = tmp->t;
-			tmp->q = q.q;
-			tmp->t = q.t;
-			q.q = o;
-			q.t = t;
+			o = side_set(s, q.p, lvl_val(q), false);
+			q.q = o.q;
+			q.t = o.t;
+			cpyqex(q, o);
 			break;
 		case BOOK_LVL_0:
 		default:
 			goto inv;
 		}
+		if (UNLIKELY(btree_sparse_p(s->t))) {
+			/* too many dead levels about, bin them */
+			side_compact(s);
+		}
 		break;
 	case BOOK_SIDE_CLR:
 		book_clr(b);
 		break;
 	case BOOK_SIDE_DEL:
-		for (btree_iter_t i = {.t = b.BOOK(BOOK_SIDE_ASK)};
-		     btree_iter_next(&i) && i.k <= q.p;) {
-			i.v->q = i.k < q.p ? 0.df : i.v->q - q.q;
+		for (book_iter_t i = book_iter_lmt(
+			     book_iter(b, BOOK_SIDE_ASK), q.p);
+		     book_iter_next(&i);) {
+			btree_val_t v = lvl_val(i);
+
+			v.q = i.p < q.p ? (qx_t)0 : i.q - q.q;
+			minqex(v, q);
+			side_upd(b.BOOK(BOOK_SIDE_ASK), i.p, v);
+		}
+		for (book_iter_t i = book_iter_lmt(
+			     book_iter(b, BOOK_SIDE_BID), q.p);
+		     book_iter_next(&i);) {
+			btree_val_t v = lvl_val(i);
+
+			v.q = i.p > q.p ? (qx_t)0 : i.q - q.q;
+			minqex(v, q);
+			side_upd(b.BOOK(BOOK_SIDE_BID), i.p, v);
 		}
-		for (btree_iter_t i = {.t = b.BOOK(BOOK_SIDE_BID)};
-		     btree_iter_next(&i) && i.k >= q.p;) {
-			i.v->q = i.k > q.p ? 0.df : i.v->q - q.q;
+		for (size_t i = 0U; i < countof(b.quos); i++) {
+			struct side_s *x = b.quos[i];
+
+			side_retop(x);
+			if (UNLIKELY(x->v != NULL)) {
+				view_fill(x);
+			}
 		}
 		break;
 	default:
@@ -178,11 +1247,52 @@ inv:
 	return NOT_A_QUO;
 }
 
+book_quo_t
+book_add_ex(book_t b, book_quo_t q, size_t n, book_chg_t *chg)
+{
+	struct side_s *s;
+	size_t ntop;
+	book_quo_t o;
+
+	switch (q.s) {
+	case BOOK_SIDE_BID:
+	case BOOK_SIDE_ASK:
+		s = b.BOOK(q.s);
+		break;
+	default:
+		/* whole-book business, assume the worst */
+		o = book_add(b, q);
+		*chg = (book_chg_t){0U, true, true, n > 0U};
+		return o;
+	}
+
+	ntop = s->ntop;
+	o = book_add(b, q);
+	if (UNLIKELY(NOT_A_QUO_P(o))) {
+		*chg = (book_chg_t){.d = n};
+		return o;
+	} else if (q.f == BOOK_LVL_1) {
+		/* side's been wiped */
+		*chg = (book_chg_t){0U, true, s->ntop != ntop, n > 0U};
+		return o;
+	}
+	with (const btree_val_t *v = side_get(s, q.p)) {
+		const qx_t nq = v != NULL && !btree_val_nil_p(*v) ? v->q : 0;
+		const qx_t oq = o.q > 0 ? o.q : 0;
+
+		chg->d = side_depth(s, q.p, n);
+		chg->lvlp = nq != oq;
+		chg->topp = s->ntop != ntop;
+		chg->topnp = chg->d < n && chg->lvlp;
+	}
+	return o;
+}
+
 void
 book_clr(book_t b)
 {
-	btree_clr(b.BOOK(BOOK_SIDE_BID));
-	btree_clr(b.BOOK(BOOK_SIDE_ASK));
+	book_clr1(b.BOOK(BOOK_SIDE_BID));
+	book_clr1(b.BOOK(BOOK_SIDE_ASK));
 	return;
 }
 
@@ -196,51 +1306,106 @@ book_exp(book_t b, tv_t t)
 		return;
 	}
 	/* otherwise */
-	for (btree_iter_t i = {b.BOOK(BOOK_SIDE_ASK)}; btree_iter_next(&i);) {
-		if (i.v->t <= t) {
-			*i.v = btree_val_nil;
+	for (size_t i = 0U; i < countof(b.quos); i++) {
+		struct side_s *s = b.quos[i];
+		size_t nx = 0U;
+
+		if (UNLIKELY(s->x == NULL)) {
+			/* first time round, from now on levels are queued
+			 * by their time stamps as they come in */
+			if ((s->x = calloc(1U, sizeof(*s->x))) == NULL) {
+				continue;
+			}
+			expq_fill(s);
 		}
-	}
-	for (btree_iter_t i = {b.BOOK(BOOK_SIDE_BID)}; btree_iter_next(&i);) {
-		if (i.v->t <= t) {
-			*i.v = btree_val_nil;
+		if (UNLIKELY(s->x->lossp)) {
+			/* the queue missed levels, go through all of them
+			 * and try and build the queue anew */
+			for (book_iter_t j = {.b = s}; book_iter_next(&j);) {
+				if (j.t <= t) {
+					side_upd(s, j.p, btree_val_nil);
+					nx++;
+				}
+			}
+			expq_fill(s);
+		}
+		while (s->x->n && s->x->e->t <= t) {
+			const px_t p = s->x->e->p;
+			const btree_val_t *v = side_get(s, p);
+
+			expq_pop(s->x);
+			if (v != NULL && !btree_val_nil_p(*v) && v->t <= t) {
+				side_upd(s, p, btree_val_nil);
+				nx++;
+			}
+		}
+		if (!nx) {
+			continue;
+		} else if ((s->nexp += nx) > s->nlive + 256U ||
+			   btree_sparse_p(s->t)) {
+			/* mass extinction, tidy up */
+			side_compact(s);
+		}
+		side_retop(s);
+		if (UNLIKELY(s->v != NULL)) {
+			view_fill(s);
 		}
 	}
 	return;
 }
 
+void
+book_compact(book_t b)
+{
+	for (size_t i = 0U; i < countof(b.quos); i++) {
+		side_compact(b.quos[i]);
+	}
+	return;
+}
+
 book_quo_t
 book_top(book_t b, book_side_t s)
 {
-	btree_iter_t i = {.t = b.BOOK(s)};
+	const struct side_s *x = b.BOOK(s);
+	book_quo_t r;
 
-	if (UNLIKELY(!btree_iter_next(&i))) {
+	if (UNLIKELY(btree_val_nil_p(x->topv))) {
 		return NOT_A_QUO;
 	}
-	return (book_quo_t){
-		.s = s, .f = BOOK_LVL_1, .p = i.k, .q = i.v->q, .t = i.v->t
+	r = (book_quo_t){
+		.s = s, .f = BOOK_LVL_1,
+		.p = x->topp, .q = x->topv.q, .t = x->topv.t
 	};
+	cpyqex(r, x->topv);
+	return r;
+}
+
+size_t
+book_ntop(book_t b)
+{
+	const struct side_s *s = b.quos[0U];
+	return s[0U].ntop + s[1U].ntop;
 }
 
 size_t
 book_tops(px_t *restrict p, qx_t *restrict q, book_t b, book_side_t s, size_t n)
 {
-	btree_iter_t i = {.t = b.BOOK(s)};
+	book_iter_t i = book_iter(b, s);
 	size_t j;
 
 	if (UNLIKELY(q == NULL)) {
 		goto only_p;
 	}
 
-	for (j = 0U; j < n && btree_iter_next(&i); j++) {
-		p[j] = i.k;
-		q[j] = i.v->q;
+	for (j = 0U; j < n && book_iter_next(&i); j++) {
+		p[j] = i.p;
+		q[j] = i.q;
 	}
 	return j;
 
 only_p:
-	for (j = 0U; j < n && btree_iter_next(&i); j++) {
-		p[j] = i.k;
+	for (j = 0U; j < n && book_iter_next(&i); j++) {
+		p[j] = i.p;
 	}
 	return j;
 }
@@ -248,32 +1413,39 @@ only_p:
 book_quo_t
 book_ctop(book_t b, book_side_t s, qx_t q)
 {
-	btree_iter_t i = {.t = b.BOOK(s)};
-	qx_t P = 0.df, Q = 0.df;
+	btree_val_t *v;
+	btree_sum_t c;
+	px_t k;
+	btree_vx_t P;
+	qx_t Q;
+	book_quo_t r;
 
-	for (; Q < q && btree_iter_next(&i);) {
-		P += i.k * i.v->q;
-		Q += i.v->q;
-	}
-	if (UNLIKELY(Q < q)) {
+	v = side_find(b.BOOK(s), (btree_sum_t){q, INFVX}, &k, &c);
+	if (UNLIKELY(v == NULL)) {
 		return NOT_A_QUO;
-	} else if (LIKELY(Q > q)) {
-		P -= i.k * (Q - q);
 	}
-	return (book_quo_t){
+	P = c.v + (btree_vx_t)k * v->q;
+	Q = c.q + v->q;
+	if (LIKELY(Q > q)) {
+		P -= (btree_vx_t)k * (Q - q);
+	}
+	r = (book_quo_t){
 		.s = s, .f = BOOK_LVL_1,
-		.p = quantizepx((px_t)(P / q), i.k),
-		.q = quantizeqx(q, i.v->q),
-		.t = i.v->t,
+		.p = divpx(P, q, k, *v),
+		.q = quantizeqx(q, *v),
+		.t = v->t,
 	};
+	cpyqex(r, *v);
+	return r;
 }
 
 size_t
 book_ctops(px_t *restrict p, qx_t *restrict q,
 	   book_t b, book_side_t s, qx_t Q, size_t n)
 {
-	btree_iter_t i = {.t = b.BOOK(s)};
-	qx_t c = 0.df, C = 0.df;
+	btree_val_t *v;
+	btree_sum_t c;
+	px_t k;
 	size_t j;
 	qx_t R;
 
@@ -282,62 +1454,63 @@ book_ctops(px_t *restrict p, qx_t *restrict q,
 	}
 
 	for (j = 0U, R = Q; j < n; j++, R += Q) {
-		for (; C < R && btree_iter_next(&i);) {
-			c += i.k * i.v->q;
-			C += i.v->q;
-		}
-		if (UNLIKELY(C < R)) {
+		v = side_find(b.BOOK(s), (btree_sum_t){R, INFVX}, &k, &c);
+		if (UNLIKELY(v == NULL)) {
 			break;
 		}
-		p[j] = quantizepx((px_t)((c - i.k * (C - R)) / R), i.k);
-		q[j] = quantizeqx(R, i.v->q);
+		c.v += (btree_vx_t)k * v->q;
+		c.q += v->q;
+		p[j] = divpx(c.v - (btree_vx_t)k * (c.q - R), R, k, *v);
+		q[j] = quantizeqx(R, *v);
 	}
 	return j;
 
 only_p:
 	for (j = 0U, R = Q; j < n; j++, R += Q) {
-		for (; C < R && btree_iter_next(&i);) {
-			c += i.k * i.v->q;
-			C += i.v->q;
-		}
-		if (UNLIKELY(C < R)) {
+		v = side_find(b.BOOK(s), (btree_sum_t){R, INFVX}, &k, &c);
+		if (UNLIKELY(v == NULL)) {
 			break;
 		}
-		p[j] = quantizepx((px_t)((c - i.k * (C - R)) / R), i.k);
+		c.v += (btree_vx_t)k * v->q;
+		c.q += v->q;
+		p[j] = divpx(c.v - (btree_vx_t)k * (c.q - R), R, k, *v);
 	}
 	return j;
 }
 
 book_quo_t
-book_vtop(book_t b, book_side_t s, qx_t v)
+book_vtop(book_t b, book_side_t s, qx_t V)
 {
-	btree_iter_t i = {.t = b.BOOK(s)};
-	qx_t P = 0.df, Q = 0.df;
+	btree_val_t *v;
+	btree_sum_t c;
+	px_t k, P;
+	qx_t Q;
+	book_quo_t r;
 
-	for (; P < v && btree_iter_next(&i);) {
-		P += i.k * i.v->q;
-		Q += i.v->q;
-	}
-	if (UNLIKELY(P < v)) {
+	v = side_find(b.BOOK(s), (btree_sum_t){INFQX, V}, &k, &c);
+	if (UNLIKELY(v == NULL)) {
 		return NOT_A_QUO;
-	} else if (LIKELY(P > v)) {
-		/* P - v is exactly what we open too much */
-		Q -= (P - v) / i.k;
 	}
-	return (book_quo_t){
+	c.v += (btree_vx_t)k * v->q;
+	c.q += v->q;
+	P = lvl_vwap(&Q, c, k, V, *v);
+	r = (book_quo_t){
 		.s = s, .f = BOOK_LVL_1,
-		.p = quantizepx((px_t)(v / Q), i.k),
-		.q = quantizeqx(Q, i.v->q),
-		.t = i.v->t,
+		.p = P,
+		.q = Q,
+		.t = v->t,
 	};
+	cpyqex(r, *v);
+	return r;
 }
 
 size_t
 book_vtops(px_t *restrict p, qx_t *restrict q,
-	   book_t b, book_side_t s, qx_t v, size_t n)
+	   book_t b, book_side_t s, qx_t V, size_t n)
 {
-	btree_iter_t i = {.t = b.BOOK(s)};
-	qx_t c = 0.df, C = 0.df;
+	btree_val_t *v;
+	btree_sum_t c;
+	px_t k;
 	size_t j;
 	qx_t r;
 
@@ -345,33 +1518,28 @@ book_vtops(px_t *restrict p, qx_t *restrict q,
 		goto only_p;
 	}
 
-	for (j = 0U, r = v; j < n; j++, r += v) {
-		qx_t Q;
-		for (; c < r && btree_iter_next(&i);) {
-			c += i.k * i.v->q;
-			C += i.v->q;
-		}
-		if (UNLIKELY(c < r)) {
+	for (j = 0U, r = V; j < n; j++, r += V) {
+		v = side_find(b.BOOK(s), (btree_sum_t){INFQX, r}, &k, &c);
+		if (UNLIKELY(v == NULL)) {
 			break;
 		}
-		Q = C - (c - r) / i.k;
-		p[j] = quantizepx((px_t)(r / Q), i.k);
-		q[j] = quantizeqx(Q, i.v->q);
+		c.v += (btree_vx_t)k * v->q;
+		c.q += v->q;
+		p[j] = lvl_vwap(q + j, c, k, r, *v);
 	}
 	return j;
 
 only_p:
-	for (j = 0U, r = v; j < n; j++, r += v) {
+	for (j = 0U, r = V; j < n; j++, r += V) {
 		qx_t Q;
-		for (; c < r && btree_iter_next(&i);) {
-			c += i.k * i.v->q;
-			C += i.v->q;
-		}
-		if (UNLIKELY(c < r)) {
+
+		v = side_find(b.BOOK(s), (btree_sum_t){INFQX, r}, &k, &c);
+		if (UNLIKELY(v == NULL)) {
 			break;
 		}
-		Q = C - (c - r) / i.k;
-		p[j] = quantizepx((px_t)(r / Q), i.k);
+		c.v += (btree_vx_t)k * v->q;
+		c.q += v->q;
+		p[j] = lvl_vwap(&Q, c, k, r, *v);
 	}
 	return j;
 }
@@ -380,38 +1548,206 @@ only_p:
 book_pdo_t
 book_pdo(book_t b, book_side_t s, qx_t q, px_t lmt)
 {
-	book_pdo_t r = {.base = 0.df, .term = 0.df, .yngt = 0U, .oldt = NATV};
+	book_pdo_t r = {.base = 0, .term = 0, .yngt = 0U, .oldt = NATV};
 
 	/* nan to +/- inf */
 	lmt = !isnanpx(lmt) ? lmt
 		: s == BOOK_SIDE_BID ? -INFPX
 		: s == BOOK_SIDE_ASK ? INFPX
 		: lmt;
-	for (btree_iter_t i = {.t = b.BOOK(s)};
-	     q > 0.df && btree_iter_next(&i) &&
-		     (s == BOOK_SIDE_BID && i.k >= lmt ||
-		      s == BOOK_SIDE_ASK && i.k <= lmt);) {
-		qx_t Q = i.v->q <= q ? i.v->q : q;
-		r.term += i.k * Q;
+	for (book_iter_t i = book_iter_lmt(book_iter(b, s), lmt);
+	     q > 0 && book_iter_next(&i);) {
+		qx_t Q = i.q <= q ? i.q : q;
+		r.term += i.p * Q;
 		r.base += Q;
-		r.yngt = max_tv(r.yngt, i.v->t);
-		r.oldt = min_tv(r.oldt, i.v->t);
+		r.yngt = max_tv(r.yngt, i.t);
+		r.oldt = min_tv(r.oldt, i.t);
 		q -= Q;
 	}
 	return r;
 }
 
 
+const book_view_t*
+book_view(book_t b, book_side_t s, size_t n)
+{
+	struct side_s *x = b.BOOK(s);
+	book_view_t *v = x->v;
+
+	if (v == NULL && (v = calloc(1U, sizeof(*v))) == NULL) {
+		return NULL;
+	}
+	if (n != v->z) {
+		/* twice the rows, the acked ones go after the live ones */
+		px_t *p = realloc(v->p, 2U * (n ?: 1U) * sizeof(*v->p));
+		qx_t *q = realloc(v->q, 2U * (n ?: 1U) * sizeof(*v->q));
+
+		v->p = p ?: v->p;
+		v->q = q ?: v->q;
+		if (UNLIKELY(p == NULL || q == NULL)) {
+			goto nomem;
+		}
+#if defined BOOKSI64
+		with (unsigned char *pe, *qe) {
+			pe = realloc(v->pe, 2U * (n ?: 1U) * sizeof(*v->pe));
+			qe = realloc(v->qe, 2U * (n ?: 1U) * sizeof(*v->qe));
+			v->pe = pe ?: v->pe;
+			v->qe = qe ?: v->qe;
+			if (UNLIKELY(pe == NULL || qe == NULL)) {
+				goto nomem;
+			}
+		}
+#endif	/* BOOKSI64 */
+		v->z = n;
+	}
+	x->v = v;
+	x->vack = 0U;
+	v->n = 0U;
+	v->lo = v->hi = 0U;
+	view_fill(x);
+	return v;
+
+nomem:
+	if (x->v == NULL) {
+		free(v->p);
+		free(v->q);
+#if defined BOOKSI64
+		free(v->pe);
+		free(v->qe);
+#endif	/* BOOKSI64 */
+		free(v);
+	}
+	return NULL;
+}
+
+void
+book_view_ack(book_t b, book_side_t s)
+{
+	struct side_s *x = b.BOOK(s);
+	book_view_t *v = x->v;
+
+	if (LIKELY(v != NULL)) {
+		view_mov(v, v->z, 0U, v->n);
+		x->vack = v->n;
+		v->lo = v->z;
+		v->hi = 0U;
+	}
+	return;
+}
+
+book_iter_t
+book_iter_at(book_t b, book_side_t s, px_t p)
+{
+	return side_iter_at(b.BOOK(s), p);
+}
+
+book_iter_t
+book_riter(book_t b, book_side_t s)
+{
+	const struct side_s *x = b.BOOK(s);
+	const btree_iter_t i = btree_last(x->t);
+
+	return (book_iter_t){.b = b.BOOK(s), .c = i.t, .i = i.i, .revp = true};
+}
+
+static bool
+book_iter_prev(book_iter_t *iter)
+{
+/* tree first, then the ladder, bottom up */
+	const struct side_s *s = iter->b;
+
+	if (iter->c != NULL) {
+		btree_iter_t i = {.t = iter->c, .i = iter->i, .r = s->t};
+
+		if (btree_iter_prev(&i)) {
+			iter->c = i.t;
+			iter->i = i.i;
+			iter->p = i.k;
+			iter->q = i.v->q;
+			iter->t = i.v->t;
+			cpyqex(*iter, *i.v);
+			return true;
+		}
+		/* ladder next */
+		iter->c = NULL;
+		iter->i = NLADDER;
+	}
+	if (s->l != NULL) {
+		const struct ladder_s *l = s->l;
+		const size_t d = ladder_prev(l, iter->i);
+
+		if (d < NLADDER) {
+			const size_t j = (uint64_t)(l->top + d) % NLADDER;
+
+			iter->p = l->key[j];
+			iter->q = l->val[j].q;
+			iter->t = l->val[j].t;
+			cpyqex(*iter, l->val[j]);
+			iter->i = d;
+			return true;
+		}
+	}
+	return false;
+}
+
 bool
 book_iter_next(book_iter_t *iter)
 {
-	btree_iter_t *i = (void*)iter;
-	if (btree_iter_next(i)) {
-		btree_val_t *tmp = i->v;
-		iter->q = tmp->q;
-		iter->t = tmp->t;
+	const struct side_s *s = iter->b;
+	btree_iter_t i;
+
+	if (UNLIKELY(s == NULL)) {
+		return false;
+	} else if (UNLIKELY(iter->revp)) {
+		if (!book_iter_prev(iter)) {
+			goto nil;
+		}
+		goto lmt;
+	} else if (iter->c == NULL && s->l != NULL) {
+		/* ladder first */
+		const struct ladder_s *l = s->l;
+		const size_t d = ladder_next(l, iter->i);
+
+		if (d < NLADDER) {
+			const size_t j = (uint64_t)(l->top + d) % NLADDER;
+
+			iter->p = l->key[j];
+			iter->q = l->val[j].q;
+			iter->t = l->val[j].t;
+			cpyqex(*iter, l->val[j]);
+			iter->i = d + 1U;
+			goto lmt;
+		}
+		/* tree next */
+		iter->i = 0U;
+	}
+	i = (btree_iter_t){.t = iter->c ?: s->t, .i = iter->i};
+	if (btree_iter_next(&i)) {
+		iter->c = i.t;
+		iter->i = i.i;
+		iter->p = i.k;
+		iter->q = i.v->q;
+		iter->t = i.v->t;
+		cpyqex(*iter, *i.v);
+		goto lmt;
+	}
+	goto nil;
+
+lmt:
+	if (LIKELY(!iter->lmtp)) {
+		return true;
+	} else if (!iter->revp && !isnanpx(iter->p) &&
+		   (s->descp ? iter->p >= iter->lmt : iter->p <= iter->lmt)) {
+		/* nans never make it */
+		return true;
+	} else if (iter->revp && (isnanpx(iter->p) ||
+		   !(s->descp ? iter->p > iter->lmt : iter->p < iter->lmt))) {
 		return true;
 	}
+	/* beyond the limit */
+nil:
+	/* that's it */
+	iter->b = NULL;
 	return false;
 }
 
@@ -421,6 +1757,17 @@ book_iter_next(book_iter_t *iter)
 #  define BOOKSD32
 #
 #  undef quantizepx
+#  undef quantexppx
+#  undef scalbnpx
+#  undef INCLUDED_books_h_
+#  undef INCLUDED_btree_h_
+#  include __FILE__
+# elif defined BOOKSD32 && !defined BOOKSI64
+#  define BOOKSI64
+#
+#  undef quantizepx
+#  undef quantexppx
+#  undef scalbnpx
 #  undef INCLUDED_books_h_
 #  undef INCLUDED_btree_h_
 #  include __FILE__
@@ -36,9 +36,12 @@
  **/
 #if !defined INCLUDED_books_h_
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 
-#if !defined BOOKSD32 || !defined BOOKSD64
+#if !defined INCLUDED_books_h_once_
+/* flavour-agnostic bits, for the first of possibly several flavours */
+# define INCLUDED_books_h_once_
 # define books_h_once
 #endif
 
@@ -50,7 +53,7 @@ typedef long long unsigned int tv_t;
 #define MSECS	(1000)
 #endif
 
-#if !defined BOOKSD32 && !defined BOOKSD64
+#if !defined BOOKSD32 && !defined BOOKSD64 && !defined BOOKSI64
 /* set a default */
 # define BOOKSD64
 #endif	/* BOOKSD64 */
@@ -63,13 +66,20 @@ typedef long long unsigned int tv_t;
 #undef isinfpx
 
 #undef book_quo_t
+#undef book_pdo_t
 #undef book_iter_t
+#undef book_view_t
 #undef make_book
+#undef make_book_ladder
 #undef free_book
+#undef book_prealloc
 #undef book_add
+#undef book_add_ex
 #undef book_clr
 #undef book_exp
+#undef book_compact
 #undef book_top
+#undef book_ntop
 #undef book_tops
 #undef book_ctop
 #undef book_ctops
@@ -77,14 +87,61 @@ typedef long long unsigned int tv_t;
 #undef book_vtops
 #undef book_pdo
 #undef book_iter
+#undef book_iter_at
+#undef book_iter_lmt
+#undef book_riter
+#undef book_view
+#undef book_view_ack
 #undef book_iter_next
 #undef px_t
+#undef qx_t
 
 #if 0
 
+#elif defined BOOKSI64
+/* prices in ticks, quantities in lots, the scales are up to the caller,
+ * levels keep the quanta their prices and quantities came in with */
+# define px_t		int64_t
+# define qx_t		int64_t
+#
+# define NANPX		INT64_MIN
+# define isnanpx(x)	((x) == INT64_MIN)
+# define NANQX		INT64_MIN
+# define isnanqx(x)	((x) == INT64_MIN)
+# define INFPX		INT64_MAX
+# define isinfpx(x)	((x) == INT64_MAX || (x) == -INT64_MAX)
+#
+# define book_quo_t	booki64_quo_t
+# define book_pdo_t	booki64_pdo_t
+# define book_iter_t	booki64_iter_t
+# define book_view_t	booki64_view_t
+# define make_book	make_booki64
+# define make_book_ladder	make_booki64_ladder
+# define free_book	free_booki64
+# define book_prealloc	booki64_prealloc
+# define book_add	booki64_add
+# define book_add_ex	booki64_add_ex
+# define book_clr	booki64_clr
+# define book_exp	booki64_exp
+# define book_compact	booki64_compact
+# define book_top	booki64_top
+# define book_ntop	booki64_ntop
+# define book_tops	booki64_tops
+# define book_ctop	booki64_ctop
+# define book_ctops	booki64_ctops
+# define book_vtop	booki64_vtop
+# define book_vtops	booki64_vtops
+# define book_pdo	booki64_pdo
+# define book_iter	booki64_iter
+# define book_iter_at	booki64_iter_at
+# define book_iter_lmt	booki64_iter_lmt
+# define book_riter	booki64_riter
+# define book_view	booki64_view
+# define book_view_ack	booki64_view_ack
+# define book_iter_next	booki64_iter_next
 #elif defined BOOKSD32
 # define px_t		_Decimal32
-typedef _Decimal64 qx_t;
+# define qx_t		_Decimal64
 #
 # define NANPX		NAND32
 # define isnanpx	isnand32
@@ -94,13 +151,20 @@ typedef _Decimal64 qx_t;
 # define isinfpx	isinfd32
 #
 # define book_quo_t	bookd32_quo_t
+# define book_pdo_t	bookd32_pdo_t
 # define book_iter_t	bookd32_iter_t
+# define book_view_t	bookd32_view_t
 # define make_book	make_bookd32
+# define make_book_ladder	make_bookd32_ladder
 # define free_book	free_bookd32
+# define book_prealloc	bookd32_prealloc
 # define book_add	bookd32_add
+# define book_add_ex	bookd32_add_ex
 # define book_clr	bookd32_clr
 # define book_exp	bookd32_exp
+# define book_compact	bookd32_compact
 # define book_top	bookd32_top
+# define book_ntop	bookd32_ntop
 # define book_tops	bookd32_tops
 # define book_ctop	bookd32_ctop
 # define book_ctops	bookd32_ctops
@@ -108,11 +172,16 @@ typedef _Decimal64 qx_t;
 # define book_vtops	bookd32_vtops
 # define book_pdo	bookd32_pdo
 # define book_iter	bookd32_iter
+# define book_iter_at	bookd32_iter_at
+# define book_iter_lmt	bookd32_iter_lmt
+# define book_riter	bookd32_riter
+# define book_view	bookd32_view
+# define book_view_ack	bookd32_view_ack
 # define book_iter_next	bookd32_iter_next
 
 #elif defined BOOKSD64
 # define px_t		_Decimal64
-typedef _Decimal64 qx_t;
+# define qx_t		_Decimal64
 #
 # define NANPX		NAND64
 # define isnanpx	isnand64
@@ -122,13 +191,20 @@ typedef _Decimal64 qx_t;
 # define isinfpx	isinfd64
 #
 # define book_quo_t	bookd64_quo_t
+# define book_pdo_t	bookd64_pdo_t
 # define book_iter_t	bookd64_iter_t
+# define book_view_t	bookd64_view_t
 # define make_book	make_bookd64
+# define make_book_ladder	make_bookd64_ladder
 # define free_book	free_bookd64
+# define book_prealloc	bookd64_prealloc
 # define book_add	bookd64_add
+# define book_add_ex	bookd64_add_ex
 # define book_clr	bookd64_clr
 # define book_exp	bookd64_exp
+# define book_compact	bookd64_compact
 # define book_top	bookd64_top
+# define book_ntop	bookd64_ntop
 # define book_tops	bookd64_tops
 # define book_ctop	bookd64_ctop
 # define book_ctops	bookd64_ctops
@@ -136,8 +212,13 @@ typedef _Decimal64 qx_t;
 # define book_vtops	bookd64_vtops
 # define book_pdo	bookd64_pdo
 # define book_iter	bookd64_iter
+# define book_iter_at	bookd64_iter_at
+# define book_iter_lmt	bookd64_iter_lmt
+# define book_riter	bookd64_riter
+# define book_view	bookd64_view
+# define book_view_ack	bookd64_view_ack
 # define book_iter_next	bookd64_iter_next
-#endif	/* BOOKSD32 || BOOKSD64 */
+#endif	/* BOOKSI64 || BOOKSD32 || BOOKSD64 */
 
 /* our books look like
  * T... INS ACT PRC QTY
@@ -176,11 +257,15 @@ typedef struct {
 } book_t;
 
 typedef struct {
-	qx_t base;
-	qx_t term;
-	tv_t yngt;
-	tv_t oldt;
-} book_pdo_t;
+	/* number of levels ahead of the one touched, capped */
+	size_t d;
+	/* whether the level touched changed at all */
+	bool lvlp;
+	/* whether the top level changed */
+	bool topp;
+	/* whether any of the top levels up to the cap changed */
+	bool topnp;
+} book_chg_t;
 #endif
 
 typedef struct {
@@ -189,32 +274,88 @@ typedef struct {
 	px_t p;
 	qx_t q;
 	tv_t t;
+#if defined BOOKSI64
+	/* P is a multiple of 10^pe ticks and Q one of 10^qe lots */
+	unsigned char pe;
+	unsigned char qe;
+#endif	/* BOOKSI64 */
 } book_quo_t;
 
+typedef struct {
+	qx_t base;
+	qx_t term;
+	tv_t yngt;
+	tv_t oldt;
+} book_pdo_t;
+
 #define NOT_A_QUO	(book_quo_t){BOOK_SIDE_UNK}
 #define NOT_A_QUO_P(x)	!((x).s)
 
 typedef struct {
 	void *b;
+	void *c;
 	size_t i;
+	/* walk worst level first, stop beyond LMT */
+	bool revp;
+	bool lmtp;
+	px_t lmt;
 	px_t p;
 	qx_t q;
 	tv_t t;
+#if defined BOOKSI64
+	unsigned char pe;
+	unsigned char qe;
+#endif	/* BOOKSI64 */
 } book_iter_t;
 
+typedef struct {
+	/* rows in use and the most rows we keep */
+	size_t n;
+	size_t z;
+	/* rows LO up to HI changed since the last book_view_ack() */
+	size_t lo;
+	size_t hi;
+	px_t *p;
+	qx_t *q;
+#if defined BOOKSI64
+	unsigned char *pe;
+	unsigned char *qe;
+#endif	/* BOOKSI64 */
+} book_view_t;
+
 #define BIDX(x)		((x) - 1U)
 #define BOOK(x)		quos[BIDX(x)]
 
 
 extern book_t make_book(void);
+
+/**
+ * Like make_book() but keep the price levels near the top of either
+ * side on a ladder of ticks of size TICK, levels further out go to the
+ * usual btree.  Use a TICK of 0 to have it inferred from the prices. */
+extern book_t make_book_ladder(px_t tick);
 extern book_t free_book(book_t);
 
+/**
+ * Pre-size BOOK's node pools so that up to NLVL price levels per side
+ * can be held without calling malloc.
+ * Return 0 on success, -1 otherwise. */
+extern int book_prealloc(book_t, size_t nlvl);
+
 /**
  * Add QUO to BOOK.
  * QUO will hold the previous state, i.e. the old price level
  * in p, the old quantity in q and the old time in t, respectively. */
 extern book_quo_t book_add(book_t, book_quo_t);
 
+/**
+ * Like book_add() but also report in CHG how the update changed the top
+ * N levels of QUO's side.  Levels are counted up to N only, i.e. updates
+ * deeper down report a depth of N.
+ * Clearing or deleting quotes report a depth of 0 and a changed top. */
+extern book_quo_t
+book_add_ex(book_t, book_quo_t, size_t n, book_chg_t *chg);
+
 /**
  * Clear the entire book. */
 extern void book_clr(book_t);
@@ -223,10 +364,20 @@ extern void book_clr(book_t);
  * Expunge all quotes older than T. */
 extern void book_exp(book_t, tv_t);
 
+/**
+ * Physically remove empty price levels from BOOK.
+ * This happens automatically every now and then, see btree_sparse_p(). */
+extern void book_compact(book_t);
+
 /**
  * Return the top-most quote of BOOK'S SIDE. */
 extern book_quo_t book_top(book_t, book_side_t);
 
+/**
+ * Return a counter that changes whenever the price or quantity of
+ * either side's top-most quote changes. */
+extern size_t book_ntop(book_t);
+
 /**
  * Put the top-most N price levels into PX (and QX) and return the number
  * of levels filled. */
@@ -257,16 +408,46 @@ book_vtops(px_t*restrict, qx_t*restrict, book_t, book_side_t, qx_t V, size_t n);
 
 extern bool book_iter_next(book_iter_t*);
 
+/**
+ * Return an iterator over BOOK's SIDE that starts at price level P,
+ * or the first level after it. */
+extern book_iter_t book_iter_at(book_t, book_side_t, px_t p);
+
+/**
+ * Return an iterator over BOOK's SIDE that starts at the worst level
+ * and works its way to the top. */
+extern book_iter_t book_riter(book_t, book_side_t);
+
 /**
  * Like book_ctop() but produce a base/term aggregate and limit book
  * traversal to LMT. */
 extern book_pdo_t book_pdo(book_t, book_side_t, qx_t q, px_t lmt);
 
+/**
+ * Attach a view of the top N price levels to BOOK's SIDE and return it.
+ * The view is kept up to date by book_add() and friends, rows that
+ * changed are marked, see book_view_t.  Calling it again resizes the
+ * view, the view goes with the book.  Return NULL if out of memory. */
+extern const book_view_t *book_view(book_t, book_side_t, size_t n);
+
+/**
+ * Clear the change marks of the view on BOOK's SIDE. */
+extern void book_view_ack(book_t, book_side_t);
+
 
 static inline book_iter_t
 book_iter(book_t b, book_side_t s)
 {
-	return (book_iter_t){b.BOOK(s)};
+	return (book_iter_t){.b = b.BOOK(s)};
+}
+
+static inline book_iter_t
+book_iter_lmt(book_iter_t i, px_t lmt)
+{
+/* have I stop after the levels at LMT */
+	i.lmtp = true;
+	i.lmt = lmt;
+	return i;
 }
 
 #define INCLUDED_books_h_
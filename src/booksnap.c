@@ -41,35 +41,66 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #if defined HAVE_DFP754_H
 # include <dfp754.h>
 #endif	/* HAVE_DFP754_H */
 #include "dfp754_d32.h"
 #include "dfp754_d64.h"
-#include <assert.h>
-#include "hash.h"
+#include "intern.h"
 #include "books.h"
 #include "xquo.h"
+#include "xin.h"
+#include "stage.h"
+#include "obuf.h"
+#include "shard.h"
+#include "ckpt.h"
 #include "nifty.h"
 
-#define strtopx		strtod64
-#define pxtostr		d64tostr
-#define strtoqx		strtod64
-#define qxtostr		d64tostr
-
-#define HX_CATCHALL	((hx_t)-1ULL)
+#if defined BOOKSI64
+# define strtopx	strtoi64
+# define pxtostr	i64tostr
+# define strtoqx	strtoi64
+# define qxtostr	i64tostr
+/* book values X of S decimal places whose last E places don't count */
+# define pxetostr(b, z, x, s, e)	\
+	i64tostr(b, z, xscale(x, s, (s) - (e)), (s) - (e))
+# define qxetostr(b, z, x, s, e)	\
+	i64tostr(b, z, xscale(x, s, (s) - (e)), (s) - (e))
+#else  /* !BOOKSI64 */
+# define strtopx(x, on, s)	strtod64(x, on)
+# define pxtostr(b, z, x, s)	((void)(s), d64tostr(b, z, x))
+# define strtoqx(x, on, s)	strtod64(x, on)
+# define qxtostr(b, z, x, s)	((void)(s), d64tostr(b, z, x))
+/* decimals know their quanta */
+# define pxetostr(b, z, x, s, e)	((void)(s), d64tostr(b, z, x))
+# define qxetostr(b, z, x, s, e)	((void)(s), d64tostr(b, z, x))
+#endif	/* BOOKSI64 */
 
 /* command line params */
 static tv_t intv = 1U * NSECS;
 static tv_t offs = 0U * MSECS;
 static tv_t inva;
 static FILE *sfil;
+/* snaps before this and from that go unprinted */
+static tv_t since;
+static tv_t till = NATV;
+/* number of segments to snap in parallel */
+static size_t nseg;
+/* pre-pass checkpoints, by position */
+static size_t ckstep;
+static size_t ckpos;
 
 /* output mode */
-static void(*snap)(book_t, const char*);
+static void(*snap)(book_t, const char*, size_t, xscl_t);
 /* for N-books */
 static size_t ntop;
 static qx_t cqty;
+/* ladder tick size, nan for no ladder, 0 for auto */
+static px_t tick;
+/* decimal places of the above */
+static xscl_t cscl;
 
 
 static __attribute__((format(printf, 1, 2))) void
@@ -158,6 +189,9 @@ sufstrtotv(const char *str)
 
 
 static tv_t metr;
+/* METR rendered, once per snap and shard */
+static __thread char stmp[32U];
+static __thread size_t stmz;
 static tv_t(*next)(tv_t);
 
 static tv_t
@@ -195,10 +229,23 @@ _next_stmp(tv_t newm)
 	return NATV;
 }
 
+static tv_t
+_next_once(tv_t newm)
+{
+/* snap at SINCE, and that's it */
+	static bool donep;
+
+	if (donep) {
+		return NATV;
+	}
+	donep = true;
+	return since >= newm ? since : NATV;
+}
+
 
 /* snappers */
 static void
-snap1(book_t bk, const char *cont)
+snap1(book_t bk, const char *cont, size_t conz, xscl_t scl)
 {
 	char buf[256U];
 	size_t len;
@@ -207,44 +254,46 @@ snap1(book_t bk, const char *cont)
 	b = book_top(bk, BOOK_SIDE_BID);
 	a = book_top(bk, BOOK_SIDE_ASK);
 
-	len = tvtostr(buf, sizeof(buf), metr);
+	len = memncpy(buf, stmp, stmz);
 	if (LIKELY(cont != NULL)) {
 		buf[len++] = '\t';
-		len += memncpy(buf + len, cont, strlen(cont));
+		len += memncpy(buf + len, cont, conz);
 	}
 	buf[len++] = '\t';
 	buf[len++] = 'c';
 	buf[len++] = '1';
 	buf[len++] = '\t';
 	if (b.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, b.p);
+		len += pxetostr(buf + len, sizeof(buf) - len, b.p, scl.p, b.pe);
 	}
 	buf[len++] = '\t';
 	if (a.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, a.p);
+		len += pxetostr(buf + len, sizeof(buf) - len, a.p, scl.p, a.pe);
 	}
 	buf[len++] = '\t';
-	len += qxtostr(buf + len, sizeof(buf) - len, b.q);
+	len += qxetostr(buf + len, sizeof(buf) - len,
+			b.q, scl.q, b.q ? b.qe : scl.q);
 	buf[len++] = '\t';
-	len += qxtostr(buf + len, sizeof(buf) - len, a.q);
+	len += qxetostr(buf + len, sizeof(buf) - len,
+			a.q, scl.q, a.q ? a.qe : scl.q);
 	buf[len++] = '\n';
 	/* and out */
-	fwrite(buf, 1, len, stdout);
+	obuf_write(buf, len);
 	return;
 }
 
 static void
-snap12(book_t bk, const char *cont)
+snap12(book_t bk, const char *cont, size_t conz, xscl_t scl)
 {
 /* like snap2 but for top-level only */
 	char buf[256U];
 	size_t len, prfz;
 	book_quo_t q;
 
-	len = tvtostr(buf, sizeof(buf), metr);
+	len = memncpy(buf, stmp, stmz);
 	if (LIKELY(cont != NULL)) {
 		buf[len++] = '\t';
-		len += memncpy(buf + len, cont, strlen(cont));
+		len += memncpy(buf + len, cont, conz);
 	}
 	buf[len++] = '\t';
 	buf[len++] = 'B';
@@ -253,40 +302,40 @@ snap12(book_t bk, const char *cont)
 	prfz = len;
 
 	q = book_top(bk, BOOK_SIDE_BID);
-	if (q.q > 0.dd) {
-		len += pxtostr(buf + len, sizeof(buf) - len, q.p);
+	if (q.q > 0) {
+		len += pxetostr(buf + len, sizeof(buf) - len, q.p, scl.p, q.pe);
 		buf[len++] = '\t';
-		len += qxtostr(buf + len, sizeof(buf) - len, q.q);
+		len += qxetostr(buf + len, sizeof(buf) - len, q.q, scl.q, q.qe);
 		buf[len++] = '\n';
 		/* and out */
-		fwrite(buf, 1, len, stdout);
+		obuf_write(buf, len);
 		len = prfz;
 	}
 
 	/* go to asks */
 	buf[prfz - 3U] = 'A';
 	q = book_top(bk, BOOK_SIDE_ASK);
-	if (q.q > 0.dd) {
-		len += pxtostr(buf + len, sizeof(buf) - len, q.p);
+	if (q.q > 0) {
+		len += pxetostr(buf + len, sizeof(buf) - len, q.p, scl.p, q.pe);
 		buf[len++] = '\t';
-		len += qxtostr(buf + len, sizeof(buf) - len, q.q);
+		len += qxetostr(buf + len, sizeof(buf) - len, q.q, scl.q, q.qe);
 		buf[len++] = '\n';
 		/* and out */
-		fwrite(buf, 1, len, stdout);
+		obuf_write(buf, len);
 	}
 	return;
 }
 
 static void
-snap2(book_t bk, const char *cont)
+snap2(book_t bk, const char *cont, size_t conz, xscl_t scl)
 {
 	char buf[256U];
 	size_t len, prfz;
 
-	len = tvtostr(buf, sizeof(buf), metr);
+	len = memncpy(buf, stmp, stmz);
 	if (LIKELY(cont != NULL)) {
 		buf[len++] = '\t';
-		len += memncpy(buf + len, cont, strlen(cont));
+		len += memncpy(buf + len, cont, conz);
 	}
 	buf[len++] = '\t';
 	buf[len++] = 'B';
@@ -296,40 +345,52 @@ snap2(book_t bk, const char *cont)
 
 	for (book_iter_t i = book_iter(bk, BOOK_SIDE_BID);
 	     book_iter_next(&i); len = prfz) {
-		len += pxtostr(buf + len, sizeof(buf) - len, i.p);
+		len += pxetostr(buf + len, sizeof(buf) - len, i.p, scl.p, i.pe);
 		buf[len++] = '\t';
-		len += qxtostr(buf + len, sizeof(buf) - len, i.q);
+		len += qxetostr(buf + len, sizeof(buf) - len, i.q, scl.q, i.qe);
 		buf[len++] = '\n';
 		/* and out */
-		fwrite(buf, 1, len, stdout);
+		obuf_write(buf, len);
 	}
 
 	/* go to asks */
 	buf[prfz - 3U] = 'A';
 	for (book_iter_t i = book_iter(bk, BOOK_SIDE_ASK);
 	     book_iter_next(&i); len = prfz) {
-		len += pxtostr(buf + len, sizeof(buf) - len, i.p);
+		len += pxetostr(buf + len, sizeof(buf) - len, i.p, scl.p, i.pe);
 		buf[len++] = '\t';
-		len += qxtostr(buf + len, sizeof(buf) - len, i.q);
+		len += qxetostr(buf + len, sizeof(buf) - len, i.q, scl.q, i.qe);
 		buf[len++] = '\n';
 		/* and out */
-		fwrite(buf, 1, len, stdout);
+		obuf_write(buf, len);
 	}
 	return;
 }
 
-static struct {
+static inline book_quo_t
+iter_quo(book_iter_t i)
+{
+/* level I as quote, with its quanta */
+	book_quo_t r = {.p = i.p, .q = i.q, .t = i.t};
+
+#if defined BOOKSI64
+	r.pe = i.pe;
+	r.qe = i.qe;
+#endif	/* BOOKSI64 */
+	return r;
+}
+
+static __thread struct {
 	size_t bn;
 	size_t an;
 	size_t bz;
 	size_t az;
-	px_t *b;
-	px_t *a;
-	qx_t *B;
-	qx_t *A;
+	book_quo_t *b;
+	book_quo_t *a;
 } *snap3_aux;
-static size_t zbk;
-static size_t ibk;
+/* per shard, indexed like the shard's books */
+static __thread size_t zbk;
+static __thread size_t ibk;
 
 static void
 init_snap3(size_t nbook)
@@ -350,12 +411,6 @@ free_snap3(void)
 		if (LIKELY(snap3_aux[i].a != NULL)) {
 			free(snap3_aux[i].a);
 		}
-		if (LIKELY(snap3_aux[i].B != NULL)) {
-			free(snap3_aux[i].B);
-		}
-		if (LIKELY(snap3_aux[i].A != NULL)) {
-			free(snap3_aux[i].A);
-		}
 	}
 	free(snap3_aux);
 	snap3_aux = NULL;
@@ -363,6 +418,19 @@ free_snap3(void)
 	return;
 }
 
+static void
+grow_snap3(void)
+{
+	if (UNLIKELY(ibk >= zbk)) {
+		/* resize */
+		const size_t olz = zbk;
+		for (zbk = zbk ?: 8U; zbk <= ibk; zbk *= 2U);
+		snap3_aux = realloc(snap3_aux, zbk * sizeof(*snap3_aux));
+		memset(snap3_aux + olz, 0, (zbk - olz) * sizeof(*snap3_aux));
+	}
+	return;
+}
+
 static void
 snap3_book(book_t bk)
 {
@@ -376,14 +444,11 @@ snap3_book(book_t bk)
 	     book_iter_next(&i); bi++) {
 		if (UNLIKELY(bi >= bz)) {
 			bz = (bz *= 2U) ?: 32U;
-			snap3_aux[ibk].b =
-				realloc(snap3_aux[ibk].b, bz * sizeof(px_t));
-			snap3_aux[ibk].B =
-				realloc(snap3_aux[ibk].B, bz * sizeof(qx_t));
+			snap3_aux[ibk].b = realloc(
+				snap3_aux[ibk].b, bz * sizeof(book_quo_t));
 			snap3_aux[ibk].bz = bz;
 		}
-		snap3_aux[ibk].b[bi] = i.p;
-		snap3_aux[ibk].B[bi] = i.q;
+		snap3_aux[ibk].b[bi] = iter_quo(i);
 	}
 	snap3_aux[ibk].bn = bi;
 
@@ -394,42 +459,45 @@ snap3_book(book_t bk)
 	     book_iter_next(&i); bi++) {
 		if (UNLIKELY(bi >= bz)) {
 			bz = (bz *= 2U) ?: 32U;
-			snap3_aux[ibk].a =
-				realloc(snap3_aux[ibk].a, bz * sizeof(px_t));
-			snap3_aux[ibk].A =
-				realloc(snap3_aux[ibk].A, bz * sizeof(qx_t));
+			snap3_aux[ibk].a = realloc(
+				snap3_aux[ibk].a, bz * sizeof(book_quo_t));
 			snap3_aux[ibk].az = bz;
 		}
-		snap3_aux[ibk].a[bi] = i.p;
-		snap3_aux[ibk].A[bi] = i.q;
+		snap3_aux[ibk].a[bi] = iter_quo(i);
 	}
 	snap3_aux[ibk].an = bi;
 	return;
 }
 
+static inline book_quo_t
+snap3_chg(book_iter_t i, book_quo_t o)
+{
+/* what happened to level O which is I now */
+	book_quo_t r = iter_quo(i);
+
+	r.q -= o.q;
+#if defined BOOKSI64
+	/* as fine as the finer of the two */
+	r.qe = o.qe < r.qe ? o.qe : r.qe;
+#endif	/* BOOKSI64 */
+	return r;
+}
+
 static void
-snap3(book_t bk, const char *cont)
+snap3(book_t bk, const char *cont, size_t conz, xscl_t scl)
 {
 	char buf[256U];
 	size_t len, prfz;
 	/* index into last book */
 	size_t bi, bn;
-	const px_t *pp;
-	const qx_t *qp;
+	const book_quo_t *pp;
 
-	if (UNLIKELY(ibk >= zbk)) {
-		/* resize */
-		const size_t olz = zbk;
-		while ((zbk *= 2U) < ibk);
-		snap3_aux = realloc(snap3_aux, zbk);
-		snap3_aux = calloc(zbk, sizeof(*snap3_aux));
-		memset(snap3_aux + olz, 0, (zbk - olz) * sizeof(*snap3_aux));
-	}
+	grow_snap3();
 
-	len = tvtostr(buf, sizeof(buf), metr);
+	len = memncpy(buf, stmp, stmz);
 	if (LIKELY(cont != NULL)) {
 		buf[len++] = '\t';
-		len += memncpy(buf + len, cont, strlen(cont));
+		len += memncpy(buf + len, cont, conz);
 	}
 	buf[len++] = '\t';
 	buf[len++] = 'B';
@@ -439,42 +507,41 @@ snap3(book_t bk, const char *cont)
 
 	/* bids first, descending order */
 	pp = snap3_aux[ibk].b;
-	qp = snap3_aux[ibk].B;
 	bn = snap3_aux[ibk].bn;
 	bi = 0U;
 	for (book_iter_t i = {.b = bk.BOOK(BOOK_SIDE_BID)};
 	     book_iter_next(&i); len = prfz) {
-		px_t p;
-		qx_t q;
+		book_quo_t x;
 
 	again_b:
 		if (bi >= bn) {
 			goto nopp_b;
-		} else if (i.p == pp[bi]) {
-			p = i.p;
-			q = i.q - qp[bi];
-		} else if (i.p > pp[bi]) {
+		} else if (i.p == pp[bi].p) {
+			x = snap3_chg(i, pp[bi]);
+		} else if (i.p > pp[bi].p) {
 		nopp_b:
-			p = i.p;
-			q = i.q;
-		} else if (i.p < pp[bi]) {
-			p = pp[bi];
-			q = -qp[bi];
+			x = iter_quo(i);
+		} else if (i.p < pp[bi].p) {
+			x = pp[bi];
+			x.q = -x.q;
 		} else {
 			continue;
 		}
 
-		len += pxtostr(buf + len, sizeof(buf) - len, p);
+		len += pxetostr(buf + len, sizeof(buf) - len, x.p, scl.p, x.pe);
 		buf[len++] = '\t';
-		len += qxtostr(buf + len, sizeof(buf) - len, q);
+		len += qxetostr(buf + len, sizeof(buf) - len, x.q, scl.q, x.qe);
 		buf[len++] = '\n';
 		/* and out */
-		fwrite(buf, 1, len, stdout);
+		obuf_write(buf, len);
 
 		/* see where to go next */
-		if (bi < bn && i.p <= pp[bi]) {
+		if (bi < bn && i.p <= pp[bi].p) {
+			/* if it was the old level that went, I is still due */
+			const bool gonep = i.p < pp[bi].p;
+
 			bi++;
-			if (i.p < pp[bi]) {
+			if (gonep) {
 				len = prfz;
 				goto again_b;
 			}
@@ -484,42 +551,41 @@ snap3(book_t bk, const char *cont)
 	/* go to asks now */
 	buf[prfz - 3U] = 'A';
 	pp = snap3_aux[ibk].a;
-	qp = snap3_aux[ibk].A;
 	bn = snap3_aux[ibk].an;
 	bi = 0U;
 	for (book_iter_t i = {.b = bk.BOOK(BOOK_SIDE_ASK)};
 	     book_iter_next(&i); len = prfz) {
-		px_t p;
-		qx_t q;
+		book_quo_t x;
 
 	again_a:
 		if (bi >= bn) {
 			goto nopp_a;
-		} else if (i.p == pp[bi]) {
-			p = i.p;
-			q = i.q - qp[bi];
-		} else if (i.p < pp[bi]) {
+		} else if (i.p == pp[bi].p) {
+			x = snap3_chg(i, pp[bi]);
+		} else if (i.p < pp[bi].p) {
 		nopp_a:
-			p = i.p;
-			q = i.q;
-		} else if (i.p > pp[bi]) {
-			p = pp[bi];
-			q = -qp[bi];
+			x = iter_quo(i);
+		} else if (i.p > pp[bi].p) {
+			x = pp[bi];
+			x.q = -x.q;
 		} else {
 			continue;
 		}
 
-		len += pxtostr(buf + len, sizeof(buf) - len, p);
+		len += pxetostr(buf + len, sizeof(buf) - len, x.p, scl.p, x.pe);
 		buf[len++] = '\t';
-		len += qxtostr(buf + len, sizeof(buf) - len, q);
+		len += qxetostr(buf + len, sizeof(buf) - len, x.q, scl.q, x.qe);
 		buf[len++] = '\n';
 		/* and out */
-		fwrite(buf, 1, len, stdout);
+		obuf_write(buf, len);
 
 		/* see where to go next */
-		if (bi < bn && i.p >= pp[bi]) {
+		if (bi < bn && i.p >= pp[bi].p) {
+			/* if it was the old level that went, I is still due */
+			const bool gonep = i.p > pp[bi].p;
+
 			bi++;
-			if (i.p > pp[bi]) {
+			if (gonep) {
 				len = prfz;
 				goto again_a;
 			}
@@ -532,28 +598,53 @@ snap3(book_t bk, const char *cont)
 }
 
 static void
-snapn(book_t bk, const char *cont)
+rescale_snap3(size_t k, xscl_t from, xscl_t to)
+{
+/* bring the photo-copy of book K to new decimal places */
+	if (UNLIKELY(k >= zbk || snap3_aux == NULL)) {
+		return;
+	}
+	for (size_t s = 0U; s < 2U; s++) {
+		book_quo_t *x = !s ? snap3_aux[k].b : snap3_aux[k].a;
+		const size_t n = !s ? snap3_aux[k].bn : snap3_aux[k].an;
+
+		for (size_t i = 0U; i < n; i++) {
+			x[i].p = xscale(x[i].p, from.p, to.p);
+			x[i].q = xscale(x[i].q, from.q, to.q);
+#if defined BOOKSI64
+			/* levels keep their quanta */
+			x[i].pe = (unsigned char)(x[i].pe + to.p - from.p);
+			x[i].qe = (unsigned char)(x[i].qe + to.q - from.q);
+#endif	/* BOOKSI64 */
+		}
+	}
+	return;
+}
+
+static void
+snapn(book_t bk, const char *cont, size_t conz, xscl_t scl)
 {
-	px_t b[ntop];
-	qx_t B[ntop];
-	px_t a[ntop];
-	qx_t A[ntop];
+	book_quo_t b[ntop];
+	book_quo_t a[ntop];
 	size_t bn, an;
 	char buf[256U];
 	size_t len, prfz;
 
-	memset(b, -1, sizeof(b));
-	memset(B, -1, sizeof(B));
-	memset(a, -1, sizeof(a));
-	memset(A, -1, sizeof(A));
-
-	bn = book_tops(b, B, bk, BOOK_SIDE_BID, ntop);
-	an = book_tops(a, A, bk, BOOK_SIDE_ASK, ntop);
+	bn = 0U;
+	for (book_iter_t i = book_iter(bk, BOOK_SIDE_BID);
+	     bn < ntop && book_iter_next(&i); bn++) {
+		b[bn] = iter_quo(i);
+	}
+	an = 0U;
+	for (book_iter_t i = book_iter(bk, BOOK_SIDE_ASK);
+	     an < ntop && book_iter_next(&i); an++) {
+		a[an] = iter_quo(i);
+	}
 
-	len = tvtostr(buf, sizeof(buf), metr);
+	len = memncpy(buf, stmp, stmz);
 	if (LIKELY(cont != NULL)) {
 		buf[len++] = '\t';
-		len += memncpy(buf + len, cont, strlen(cont));
+		len += memncpy(buf + len, cont, conz);
 	}
 	buf[len++] = '\t';
 	buf[len++] = 'c';
@@ -565,219 +656,508 @@ snapn(book_t bk, const char *cont)
 		len += snprintf(buf + len, sizeof(buf) - len, "%zu", i + 1U);
 		buf[len++] = '\t';
 		if (LIKELY(i < bn)) {
-			len += pxtostr(buf + len, sizeof(buf) - len, b[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					b[i].p, scl.p, b[i].pe);
 		}
 		buf[len++] = '\t';
 		if (LIKELY(i < an)) {
-			len += pxtostr(buf + len, sizeof(buf) - len, a[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					a[i].p, scl.p, a[i].pe);
 		}
 		buf[len++] = '\t';
 		if (LIKELY(i < bn)) {
-			len += qxtostr(buf + len, sizeof(buf) - len, B[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					b[i].q, scl.q, b[i].qe);
 		}
 		buf[len++] = '\t';
 		if (LIKELY(i < an)) {
-			len += qxtostr(buf + len, sizeof(buf) - len, A[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					a[i].q, scl.q, a[i].qe);
 		}
 		buf[len++] = '\n';
 		/* and out */
-		fwrite(buf, 1, len, stdout);
+		obuf_write(buf, len);
 	}
 	return;
 }
 
 static void
-snapc(book_t bk, const char *cont)
+snapc(book_t bk, const char *cont, size_t conz, xscl_t scl)
 {
 	char buf[256U];
 	size_t len;
 	book_quo_t b, a;
 
-	b = book_ctop(bk, BOOK_SIDE_BID, cqty);
-	a = book_ctop(bk, BOOK_SIDE_ASK, cqty);
+	const qx_t c = xscale(cqty, cscl.q, scl.q);
+
+	b = book_ctop(bk, BOOK_SIDE_BID, c);
+	a = book_ctop(bk, BOOK_SIDE_ASK, c);
 
-	len = tvtostr(buf, sizeof(buf), metr);
+	len = memncpy(buf, stmp, stmz);
 	if (LIKELY(cont != NULL)) {
 		buf[len++] = '\t';
-		len += memncpy(buf + len, cont, strlen(cont));
+		len += memncpy(buf + len, cont, conz);
 	}
 	buf[len++] = '\t';
 	buf[len++] = 'c';
 	buf[len++] = '1';
 	buf[len++] = '\t';
 	if (b.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, b.p);
+		len += pxetostr(buf + len, sizeof(buf) - len, b.p, scl.p, b.pe);
 	}
 	buf[len++] = '\t';
 	if (a.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, a.p);
+		len += pxetostr(buf + len, sizeof(buf) - len, a.p, scl.p, a.pe);
 	}
 	buf[len++] = '\t';
 	if (b.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, b.q);
+		len += qxetostr(buf + len, sizeof(buf) - len, b.q, scl.q, b.qe);
 	}
 	buf[len++] = '\t';
 	if (a.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, a.q);
+		len += qxetostr(buf + len, sizeof(buf) - len, a.q, scl.q, a.qe);
 	}
 	buf[len++] = '\n';
 	/* and out */
-	fwrite(buf, 1, len, stdout);
+	obuf_write(buf, len);
 	return;
 }
 
 static void
-snapcn(book_t bk, const char *cont)
+snapcn(book_t bk, const char *cont, size_t conz, xscl_t scl)
 {
-	px_t b[ntop];
-	qx_t B[ntop];
-	px_t a[ntop];
-	qx_t A[ntop];
+	book_quo_t b[ntop];
+	book_quo_t a[ntop];
 	size_t bn, an;
 	char buf[256U];
 	size_t len, prfz;
 
-	memset(b, -1, sizeof(b));
-	memset(B, -1, sizeof(B));
-	memset(a, -1, sizeof(a));
-	memset(A, -1, sizeof(A));
+	const qx_t c = xscale(cqty, cscl.q, scl.q);
 
-	bn = book_ctops(b, B, bk, BOOK_SIDE_BID, cqty, ntop);
-	an = book_ctops(a, A, bk, BOOK_SIDE_ASK, cqty, ntop);
+	/* level i is at (i + 1) * c, with quanta, unlike book_ctops() */
+	for (bn = 0U; bn < ntop; bn++) {
+		b[bn] = book_ctop(bk, BOOK_SIDE_BID, c * (qx_t)(bn + 1U));
+		if (NOT_A_QUO_P(b[bn])) {
+			break;
+		}
+	}
+	for (an = 0U; an < ntop; an++) {
+		a[an] = book_ctop(bk, BOOK_SIDE_ASK, c * (qx_t)(an + 1U));
+		if (NOT_A_QUO_P(a[an])) {
+			break;
+		}
+	}
 
-	len = tvtostr(buf, sizeof(buf), metr);
+	len = memncpy(buf, stmp, stmz);
 	if (LIKELY(cont != NULL)) {
 		buf[len++] = '\t';
-		len += memncpy(buf + len, cont, strlen(cont));
+		len += memncpy(buf + len, cont, conz);
 	}
 	buf[len++] = '\t';
 	buf[len++] = 'c';
 	prfz = len;
 
-	qx_t eoc = cqty;
 	for (size_t i = 0U,
 		     n = ntop < bn && ntop < an ? ntop : bn < an ? an : bn;
-	     i < n; i++, eoc += cqty, len = prfz) {
+	     i < n; i++, len = prfz) {
 		len += snprintf(buf + len, sizeof(buf) - len, "%zu", i + 1U);
 		buf[len++] = '\t';
 		if (LIKELY(i < bn)) {
-			len += pxtostr(buf + len, sizeof(buf) - len, b[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					b[i].p, scl.p, b[i].pe);
 		}
 		buf[len++] = '\t';
 		if (LIKELY(i < an)) {
-			len += pxtostr(buf + len, sizeof(buf) - len, a[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					a[i].p, scl.p, a[i].pe);
 		}
 		buf[len++] = '\t';
 		if (LIKELY(i < bn)) {
-			len += qxtostr(buf + len, sizeof(buf) - len, B[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					b[i].q, scl.q, b[i].qe);
 		}
 		buf[len++] = '\t';
 		if (LIKELY(i < an)) {
-			len += qxtostr(buf + len, sizeof(buf) - len, A[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					a[i].q, scl.q, a[i].qe);
 		}
 		buf[len++] = '\n';
 		/* and out */
-		fwrite(buf, 1, len, stdout);
+		obuf_write(buf, len);
 	}
 	return;
 }
 
 static void
-snapv(book_t bk, const char *cont)
+snapv(book_t bk, const char *cont, size_t conz, xscl_t scl)
 {
 	char buf[256U];
 	size_t len;
 	book_quo_t b, a;
 
-	b = book_vtop(bk, BOOK_SIDE_BID, cqty);
-	a = book_vtop(bk, BOOK_SIDE_ASK, cqty);
+	const qx_t c = xscale(cqty, cscl.q, scl.p + scl.q);
+
+	b = book_vtop(bk, BOOK_SIDE_BID, c);
+	a = book_vtop(bk, BOOK_SIDE_ASK, c);
 
-	len = tvtostr(buf, sizeof(buf), metr);
+	len = memncpy(buf, stmp, stmz);
 	if (LIKELY(cont != NULL)) {
 		buf[len++] = '\t';
-		len += memncpy(buf + len, cont, strlen(cont));
+		len += memncpy(buf + len, cont, conz);
 	}
 	buf[len++] = '\t';
 	buf[len++] = 'c';
 	buf[len++] = '1';
 	buf[len++] = '\t';
 	if (b.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, b.p);
+		len += pxetostr(buf + len, sizeof(buf) - len, b.p, scl.p, b.pe);
 	}
 	buf[len++] = '\t';
 	if (a.q) {
-		len += pxtostr(buf + len, sizeof(buf) - len, a.p);
+		len += pxetostr(buf + len, sizeof(buf) - len, a.p, scl.p, a.pe);
 	}
 	buf[len++] = '\t';
 	if (b.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, b.q);
+		len += qxetostr(buf + len, sizeof(buf) - len, b.q, scl.q, b.qe);
 	}
 	buf[len++] = '\t';
 	if (a.q) {
-		len += qxtostr(buf + len, sizeof(buf) - len, a.q);
+		len += qxetostr(buf + len, sizeof(buf) - len, a.q, scl.q, a.qe);
 	}
 	buf[len++] = '\n';
 	/* and out */
-	fwrite(buf, 1, len, stdout);
+	obuf_write(buf, len);
 	return;
 }
 
 static void
-snapvn(book_t bk, const char *cont)
+snapvn(book_t bk, const char *cont, size_t conz, xscl_t scl)
 {
-	px_t b[ntop];
-	qx_t B[ntop];
-	px_t a[ntop];
-	qx_t A[ntop];
+	book_quo_t b[ntop];
+	book_quo_t a[ntop];
 	size_t bn, an;
 	char buf[256U];
 	size_t len, prfz;
 
-	memset(b, -1, sizeof(b));
-	memset(B, -1, sizeof(B));
-	memset(a, -1, sizeof(a));
-	memset(A, -1, sizeof(A));
+	const qx_t c = xscale(cqty, cscl.q, scl.p + scl.q);
 
-	bn = book_vtops(b, B, bk, BOOK_SIDE_BID, cqty, ntop);
-	an = book_vtops(a, A, bk, BOOK_SIDE_ASK, cqty, ntop);
+	/* level i is at (i + 1) * c, with quanta, unlike book_vtops() */
+	for (bn = 0U; bn < ntop; bn++) {
+		b[bn] = book_vtop(bk, BOOK_SIDE_BID, c * (qx_t)(bn + 1U));
+		if (NOT_A_QUO_P(b[bn])) {
+			break;
+		}
+	}
+	for (an = 0U; an < ntop; an++) {
+		a[an] = book_vtop(bk, BOOK_SIDE_ASK, c * (qx_t)(an + 1U));
+		if (NOT_A_QUO_P(a[an])) {
+			break;
+		}
+	}
 
-	len = tvtostr(buf, sizeof(buf), metr);
+	len = memncpy(buf, stmp, stmz);
 	if (LIKELY(cont != NULL)) {
 		buf[len++] = '\t';
-		len += memncpy(buf + len, cont, strlen(cont));
+		len += memncpy(buf + len, cont, conz);
 	}
 	buf[len++] = '\t';
 	buf[len++] = 'c';
 	prfz = len;
 
-	qx_t eoc = cqty;
 	for (size_t i = 0U,
 		     n = ntop < bn && ntop < an ? ntop : bn < an ? an : bn;
-	     i < n; i++, eoc += cqty, len = prfz) {
+	     i < n; i++, len = prfz) {
 		len += snprintf(buf + len, sizeof(buf) - len, "%zu", i + 1U);
 		buf[len++] = '\t';
 		if (LIKELY(i < bn)) {
-			len += pxtostr(buf + len, sizeof(buf) - len, b[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					b[i].p, scl.p, b[i].pe);
 		}
 		buf[len++] = '\t';
 		if (LIKELY(i < an)) {
-			len += pxtostr(buf + len, sizeof(buf) - len, a[i]);
+			len += pxetostr(buf + len, sizeof(buf) - len,
+					a[i].p, scl.p, a[i].pe);
 		}
 		buf[len++] = '\t';
 		if (LIKELY(i < bn)) {
-			len += qxtostr(buf + len, sizeof(buf) - len, B[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					b[i].q, scl.q, b[i].qe);
 		}
 		buf[len++] = '\t';
 		if (LIKELY(i < an)) {
-			len += qxtostr(buf + len, sizeof(buf) - len, A[i]);
+			len += qxetostr(buf + len, sizeof(buf) - len,
+					a[i].q, scl.q, a[i].qe);
 		}
 		buf[len++] = '\n';
 		/* and out */
-		fwrite(buf, 1, len, stdout);
+		obuf_write(buf, len);
+	}
+	return;
+}
+
+
+/* books by id, or by id / NSHRD in the shards */
+struct shelf_s {
+	book_t *book;
+	xscl_t *scl;
+	const char **cont;
+	size_t *conz;
+	size_t n;
+	size_t z;
+};
+static struct shelf_s *shlf;
+static size_t nshrd = 1U;
+/* set when books couldn't be set up */
+static _Atomic int werr;
+
+static void
+work(size_t w, const shev_t *ev)
+{
+/* events for shard W are
+ * - quotes for book K
+ * - new books K named Q.INS, their Q.Q.T is NATV
+ * - snapshots of all books at Q.Q.T, their K is NOT_AN_ID,
+ *   with NB of 0 they're not to be printed
+ * - NULL, the shard's about to stop */
+	struct shelf_s *sh = shlf + w;
+	size_t j;
+	xquo_t q;
+
+	if (UNLIKELY(ev == NULL)) {
+		if (snap == snap3) {
+			free_snap3();
+		}
+		return;
+	} else if (ev->k == NOT_AN_ID && !ev->nb) {
+		const tv_t t = ev->q.q.t;
+
+		/* keep expiries and level-3 photo-copies going */
+		for (ibk = 0U; ibk < sh->n; ibk++) {
+			book_exp(sh->book[ibk], inva ? t : 0ULL);
+			if (snap == snap3) {
+				grow_snap3();
+				snap3_book(sh->book[ibk]);
+			}
+		}
+		return;
+	} else if (ev->k == NOT_AN_ID) {
+		const tv_t t = ev->q.q.t;
+
+		/* materialise snapshot */
+		stmz = tvtostr(stmp, sizeof(stmp), t);
+		for (ibk = 0U; ibk < sh->n; ibk++) {
+			book_exp(sh->book[ibk], inva ? t : 0ULL);
+			snap(sh->book[ibk],
+			     sh->cont[ibk], sh->conz[ibk], sh->scl[ibk]);
+			shard_span();
+		}
+		return;
+	} else if (UNLIKELY(ev->q.q.t == NATV)) {
+		/* initialise the book */
+		if (UNLIKELY(ev->k / nshrd > sh->n)) {
+			/* we lost a book before, books and ids are out of
+			 * step from now on, leave them all to it */
+			return;
+		} else if (UNLIKELY(sh->n >= sh->z)) {
+			/* resize */
+			const size_t nuz = 2U * sh->z ?: 8U;
+			void *nu;
+
+			/* each array that did grow is kept */
+			if ((nu = realloc(sh->book, nuz * sizeof(*sh->book)))) {
+				sh->book = nu;
+				nu = realloc(sh->scl, nuz * sizeof(*sh->scl));
+			}
+			if (nu != NULL) {
+				sh->scl = nu;
+				nu = realloc(sh->cont, nuz * sizeof(*sh->cont));
+			}
+			if (nu != NULL) {
+				sh->cont = nu;
+				nu = realloc(sh->conz, nuz * sizeof(*sh->conz));
+			}
+			if (nu != NULL) {
+				sh->conz = nu;
+			} else {
+				werr = -1;
+				return;
+			}
+			sh->z = nuz;
+		}
+		sh->book[sh->n] = make_book_ladder(tick);
+		sh->scl[sh->n] = cscl;
+		sh->cont[sh->n] = ev->q.ins;
+		sh->conz[sh->n] = ev->q.inz;
+		sh->n++;
+		return;
+	}
+	/* bring quote and book to the same decimal places */
+	if (UNLIKELY((j = ev->k / nshrd) >= sh->n)) {
+		/* book never made it */
+		return;
+	}
+	q = ev->q;
+	if (UNLIKELY(q.scl.p > sh->scl[j].p || q.scl.q > sh->scl[j].q)) {
+		const xscl_t to = {
+			q.scl.p > sh->scl[j].p ? q.scl.p : sh->scl[j].p,
+			q.scl.q > sh->scl[j].q ? q.scl.q : sh->scl[j].q,
+		};
+		sh->book[j] = rescale_book(
+			sh->book[j], xscale(tick, cscl.p, to.p),
+			sh->scl[j], to);
+		if (snap == snap3) {
+			rescale_snap3(j, sh->scl[j], to);
+		}
+		sh->scl[j] = to;
+	}
+	q.q = rescale_quo(q, sh->scl[j]);
+	/* add to book */
+	q.q.t += inva;
+	q.q = book_add(sh->book[j], q.q);
+	return;
+}
+
+static void
+dispatch(shard_t s, shev_t ev)
+{
+/* hand EV to the shards, or do it ourselves */
+	if (s != NULL) {
+		shard_send(s, ev);
+	} else {
+		work(0U, &ev);
 	}
 	return;
 }
 
+static void
+mark(ckout_t ck, tv_t t, size_t pos)
+{
+/* checkpoint the books, there's only the one shelf */
+	const struct shelf_s *sh = shlf;
+
+	for (size_t i = 0U; i < sh->n; i++) {
+		ckout_book(ck, sh->cont[i], sh->conz[i],
+			   sh->scl[i], sh->book[i]);
+	}
+	ckout_mark(ck, t, pos);
+	return;
+}
+
+static int
+prepass(const char *fn)
+{
+/* fork the pre-pass unless FN has been indexed,
+ * return 0 in the pre-pass, 1 once it's done */
+	ckin_t c;
+	pid_t p;
+	int st;
+
+	if ((c = make_ckin(fn)) != NULL) {
+		free_ckin(c);
+		return 1;
+	}
+	switch ((p = fork())) {
+	case 0:
+		return 0;
+	case -1:
+		return 1;
+	default:
+		break;
+	}
+	/* without index segment() will let us snap on our own */
+	while (waitpid(p, &st, 0) < 0 && errno == EINTR);
+	return 1;
+}
+
+static int
+segment(const char *fn)
+{
+/* snap time segments of FN in processes of their own, starting off
+ * checkpoints, return -1 in those or if there are no checkpoints,
+ * or the exit code once all segments are out */
+	tv_t bnd[nseg + 1U];
+	pid_t pid[nseg];
+	FILE *tmp[nseg];
+	size_t n = 0U, i;
+	int rc = EXIT_SUCCESS;
+	ckin_t c;
+
+	if ((c = make_ckin(fn)) == NULL) {
+		return -1;
+	}
+	/* spread evenly over the checkpoints, in interval mode the snap
+	 * before a segment's start is shot off the checkpoint, so it
+	 * starts an interval later */
+	bnd[n++] = 0ULL;
+	for (size_t j = 1U, nc = ckin_count(c); j < nseg; j++) {
+		const ckpt_t *k = ckin_nth(c, j * nc / nseg);
+
+		if (k != NULL && k->t + intv + 1U > bnd[n - 1U]) {
+			bnd[n++] = k->t + intv + 1U;
+		}
+	}
+	bnd[n] = NATV;
+	free_ckin(c);
+	if (n <= 1U) {
+		return -1;
+	}
+
+	for (i = 0U; i < n; i++) {
+		if (UNLIKELY((tmp[i] = tmpfile()) == NULL)) {
+			break;
+		} else if (UNLIKELY((pid[i] = fork()) < 0)) {
+			fclose(tmp[i]);
+			break;
+		} else if (pid[i] == 0) {
+			/* we're segment I */
+			dup2(fileno(tmp[i]), STDOUT_FILENO);
+			for (size_t j = 0U; j <= i; j++) {
+				fclose(tmp[j]);
+			}
+			since = bnd[i] > since ? bnd[i] : since;
+			till = bnd[i + 1U] < till ? bnd[i + 1U] : till;
+			return -1;
+		}
+	}
+	/* put it together, in order */
+	for (size_t j = 0U; j < i; j++) {
+		static char buf[65536U];
+		int st;
+
+		while (waitpid(pid[j], &st, 0) < 0 && errno == EINTR);
+		if (!WIFEXITED(st) || WEXITSTATUS(st) != EXIT_SUCCESS) {
+			rc = EXIT_FAILURE;
+		}
+		rewind(tmp[j]);
+		for (size_t z; (z = fread(buf, 1U, sizeof(buf), tmp[j]));) {
+			obuf_write(buf, z);
+		}
+		fclose(tmp[j]);
+	}
+	obuf_flush();
+	if (UNLIKELY(i < n)) {
+		/* couldn't fork them all, do the rest ourselves */
+		since = bnd[i] > since ? bnd[i] : since;
+		return -1;
+	}
+	return rc;
+}
+
+static tv_t
+parse_tv(const char *str)
+{
+/* read S with an optional suffix, into NSECS */
+	tv_t r, mult;
+	char *on;
+
+	if (!(r = strtoull(str, &on, 10))) {
+		return NATV;
+	} else if (UNLIKELY((mult = sufstrtotv(on)) == NATV)) {
+		return NATV;
+	}
+	return r * (mult ?: NSECS);
+}
+
 
 #include "booksnap.yucc"
 
@@ -786,11 +1166,16 @@ main(int argc, char *argv[])
 {
 	static yuck_t argi[1U];
 	int rc = EXIT_SUCCESS;
-	static hx_t *conx;
-	static const char **cont;
-	static book_t *book;
+	static intern_t ins;
+	static xin_t in;
+	static const char *ctch;
+	static size_t ctchz;
+	static shard_t shrd;
 	static size_t nbook;
-	static size_t zbook;
+	static ckout_t ck;
+	static ckin_t ckin;
+	/* whether every instrument gets a book */
+	bool allp = false;
 	size_t nctch = 0U;
 
 	if (yuck_parse(argi, argc, argv) < 0) {
@@ -858,6 +1243,31 @@ Error: cannot open stamps file");
 	/* use a next routine du jour */
 	next = !argi->stamps_arg ? _next_intv : _next_stmp;
 
+	if (argi->from_arg &&
+	    UNLIKELY((since = strtotv(argi->from_arg, NULL)) == NATV)) {
+		errno = 0, serror("\
+Error: cannot read time to snap from");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+	if (argi->till_arg &&
+	    UNLIKELY((till = strtotv(argi->till_arg, NULL)) == NATV)) {
+		errno = 0, serror("\
+Error: cannot read time to snap till");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+	if (argi->at_arg) {
+		if (UNLIKELY((since = strtotv(argi->at_arg, NULL)) == NATV)) {
+			errno = 0, serror("\
+Error: cannot read time to snap at");
+			rc = EXIT_FAILURE;
+			goto out;
+		}
+		next = _next_once;
+		intv = 1ULL;
+	}
+
 	if (argi->invalidate_arg) {
 		char *on;
 		tv_t x;
@@ -921,7 +1331,7 @@ Error: cannot read number of levels for top-N book");
 		/* advance S if value consolidation */
 		s += *s == '/';
 
-		if ((cqty = strtoqx(s, NULL)) <= 0.dd) {
+		if ((cqty = strtoqx(s, NULL, &cscl.q)) <= 0) {
 			errno = 0, serror("\
 Error: cannot read consolidated quantity");
 			rc = EXIT_FAILURE;
@@ -929,137 +1339,370 @@ Error: cannot read consolidated quantity");
 		}
 	}
 
-	if ((nbook = argi->instr_nargs)) {
-		size_t j = 0U;
+	tick = NANPX;
+	if (argi->ladder_arg == YUCK_OPTARG_NONE) {
+		tick = 0;
+	} else if (argi->ladder_arg &&
+		   !((tick = strtopx(
+				argi->ladder_arg, NULL, &cscl.p)) > 0)) {
+		errno = 0, serror("\
+Error: cannot read ladder tick size");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
 
-		/* initialise hash array and books */
-		cont = malloc(nbook * sizeof(*cont));
-		conx = malloc(nbook * sizeof(*conx));
-		book = malloc(nbook * sizeof(*book));
+	if (argi->build_index_arg) {
+		if (UNLIKELY(argi->nargs != 1U)) {
+			errno = 0, serror("\
+Error: --build-index needs exactly one FILE");
+			rc = EXIT_FAILURE;
+			goto out;
+		} else if (UNLIKELY(argi->instr_nargs || argi->instr_file_arg ||
+				    argi->stamps_arg || argi->at_arg || inva)) {
+			errno = 0, serror("\
+Error: --build-index takes no -I, -S, --at or --invalidate");
+			rc = EXIT_FAILURE;
+			goto out;
+		} else if (UNLIKELY((intv = parse_tv(
+					     argi->build_index_arg)) == NATV)) {
+			errno = 0, serror("\
+Error: cannot read checkpoint interval, must be positive.");
+			rc = EXIT_FAILURE;
+			goto out;
+		} else if (UNLIKELY((ck = make_ckout(argi->args[0U])) == NULL)) {
+			serror("\
+Error: cannot write checkpoints for `%s'", argi->args[0U]);
+			rc = EXIT_FAILURE;
+			goto out;
+		}
+		/* keep books as they come */
+		offs = 0ULL;
+		tick = NANPX;
+		cscl = (xscl_t){0U, 0U};
+		next = _next_intv;
+	}
 
-		for (size_t i = 0U; i < nbook; i++) {
+	ins = make_intern();
+	if (argi->instr_nargs || argi->instr_file_arg) {
+		for (size_t i = 0U; i < argi->instr_nargs; i++) {
 			const char *this = argi->instr_args[i];
 			const size_t conz = strlen(this);
 
 			if (UNLIKELY(conz == 0U ||
 				     conz == 1U && *this == '*')) {
-				/* catch-all hash */
+				/* catch-all */
+				nctch = 1U;
 				continue;
 			}
-			cont[j] = this;
-			conx[j] = hash(this, conz);
-			book[j] = make_book();
-			j++;
+			intern(ins, this, conz);
 		}
-		if (j < nbook) {
-			/* oh, there's been catch-alls,
-			 * shrink NBOOK and initialise last cell */
-			nbook = j;
-			cont[nbook] = nbook ? "ALL" : NULL;
-			conx[nbook] = HX_CATCHALL;
-			book[nbook] = make_book();
-			nctch = 1U;
+		if (argi->instr_file_arg) {
+			ssize_t n = read_instrs(ins, argi->instr_file_arg);
+
+			if (UNLIKELY(n < 0)) {
+				serror("\
+Error: cannot read instruments from `%s'", argi->instr_file_arg);
+				free_intern(ins);
+				rc = EXIT_FAILURE;
+				goto out;
+			}
+			nctch |= n > 0;
 		}
+		/* duplicates have been folded, books are by id,
+		 * the catch-all book goes last */
+		nbook = intern_cnt(ins);
+		ctch = nbook ? "ALL" : NULL;
+		ctchz = nbook ? strlenof("ALL") : 0U;
 	} else {
-		/* allocate some 8U books */
-		zbook = 8U;
-		cont = malloc(zbook * sizeof(*cont));
-		conx = malloc(zbook * sizeof(*conx));
-		book = malloc(zbook * sizeof(*book));
+		allp = true;
 	}
 
+	if (argi->threads_arg && ck == NULL) {
+		if (!(nshrd = strtoul(argi->threads_arg, NULL, 10))) {
+			errno = 0, serror("\
+Error: cannot read number of threads");
+			rc = EXIT_FAILURE;
+			goto out;
+		}
+	}
+	if (argi->segments_arg &&
+	    !(nseg = strtoul(argi->segments_arg, NULL, 10))) {
+		errno = 0, serror("\
+Error: cannot read number of segments");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+	shlf = calloc(nshrd, sizeof(*shlf));
+
 	if (snap == snap3) {
 		init_snap3(nbook + nctch);
 	}
 
-	{
-		char *line = NULL;
-		size_t llen = 0UL;
+	/* segments need checkpoints, for which stamps, expiries and the
+	 * catch-all need the full history, they'd better go in one */
+	if (nseg > 1U && argi->nargs == 1U && ck == NULL &&
+	    !argi->stamps_arg && !argi->at_arg && !inva && !nctch) {
+		int st;
+
+		if (!prepass(argi->args[0U])) {
+			/* we're the pre-pass, index all books of FILE */
+			if (UNLIKELY((ck = make_ckout(argi->args[0U])) == NULL)) {
+				rc = EXIT_FAILURE;
+				goto fin;
+			}
+			free_intern(ins);
+			ins = make_intern();
+			allp = true;
+			nbook = 0U;
+			nshrd = 1U;
+			tick = NANPX;
+			cscl = (xscl_t){0U, 0U};
+		} else if ((st = segment(argi->args[0U])) >= 0) {
+			/* all segments are out */
+			rc = st;
+			goto fin;
+		}
+	}
 
-		for (ssize_t nrd; (nrd = getline(&line, &llen, stdin)) > 0;) {
-			xquo_t q;
-			size_t k;
-			hx_t hx;
+	/* open the inputs */
+	size_t nprs = 0U;
+	int cpu = -1;
+	if (argi->parsers_arg &&
+	    !(nprs = strtoul(argi->parsers_arg, NULL, 10))) {
+		errno = 0, serror("\
+Error: cannot read number of parsers");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+	/* checkpoints want positions, which only the serial reader knows */
+	if ((argi->pipeline_arg || nprs) && ck == NULL) {
+		/* reader, parsers, books and writer go to CPU, CPU+1, ... */
+		if (argi->pipeline_arg &&
+		    argi->pipeline_arg != YUCK_OPTARG_NONE) {
+			cpu = strtol(argi->pipeline_arg, NULL, 10);
+		}
+		nprs += !nprs;
+		if (UNLIKELY((in = make_xin(
+				      argi->nargs, argi->args,
+				      nprs, cpu)) == NULL ||
+			     obuf_async(cpu >= 0
+					? cpu + (int)nprs + 2 : -1) < 0)) {
+			serror("\
+Error: cannot set up pipeline");
+			rc = EXIT_FAILURE;
+			goto out;
+		}
+		pin_stage(cpu >= 0 ? cpu + (int)nprs + 1 : -1);
+	} else if (UNLIKELY((in = make_xin(
+				     argi->nargs, argi->args,
+				     0U, -1)) == NULL)) {
+		serror("\
+Error: cannot set up input");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+	/* shards go after that */
+	if (nshrd > 1U &&
+	    UNLIKELY((shrd = make_shard(
+			      nshrd, work,
+			      cpu >= 0 ? cpu + (int)nprs + 3 : -1)) == NULL)) {
+		serror("\
+Error: cannot set up threads");
+		rc = EXIT_FAILURE;
+		goto out;
+	}
 
-			if (NOT_A_XQUO_P(q = read_xquo(line, nrd))) {
-				/* invalid quote line */
+	{
+		const char *line;
+		xquo_t q;
+		size_t k = NOT_AN_ID;
+
+		/* set up the books we know of, the catch-all goes last */
+		for (size_t i = 0U; i < nbook + nctch; i++) {
+			dispatch(shrd, (shev_t){
+					 i, .q.q.t = NATV,
+					 .q.ins = i < nbook
+					 ? intern_str(ins, i) : ctch,
+					 .q.inz = i < nbook
+					 ? intern_len(ins, i) : ctchz});
+		}
+		/* start off a checkpoint if we can, the catch-all, expiries
+		 * and level-3 diffs across stamps need the full history */
+		if (since && argi->nargs == 1U && ck == NULL &&
+		    !nctch && !inva && !(snap == snap3 && argi->stamps_arg) &&
+		    (ckin = make_ckin(argi->args[0U])) != NULL) {
+			/* in interval mode the snap before SINCE must be
+			 * shot off the checkpoint, for level-3 diffs */
+			const tv_t t = next == _next_intv
+				? since > intv ? since - intv : 0ULL : since;
+			const ckpt_t *c = ckin_find(ckin, t);
+			ckbook_t bk;
+
+			for (size_t o = 0U;
+			     c != NULL && (o = ckin_book(ckin, c, o, &bk));) {
+				if (!allp) {
+					if ((k = intern_get(
+						     ins, bk.ins, bk.inz)) >= nbook) {
+						continue;
+					}
+				} else if (UNLIKELY((k = intern(
+							     ins, bk.ins,
+							     bk.inz)) == NOT_AN_ID)) {
+					continue;
+				} else if (k >= nbook) {
+					dispatch(shrd, (shev_t){
+							 k, .q.q.t = NATV,
+							 .q.ins = intern_str(ins, k),
+							 .q.inz = intern_len(ins, k)});
+					nbook++;
+				}
+				/* levels go in as level-2 quotes */
+				for (size_t i = 0U; i < bk.nbid + bk.nask; i++) {
+					const book_side_t s = i < bk.nbid
+						? BOOK_SIDE_BID : BOOK_SIDE_ASK;
+
+					dispatch(shrd, (shev_t){k, .q = {
+								 .q = {
+									 s, BOOK_LVL_2,
+									 bk.lvl[i].p,
+									 bk.lvl[i].q,
+									 bk.lvl[i].t},
+								 .scl = bk.scl}});
+				}
+			}
+			if (c != NULL) {
+				while ((metr = next(c->t)) < c->t);
+				if (!allp && !nctch) {
+					xin_filter(in, ins);
+				}
+				xin_seek(in, c->pos);
+			}
+			k = NOT_AN_ID;
+		}
+		for (int st;
+		     (st = next_xquo(in, &q, &line, &k)); k = NOT_AN_ID) {
+			if (UNLIKELY(st < 0)) {
+				serror("Error: cannot open file `%s'", line);
+				rc = EXIT_FAILURE;
 				continue;
 			} else if (q.q.t == NATV) {
 				/* invalid quote line */
 				continue;
 			} else if (UNLIKELY(!metr)) {
 				while ((metr = next(q.q.t)) < q.q.t);
-			}
-			/* check if we've got him in our books */
-			if (nbook || zbook) {
-				hx = hash(q.ins, q.inz);
-				for (k = 0U; k < nbook; k++) {
-					if (conx[k] == hx) {
-						goto snap;
-					}
+				if (ck != NULL && !argi->build_index_arg) {
+					/* pre-pass, checkpoint at segments */
+					ckpos = ckstep =
+						xin_size(in) / nseg ?: NOT_AN_ID;
+				}
+				/* without catch-alls we can filter early */
+				if (!allp && !nctch) {
+					xin_filter(in, ins);
 				}
 			}
-			if (nctch) {
+			/* check if we've got him in our books */
+			if (k < nbook) {
+				/* read_xquo_ins() has looked him up */
 				goto snap;
-			} else if (!zbook) {
+			} else if (!allp) {
+				if ((k = intern_get(ins, q.ins, q.inz)) < nbook) {
+					goto snap;
+				} else if (nctch) {
+					k = nbook;
+					goto snap;
+				}
 				/* ok, it's not for us */
 				continue;
-			} else if (UNLIKELY(nbook >= zbook)) {
-				/* resize */
-				zbook *= 2U;
-				cont = realloc(cont, zbook * sizeof(*cont));
-				conx = realloc(conx, zbook * sizeof(*conx));
-				book = realloc(book, zbook * sizeof(*book));
+			} else if (LIKELY((k = intern(ins, q.ins, q.inz)) < nbook)) {
+				goto snap;
+			} else if (UNLIKELY(k == NOT_AN_ID)) {
+				continue;
 			}
 			/* initialise the book */
-			cont[nbook] = strndup(q.ins, q.inz);
-			conx[nbook] = hx;
-			book[nbook] = make_book();
+			dispatch(shrd, (shev_t){
+					 k, .q.q.t = NATV,
+					 .q.ins = intern_str(ins, k),
+					 .q.inz = intern_len(ins, k)});
 			nbook++;
 		snap:
 			/* do we need to shoot a snap? */
 			if (LIKELY(q.q.t <= metr)) {
 				goto badd;
+			} else if (ck != NULL) {
+				/* checkpoint instead, Q is yet to go in */
+				const size_t pos = xin_tell(in);
+
+				if (pos >= ckpos) {
+					mark(ck, metr, pos);
+					while ((ckpos += ckstep) <= pos &&
+					       ckstep);
+				}
+				while ((metr = next(q.q.t)) < q.q.t);
+				goto badd;
 			}
 			do {
-				/* materialise snapshot */
-				for (ibk = 0U; ibk < nbook + nctch; ibk++) {
-					book_exp(book[ibk], inva ? metr : 0ULL);
-					snap(book[ibk], cont[ibk]);
+				if (UNLIKELY(metr >= till)) {
+					/* not our snaps any more */
+					metr = NATV;
+					break;
+				} else if (metr >= since) {
+					dispatch(shrd, (shev_t){
+							 NOT_AN_ID, nbook + nctch,
+							 .q.q.t = metr});
+				} else if (inva || snap == snap3) {
+					dispatch(shrd, (shev_t){
+							 NOT_AN_ID, 0U,
+							 .q.q.t = metr});
 				}
 			} while ((metr = next(q.q.t)) < q.q.t);
+			if (UNLIKELY(metr == NATV)) {
+				/* no more snaps to shoot */
+				break;
+			}
 		badd:
-			/* add to book */
-			q.q.t += inva;
-			q.q = book_add(book[k], q.q);
+			dispatch(shrd, (shev_t){k, .q = q});
 		}
-		free(line);
 		/* final snapshot */
-		if (metr < NATV) {
-			for (ibk = 0U; ibk < nbook + nctch; ibk++) {
-				book_exp(book[ibk], inva ? metr : 0ULL);
-				snap(book[ibk], cont[ibk]);
-			}
+		if (metr < till && metr >= since && ck == NULL) {
+			dispatch(shrd, (shev_t){
+					 NOT_AN_ID, nbook + nctch,
+					 .q.q.t = metr});
+		}
+		if (shrd != NULL && UNLIKELY(free_shard(shrd) < 0)) {
+			werr = -1;
+		}
+		obuf_flush();
+		if (UNLIKELY(werr)) {
+			serror("\
+Error: out of memory, output is incomplete");
+			rc = EXIT_FAILURE;
 		}
 	}
+	free_xin(in);
+	if (ckin != NULL) {
+		free_ckin(ckin);
+	}
+	if (ck != NULL && UNLIKELY(free_ckout(ck) < 0)) {
+		serror("\
+Error: cannot write checkpoints for `%s'", argi->args[0U]);
+		rc = EXIT_FAILURE;
+	}
 
+fin:
 	if (snap == snap3) {
 		free_snap3();
 	}
-
-	if (nbook + nctch) {
-		for (size_t i = 0U; i < nbook + nctch; i++) {
-			book[i] = free_book(book[i]);
-		}
-		if (zbook) {
-			for (size_t i = 0U; i < nbook + nctch; i++) {
-				free(deconst(cont[i]));
-			}
+	for (size_t w = 0U; w < nshrd; w++) {
+		for (size_t i = 0U; i < shlf[w].n; i++) {
+			shlf[w].book[i] = free_book(shlf[w].book[i]);
 		}
-		free(cont);
-		free(conx);
-		free(book);
+		free(shlf[w].book);
+		free(shlf[w].scl);
+		free(shlf[w].cont);
+		free(shlf[w].conz);
 	}
+	free(shlf);
+	free_intern(ins);
 
 	if (argi->stamps_arg) {
 		fclose(sfil);
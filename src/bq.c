@@ -0,0 +1,577 @@
+/*** bq.c -- binary quote files
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#if defined HAVE_DFP754_H
+# include <dfp754.h>
+#endif	/* HAVE_DFP754_H */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dfp754_d32.h"
+#include "dfp754_d64.h"
+#include "bq.h"
+#include "nifty.h"
+
+/* room for a rendered stamp */
+#define STMPZ	(32U)
+/* archive columns */
+#define NCOL	(7U)
+
+struct bqin_s {
+	/* the whole file */
+	char *m;
+	size_t mz;
+	const bq_t *r;
+	size_t nr;
+	size_t ir;
+	/* block index, and the current block unpacked, archives only */
+	const bqblk_t *blk;
+	size_t nblk;
+	size_t iblk;
+	bq_t *ubuf;
+	size_t ublk;
+	/* instrument names, by id */
+	struct {
+		const char *s;
+		size_t z;
+	} *ins;
+	size_t nins;
+	/* ids in the last filter, by id, and the bits to look for */
+	intern_t flt;
+	size_t *fid;
+	uint64_t want[4U];
+	/* time window */
+	tv_t from;
+	tv_t till;
+	/* current line */
+	char *ln;
+	size_t lz;
+};
+
+
+/* little-endian base 128 varints, and zigzag for the signed ones */
+static inline size_t
+putv(uint8_t *restrict b, uint64_t x)
+{
+	size_t n = 0U;
+
+	for (; x >= 0x80U; x >>= 7U) {
+		b[n++] = (uint8_t)(x | 0x80U);
+	}
+	b[n++] = (uint8_t)x;
+	return n;
+}
+
+static inline uint64_t
+getv(const uint8_t **b, const uint8_t *ep)
+{
+	uint64_t x = 0U;
+	const uint8_t *p = *b;
+
+	for (unsigned int sh = 0U; p < ep && sh < 64U; sh += 7U) {
+		x |= (uint64_t)(*p & 0x7fU) << sh;
+		if (!(*p++ & 0x80U)) {
+			break;
+		}
+	}
+	*b = p;
+	return x;
+}
+
+static inline uint64_t
+zz(int64_t x)
+{
+	return ((uint64_t)x << 1U) ^ (uint64_t)(x >> 63U);
+}
+
+static inline int64_t
+unzz(uint64_t x)
+{
+	return (int64_t)(x >> 1U) ^ -(int64_t)(x & 1U);
+}
+
+/* prices and quantities as integers of DP decimal places, with
+ * fixed-point books that's what they are already */
+static inline int64_t
+tkof(px_t x, unsigned char scl, int *dp)
+{
+#if defined BOOKSI64
+	*dp = scl;
+	return x;
+#else  /* !BOOKSI64 */
+	bcd64_t b = decompd64(x);
+
+	(void)scl;
+	*dp = -b.expo;
+	return b.sign ? -(int64_t)b.mant : (int64_t)b.mant;
+#endif	/* BOOKSI64 */
+}
+
+static inline px_t
+xof(int64_t tk, int dp)
+{
+#if defined BOOKSI64
+	(void)dp;
+	return tk;
+#else  /* !BOOKSI64 */
+	return scalbnd64((_Decimal64)tk, -dp);
+#endif	/* BOOKSI64 */
+}
+
+
+bqin_t
+make_bqin(const char *fn)
+{
+	struct bqin_s *r;
+	struct stat st;
+	bqhdr_t h;
+	bool arcp;
+	int fd;
+
+	if (fn[0U] == '-' && fn[1U] == '\0') {
+		errno = 0;
+		return NULL;
+	} else if (UNLIKELY((fd = open(fn, O_RDONLY)) < 0)) {
+		return NULL;
+	} else if (pread(fd, &h, sizeof(h), 0) < (ssize_t)sizeof(h) ||
+		   (memcmp(h.magic, BQ_MAGIC, sizeof(h.magic)) &&
+		    memcmp(h.magic, BQ_MAGIC_ARC, sizeof(h.magic)))) {
+		/* not for us */
+		close(fd);
+		errno = 0;
+		return NULL;
+	}
+	arcp = !memcmp(h.magic, BQ_MAGIC_ARC, sizeof(h.magic));
+	if (UNLIKELY(memcmp(h.flav, BQ_FLAV, sizeof(h.flav)) ||
+		     fstat(fd, &st) < 0 ||
+		     h.dict + h.dicz > (uint64_t)st.st_size ||
+		     !arcp &&
+		     h.nrec > (h.dict - sizeof(h)) / sizeof(bq_t) ||
+		     arcp &&
+		     (h.blks > (uint64_t)st.st_size ||
+		      h.nblk > ((uint64_t)st.st_size - h.blks) /
+		      sizeof(bqblk_t)))) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	} else if (UNLIKELY((r = calloc(1U, sizeof(*r))) == NULL)) {
+		close(fd);
+		return NULL;
+	}
+	r->m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (UNLIKELY(r->m == MAP_FAILED)) {
+		free(r);
+		return NULL;
+	}
+	(void)posix_madvise(r->m, st.st_size, POSIX_MADV_SEQUENTIAL);
+	r->mz = st.st_size;
+	if (!arcp) {
+		r->r = (const bq_t*)(r->m + sizeof(h));
+		r->nr = h.nrec;
+	} else {
+		r->blk = (const bqblk_t*)(r->m + h.blks);
+		r->nblk = h.nblk;
+		/* blocks go here when serially read */
+		r->r = r->ubuf = malloc(BQ_BLKN * sizeof(*r->ubuf));
+		if (UNLIKELY(r->ubuf == NULL)) {
+			goto nope;
+		}
+	}
+	r->till = NATV;
+	memset(r->want, -1, sizeof(r->want));
+
+	/* index the dictionary */
+	if (UNLIKELY((r->ins = malloc(h.nins * sizeof(*r->ins))) == NULL &&
+		     h.nins)) {
+		goto nope;
+	}
+	with (const char *s = r->m + h.dict, *const ep = s + h.dicz) {
+		size_t maxz = 0U;
+
+		for (const char *eol;
+		     r->nins < h.nins &&
+			     (eol = memchr(s, '\n', ep - s)) != NULL;
+		     s = eol + 1U, r->nins++) {
+			r->ins[r->nins].s = s;
+			r->ins[r->nins].z = eol - s;
+			maxz = r->ins[r->nins].z > maxz
+				? r->ins[r->nins].z : maxz;
+		}
+		if (UNLIKELY(r->nins < h.nins)) {
+			errno = EINVAL;
+			goto nope;
+		}
+		/* stamp, tab, instrument, tab */
+		r->lz = STMPZ + maxz + 2U;
+	}
+	if (UNLIKELY((r->ln = malloc(r->lz)) == NULL)) {
+		goto nope;
+	}
+	return r;
+
+nope:
+	free_bqin(r);
+	return NULL;
+}
+
+void
+free_bqin(bqin_t b)
+{
+	munmap(b->m, b->mz);
+	free(b->ubuf);
+	free(b->ins);
+	free(b->fid);
+	free(b->ln);
+	free(b);
+	return;
+}
+
+size_t
+bq_maxln(bqin_t b)
+{
+	return b->lz;
+}
+
+size_t
+bq_nblk(bqin_t b)
+{
+	return b->nblk;
+}
+
+int
+bq_filter(bqin_t b, intern_t flt)
+{
+	/* look up our instruments in the new filter */
+	b->flt = flt;
+	if (flt == NULL) {
+		memset(b->want, -1, sizeof(b->want));
+		return 0;
+	} else if (b->fid == NULL &&
+		   UNLIKELY((b->fid = malloc(
+				     b->nins * sizeof(*b->fid))) == NULL &&
+			    b->nins)) {
+		return -1;
+	}
+	memset(b->want, 0, sizeof(b->want));
+	for (size_t i = 0U; i < b->nins; i++) {
+		b->fid[i] = intern_get(flt, b->ins[i].s, b->ins[i].z);
+		if (b->fid[i] != NOT_AN_ID) {
+			b->want[i / 64U % 4U] |= 1ULL << (i % 64U);
+		}
+	}
+	return 0;
+}
+
+void
+bq_window(bqin_t b, tv_t from, tv_t till)
+{
+	b->from = from;
+	b->till = till;
+	return;
+}
+
+bool
+bq_blkp(bqin_t b, size_t i)
+{
+	const bqblk_t *k = b->blk + i;
+
+	/* quotes without instrument have no bit, they only
+	 * make it through without filter */
+	return k->till >= b->from && k->from <= b->till &&
+		(b->flt == NULL ||
+		 ((k->ins[0U] & b->want[0U]) | (k->ins[1U] & b->want[1U]) |
+		  (k->ins[2U] & b->want[2U]) | (k->ins[3U] & b->want[3U])));
+}
+
+ssize_t
+bq_unpack(bqin_t b, size_t i, bq_t *restrict r)
+{
+	const bqblk_t *k = b->blk + i;
+	const uint8_t *bp, *cp[NCOL], *ep[NCOL];
+	uint32_t loc[BQ_BLKN];
+	int64_t lst[BQ_BLKN];
+	size_t nloc = 0U;
+
+	if (UNLIKELY(k->off > b->mz || k->len > b->mz - k->off ||
+		     k->len < NCOL * sizeof(uint32_t) ||
+		     k->nrec > BQ_BLKN)) {
+		return -1;
+	}
+	/* find the columns */
+	bp = (const uint8_t*)b->m + k->off;
+	for (size_t j = 0U, o = 0U; j < NCOL; j++) {
+		uint32_t eo;
+
+		memcpy(&eo, bp + j * sizeof(eo), sizeof(eo));
+		if (UNLIKELY(eo < o ||
+			     eo > k->len - NCOL * sizeof(uint32_t))) {
+			return -1;
+		}
+		cp[j] = bp + NCOL * sizeof(uint32_t) + o;
+		ep[j] = bp + NCOL * sizeof(uint32_t) + (o = eo);
+	}
+	/* the block's instruments */
+	while (cp[0U] < ep[0U] && nloc < countof(loc)) {
+		const uint64_t id = getv(cp + 0U, ep[0U]);
+
+		loc[nloc] = id && id <= b->nins ? (uint32_t)(id - 1U) : BQ_NOINS;
+		lst[nloc++] = 0;
+	}
+	/* and the quotes */
+	with (tv_t t = 0U, d = 0U) {
+		for (size_t j = 0U; j < k->nrec; j++) {
+			const size_t l = getv(cp + 1U, ep[1U]);
+			uint8_t sf;
+			int dp, dq;
+
+			if (UNLIKELY(l >= nloc || cp[3U] >= ep[3U])) {
+				return -1;
+			}
+			d += unzz(getv(cp + 2U, ep[2U]));
+			t += d;
+			sf = *cp[3U]++;
+			dp = (int)unzz(getv(cp + 4U, ep[4U]));
+			dq = (int)unzz(getv(cp + 4U, ep[4U]));
+
+			r[j].t = t;
+			r[j].k = loc[l];
+			r[j].s = sf & 0xfU;
+			r[j].f = (sf >> 4U) & 0x3U;
+#if defined BOOKSI64
+			r[j].scl = (xscl_t){(unsigned char)dp, (unsigned char)dq};
+#else  /* !BOOKSI64 */
+			r[j].scl = (xscl_t){0U};
+#endif	/* BOOKSI64 */
+			if (LIKELY(!(sf & 0x80U))) {
+				lst[l] += unzz(getv(cp + 5U, ep[5U]));
+				r[j].p = xof(lst[l], dp);
+			} else {
+				r[j].p = NANPX;
+			}
+			if (LIKELY(!(sf & 0x40U))) {
+				r[j].q = xof(unzz(getv(cp + 6U, ep[6U])), dq);
+			} else {
+				r[j].q = NANQX;
+			}
+		}
+	}
+	return k->nrec;
+}
+
+size_t
+bq_pack(uint8_t *restrict buf, bqblk_t *blk, const bq_t *r, size_t n)
+{
+	/* columns go to their own areas first */
+	uint8_t *cp[NCOL], *c0[NCOL];
+	uint32_t loc[BQ_BLKN];
+	uint32_t eo[NCOL];
+	int64_t lst[BQ_BLKN];
+	size_t nloc = 0U;
+	size_t len;
+
+	memset(blk, 0, sizeof(*blk));
+	blk->nrec = (uint32_t)n;
+	blk->from = NATV;
+	/* instruments and their positions take up to 5 and 2 bytes
+	 * per quote, the other columns up to 10 */
+	c0[0U] = buf + NCOL * sizeof(uint32_t);
+	for (size_t j = 1U; j < NCOL; j++) {
+		c0[j] = c0[j - 1U] + n * (j <= 2U ? 8U : 10U);
+	}
+	memcpy(cp, c0, sizeof(cp));
+	with (tv_t t = 0U, d = 0U) {
+		for (size_t j = 0U; j < n; j++) {
+			const tv_t nud = r[j].t - t;
+			size_t l;
+			uint8_t sf;
+			int dp, dq;
+			int64_t tk;
+
+			/* instrument, linear search is fine for a block */
+			for (l = 0U; l < nloc && loc[l] != r[j].k; l++);
+			if (l >= nloc) {
+				loc[nloc] = r[j].k;
+				lst[nloc++] = 0;
+				cp[0U] += putv(cp[0U], r[j].k < BQ_NOINS
+					       ? (uint64_t)r[j].k + 1U : 0U);
+				if (r[j].k < BQ_NOINS) {
+					blk->ins[r[j].k / 64U % 4U] |=
+						1ULL << (r[j].k % 64U);
+				}
+			}
+			cp[1U] += putv(cp[1U], l);
+			/* stamp */
+			cp[2U] += putv(cp[2U], zz((int64_t)(nud - d)));
+			t = r[j].t;
+			d = nud;
+			blk->from = t < blk->from ? t : blk->from;
+			blk->till = t > blk->till ? t : blk->till;
+			/* side, flavour, and whether there's price and qty */
+			sf = (uint8_t)(r[j].s & 0xfU | (r[j].f & 0x3U) << 4U);
+			sf |= (uint8_t)(isnanpx(r[j].p) << 7U);
+			sf |= (uint8_t)(isnanqx(r[j].q) << 6U);
+			*cp[3U]++ = sf;
+			/* price and quantity */
+			dp = dq = 0;
+			if (!(sf & 0x80U)) {
+				tk = tkof(r[j].p, r[j].scl.p, &dp);
+				cp[5U] += putv(cp[5U], zz(tk - lst[l]));
+				lst[l] = tk;
+			}
+			if (!(sf & 0x40U)) {
+				tk = tkof(r[j].q, r[j].scl.q, &dq);
+				cp[6U] += putv(cp[6U], zz(tk));
+			}
+			cp[4U] += putv(cp[4U], zz(dp));
+			cp[4U] += putv(cp[4U], zz(dq));
+		}
+	}
+	/* close the gaps */
+	len = 0U;
+	for (size_t j = 0U; j < NCOL; j++) {
+		const size_t z = cp[j] - c0[j];
+
+		memmove(buf + NCOL * sizeof(uint32_t) + len, c0[j], z);
+		eo[j] = (uint32_t)(len += z);
+	}
+	memcpy(buf, eo, sizeof(eo));
+	len += sizeof(eo);
+	blk->len = (uint32_t)len;
+	return len;
+}
+
+size_t
+bq_line(bqin_t b, const bq_t *r, xquo_t *q, char *ln)
+{
+	size_t len = 0U;
+
+	if (LIKELY(r->k < b->nins)) {
+		if (LIKELY(r->t != NATV)) {
+			len = tvtostr(ln, STMPZ, r->t);
+			ln[len++] = '\t';
+		}
+		q->ins = ln + len;
+		q->inz = b->ins[r->k].z;
+		memcpy(ln + len, b->ins[r->k].s, q->inz);
+		len += q->inz;
+		ln[len++] = '\t';
+	} else {
+		/* like lines with the side up front */
+		q->ins = ln;
+		q->inz = 0U;
+	}
+	q->q = (book_quo_t){
+		(book_side_t)r->s, (book_lvl_t)r->f,
+		.p = r->p, .q = r->q, .t = r->t,
+	};
+	q->scl = r->scl;
+	return len;
+}
+
+size_t
+bq_tell(bqin_t b)
+{
+	return b->ublk * BQ_BLKN + b->ir - 1U;
+}
+
+size_t
+bq_size(bqin_t b)
+{
+	return b->nblk ? b->nblk * BQ_BLKN : b->nr;
+}
+
+int
+bq_seek(bqin_t b, size_t pos)
+{
+	if (!b->nblk) {
+		b->ir = pos < b->nr ? pos : b->nr;
+		return 0;
+	} else if (UNLIKELY((b->iblk = pos / BQ_BLKN) >= b->nblk)) {
+		b->nr = b->ir = 0U;
+		return 0;
+	}
+	/* unpack the block, filter or not */
+	with (ssize_t n = bq_unpack(b, b->ublk = b->iblk++, b->ubuf)) {
+		if (UNLIKELY(n < 0)) {
+			return -1;
+		}
+		b->nr = n;
+		b->ir = pos % BQ_BLKN < b->nr ? pos % BQ_BLKN : b->nr;
+	}
+	return 0;
+}
+
+ssize_t
+next_bq(bqin_t b, xquo_t *q, const char **ln, intern_t flt, size_t *k)
+{
+	if (UNLIKELY(flt != b->flt) && UNLIKELY(bq_filter(b, flt) < 0)) {
+		return -1;
+	}
+	for (;;) {
+		while (b->ir < b->nr) {
+			const bq_t *r = b->r + b->ir++;
+
+			if (flt != NULL) {
+				if (UNLIKELY(r->k >= b->nins) ||
+				    (*k = b->fid[r->k]) == NOT_AN_ID) {
+					continue;
+				}
+			}
+			*ln = b->ln;
+			return bq_line(b, r, q, b->ln);
+		}
+		/* next block then */
+		for (; b->iblk < b->nblk && !bq_blkp(b, b->iblk); b->iblk++);
+		if (b->iblk >= b->nblk) {
+			break;
+		}
+		with (ssize_t n = bq_unpack(b, b->ublk = b->iblk++, b->ubuf)) {
+			b->nr = n > 0 ? n : 0U;
+			b->ir = 0U;
+		}
+	}
+	return -1;
+}
+
+/* bq.c ends here */
@@ -0,0 +1,195 @@
+/*** bq.h -- binary quote files
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_bq_h_
+#define INCLUDED_bq_h_
+#include <stdint.h>
+#include <stdbool.h>
+#include "xquo.h"
+#include "intern.h"
+
+/**
+ * Binary quote files are a header, fixed-size quote records and a
+ * dictionary of instrument names, one per line, ids are line numbers.
+ * The dictionary trails the records so files can be written in one
+ * go, the header says where it is.
+ * Everything is in native byte order and prices and quantities are
+ * kept as px_t and qx_t bits, so files can only be read by the flavour
+ * that wrote them.
+ *
+ * Archives hold the records in blocks of up to BQ_BLKN quotes, each
+ * stored column by column:
+ * - the block's instruments, as varints of id + 1, 0 for none
+ * - per quote the instrument's position in the above, varint
+ * - stamps, delta-of-delta, zigzag varint
+ * - side and flavour, a byte, bit 6 and 7 flag missing quantities
+ *   and prices
+ * - decimal places of price and quantity, zigzag varints
+ * - prices, as integers of said decimal places, zigzag varint of
+ *   the difference to the instrument's last price in the block
+ * - quantities, as integers of said decimal places, zigzag varint
+ * Blocks start with the offsets of their columns and can be decoded
+ * independently.
+ * An index of blocks, with time range and instruments, follows the
+ * dictionary so readers can skip blocks without decoding them. */
+#define BQ_MAGIC	"books\0bq"
+#define BQ_MAGIC_ARC	"books\0ba"
+#if defined BOOKSI64
+# define BQ_FLAV	"I64"
+#else  /* !BOOKSI64 */
+# define BQ_FLAV	"D64"
+#endif	/* BOOKSI64 */
+
+/* id of quotes without instrument */
+#define BQ_NOINS	(0xffffffffU)
+
+/* quotes per archive block, and room needed to pack N of them */
+#define BQ_BLKN		(4096U)
+#define BQ_BLKZ(n)	(7U * sizeof(uint32_t) + (n) * 72U)
+
+typedef struct {
+	char magic[8U];
+	char flav[4U];
+	uint32_t nins;
+	uint64_t nrec;
+	/* offset and size of the dictionary */
+	uint64_t dict;
+	uint64_t dicz;
+	/* offset and number of entries of the block index, archives only */
+	uint64_t blks;
+	uint64_t nblk;
+} bqhdr_t;
+
+typedef struct {
+	tv_t t;
+	uint32_t k;
+	uint8_t s;
+	uint8_t f;
+	xscl_t scl;
+	px_t p;
+	qx_t q;
+} bq_t;
+
+typedef struct {
+	/* offset and size of the block */
+	uint64_t off;
+	uint32_t len;
+	uint32_t nrec;
+	/* first and last stamp */
+	tv_t from;
+	tv_t till;
+	/* instruments in the block, bit ID modulo 256 */
+	uint64_t ins[4U];
+} bqblk_t;
+
+typedef struct bqin_s *bqin_t;
+
+/**
+ * Map binary quote file FN.
+ * Return NULL with errno set if FN cannot be read or was written by
+ * another flavour, or NULL with errno 0 if FN is no binary quote file,
+ * stdin (`-') never is. */
+extern bqin_t make_bqin(const char *fn);
+
+extern void free_bqin(bqin_t);
+
+/**
+ * Return the length of the longest line next_bq() can produce. */
+extern size_t bq_maxln(bqin_t);
+
+/**
+ * Return the number of blocks if B is an archive, 0 otherwise. */
+extern size_t bq_nblk(bqin_t b);
+
+/**
+ * Only hand out quotes for instruments in FLT from now on,
+ * or everything if FLT is NULL. */
+extern int bq_filter(bqin_t b, intern_t flt);
+
+/**
+ * Skip blocks with no stamps between FROM and TILL. */
+extern void bq_window(bqin_t b, tv_t from, tv_t till);
+
+/**
+ * Return whether block I of B may hold quotes for the filter and
+ * the window in place. */
+extern bool bq_blkp(bqin_t b, size_t i);
+
+/**
+ * Decode block I of B into R which must have room for BQ_BLKN records.
+ * Return the number of records or -1 if the block is corrupt.
+ * Blocks can be unpacked concurrently. */
+extern ssize_t bq_unpack(bqin_t b, size_t i, bq_t *restrict r);
+
+/**
+ * Pack the N records R, N <= BQ_BLKN, into BUF which must have room
+ * for BQ_BLKZ(N) bytes, fill in BLK but its offset.
+ * Return the number of bytes used. */
+extern size_t
+bq_pack(uint8_t *restrict buf, bqblk_t *blk, const bq_t *r, size_t n);
+
+/**
+ * Turn record R of B into Q, its stamp and instrument go to LN which
+ * must have room for bq_maxln() bytes, return the length of LN.
+ * Safe to call concurrently. */
+extern size_t bq_line(bqin_t b, const bq_t *r, xquo_t *q, char *ln);
+
+/**
+ * Return the position of the quote last handed out by next_bq(). */
+extern size_t bq_tell(bqin_t b);
+
+/**
+ * Return the position past the last quote, for archives that's past
+ * the last block. */
+extern size_t bq_size(bqin_t b);
+
+/**
+ * Make the quote at position POS the next one to be handed out.
+ * Positions in archives are block * BQ_BLKN + index in the block.
+ * Return 0 on success, -1 otherwise. */
+extern int bq_seek(bqin_t b, size_t pos);
+
+/**
+ * Put the next quote into Q and its stamp and instrument, tab-separated
+ * like in text files, into a line whose address goes to LN and which
+ * is overwritten by the next call.
+ * If FLT is given, skip quotes for instruments not in FLT and put the
+ * instrument's id in FLT into K.
+ * Return the length of the line or -1 if there are no more quotes. */
+extern ssize_t
+next_bq(bqin_t, xquo_t *q, const char **ln, intern_t flt, size_t *k);
+
+#endif	/* INCLUDED_bq_h_ */
@@ -44,15 +44,23 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#if defined __AVX2__ || defined __SSE4_2__
+# include <immintrin.h>
+#endif	/* __AVX2__ || __SSE4_2__ */
+#include "dfp754_d64.h"
 
-#if !defined BOOKSD64 && !defined BOOKSD32
+#if !defined BOOKSD64 && !defined BOOKSD32 && !defined BOOKSI64
 # define BTREE_MULTI
 # define BOOKSD64
-#endif	/* !BOOKSD64 && !BOOKSD32 */
+#endif	/* !BOOKSD64 && !BOOKSD32 && !BOOKSI64 */
 #include "btree.h"
 #include "btree_val.h"
 #include "nifty.h"
 
+#if !defined BOOKSD32 || !defined BOOKSD64
+# define btree_c_once
+#endif
+
 #undef btree_ual_t
 #undef node_free_p
 #undef root_split
@@ -61,9 +69,42 @@
 #undef twig_get
 #undef leaf_add
 #undef twig_add
+#undef make_ikey
+#undef key_ikey
+#undef node_slab
+#undef make_node
+#undef free_node
+#undef free_nodes
+#undef node_last
+#undef leaf_prev
+#undef val_sum
+#undef node_sum
+#undef sum_upd
+#undef val_set
 
 #if 0
 
+#elif defined BOOKSI64
+# define btree_ual_t	btreei64_ual_t
+# define node_free_p	nodei64_free_p
+# define root_split	rooti64_split
+# define node_split	nodei64_split
+# define leaf_get	leafi64_get
+# define twig_get	twigi64_get
+# define leaf_add	leafi64_add
+# define twig_add	twigi64_add
+# define make_ikey(k)	ikey_i64(k)
+# define key_ikey	keyi64_ikey
+# define node_slab	nodei64_slab
+# define make_node	make_nodei64
+# define free_node	free_nodei64
+# define free_nodes	free_nodei64s
+# define node_last	nodei64_last
+# define leaf_prev	leafi64_prev
+# define val_sum	vali64_sum
+# define node_sum	nodei64_sum
+# define sum_upd	sumi64_upd
+# define val_set	vali64_set
 #elif defined BOOKSD32
 # define btree_ual_t	btreed32_ual_t
 # define node_free_p	noded32_free_p
@@ -73,6 +114,18 @@
 # define twig_get	twigd32_get
 # define leaf_add	leafd32_add
 # define twig_add	twigd32_add
+# define make_ikey(k)	ikey_d64((_Decimal64)(k))
+# define key_ikey	keyd32_ikey
+# define node_slab	noded32_slab
+# define make_node	make_noded32
+# define free_node	free_noded32
+# define free_nodes	free_noded32s
+# define node_last	noded32_last
+# define leaf_prev	leafd32_prev
+# define val_sum	vald32_sum
+# define node_sum	noded32_sum
+# define sum_upd	sumd32_upd
+# define val_set	vald32_set
 #elif defined BOOKSD64
 # define btree_ual_t	btreed64_ual_t
 # define node_free_p	noded64_free_p
@@ -82,7 +135,19 @@
 # define twig_get	twigd64_get
 # define leaf_add	leafd64_add
 # define twig_add	twigd64_add
-#endif	/* BOOKSD32 || BOOKSD64 */
+# define make_ikey(k)	ikey_d64(k)
+# define key_ikey	keyd64_ikey
+# define node_slab	noded64_slab
+# define make_node	make_noded64
+# define free_node	free_noded64
+# define free_nodes	free_noded64s
+# define node_last	noded64_last
+# define leaf_prev	leafd64_prev
+# define val_sum	vald64_sum
+# define node_sum	noded64_sum
+# define sum_upd	sumd64_upd
+# define val_set	vald64_set
+#endif	/* BOOKSI64 || BOOKSD32 || BOOKSD64 */
 
 typedef union {
 	btree_val_t v;
@@ -96,11 +161,148 @@ struct btree_s {
 	uint32_t splitp:1;
 	uint32_t:29;
 	uint64_t used;
+	/* keys in their order-preserving integer encoding, ascending,
+	 * unused slots are all ones */
+	uint64_t ikey[63U + 1U/*spare*/];
 	btree_key_t key[63U + 1U/*spare*/];
 	btree_ual_t val[64U];
+	/* twigs only, sums over the live values below each child */
+	btree_sum_t sum[64U];
 	btree_t next;
+	/* root only, keys put and keys alive at the last compaction */
+	size_t nput;
+	size_t nlive;
+	/* the pool this node came from, the tree's */
+	struct node_pool_s *pool;
+};
+
+
+#if defined btree_c_once
+static const uint_least64_t pow10s[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
 };
 
+static inline __attribute__((const)) uint64_t
+ikey_d64(_Decimal64 x)
+{
+/* map X onto an unsigned integer so that integer order is decimal order
+ * and all members of a cohort (1.0 and 1.00, say) map to the same integer
+ * the idea is to normalise the coefficient to exactly 16 digits, then
+ * put the adjusted exponent (biased, 10 bits) in front of the coefficient
+ * (offset by 10^15, that's 53 bits) and flip everything for negatives,
+ * NaNs sort last, just before the all-ones value of unused slots */
+	uint_least64_t m;
+	int e;
+	int s;
+
+	if (UNLIKELY(isnand64(x))) {
+		return -2ULL;
+	}
+#if defined HAVE_DFP754_BID_LITERALS
+	with (uint64_t b = bits64(x)) {
+		s = (int64_t)b < 0;
+		if (UNLIKELY((b & 0x7800000000000000ULL) ==
+			     0x7800000000000000ULL)) {
+			/* infinities */
+			m = pow10s[15U], e = 1023 - 15 - 398;
+		} else if (UNLIKELY((b & 0x6000000000000000ULL) ==
+				    0x6000000000000000ULL)) {
+			m = (0b100ULL << 51U) ^ (b & 0x7ffffffffffffULL);
+			e = (int)((b >> 51U) & 0x3ffU) - 398;
+		} else {
+			m = b & 0x1fffffffffffffULL;
+			e = (int)((b >> 53U) & 0x3ffU) - 398;
+		}
+	}
+#else  /* !HAVE_DFP754_BID_LITERALS */
+	s = x < 0.dd;
+	x = s ? -x : x;
+	if (UNLIKELY(isinfd64(x))) {
+		m = pow10s[15U], e = 1023 - 15 - 398;
+	} else {
+		e = quantexpd64(x);
+		m = (uint_least64_t)scalbnd64(x, -e);
+	}
+#endif	/* HAVE_DFP754_BID_LITERALS */
+	if (UNLIKELY(!m || m >= pow10s[16U])) {
+		/* zeros, and non-canonicals which are zeros too */
+		return 1ULL << 63U;
+	}
+	/* normalise M to 16 digits */
+	with (unsigned int d = (64U - __builtin_clzll(m)) * 1233U >> 12U) {
+		/* D is the number of digits or one less */
+		d += m >= pow10s[d];
+		m *= pow10s[16U - d];
+		e -= 16 - d;
+	}
+	m -= pow10s[15U];
+	m += (uint64_t)(e + 398 + 15) << 53U;
+	m += (1ULL << 63U) + 1ULL;
+	return s ? ~m : m;
+}
+
+static inline __attribute__((const)) uint64_t
+ikey_i64(int64_t x)
+{
+/* same for integers which is as easy as flipping the sign bit,
+ * INT64_MIN is our NaN and sorts last, the extremes are squeezed
+ * to stay clear of the NaN and all-ones values and their complements */
+	uint64_t r = (uint64_t)x ^ (1ULL << 63U);
+
+	if (UNLIKELY(x == INT64_MIN)) {
+		return -2ULL;
+	}
+	return r < 2ULL ? 2ULL : r > -3ULL ? -3ULL : r;
+}
+
+static inline size_t
+ikey_rank(const uint64_t *ik, size_t n, uint64_t k)
+{
+/* return the number of keys in IK[0..N) that are strictly less than K,
+ * IK is sorted and padded with all-ones up to the next multiple of 4 */
+	size_t r = 0U;
+
+#if defined __AVX2__
+	const __m256i sgn = _mm256_set1_epi64x(INT64_MIN);
+	const __m256i kv = _mm256_xor_si256(_mm256_set1_epi64x(k), sgn);
+
+	for (size_t i = 0U; i < n; i += 4U) {
+		__m256i x = _mm256_loadu_si256((const void*)(ik + i));
+		__m256i c = _mm256_cmpgt_epi64(kv, _mm256_xor_si256(x, sgn));
+		r += __builtin_popcount(
+			_mm256_movemask_pd(_mm256_castsi256_pd(c)));
+	}
+#elif defined __SSE4_2__
+	const __m128i sgn = _mm_set1_epi64x(INT64_MIN);
+	const __m128i kv = _mm_xor_si128(_mm_set1_epi64x(k), sgn);
+
+	for (size_t i = 0U; i < n; i += 2U) {
+		__m128i x = _mm_loadu_si128((const void*)(ik + i));
+		__m128i c = _mm_cmpgt_epi64(kv, _mm_xor_si128(x, sgn));
+		r += __builtin_popcount(
+			_mm_movemask_pd(_mm_castsi128_pd(c)));
+	}
+#else  /* !__AVX2__ && !__SSE4_2__ */
+	/* plain compares, branch-free so the compiler can vectorise */
+	for (size_t i = 0U; i < n; i++) {
+		r += ik[i] < k;
+	}
+#endif	/* __AVX2__ || __SSE4_2__ */
+	return r;
+}
+#endif	/* btree_c_once */
+
+static inline __attribute__((pure)) uint64_t
+key_ikey(btree_t t, btree_key_t k)
+{
+	uint64_t r = make_ikey(k);
+	/* descending trees simply use the complement, but NaNs stay last */
+	return t->descp && r < -2ULL ? ~r : r;
+}
+
 
 static bool
 node_free_p(btree_t t)
@@ -118,33 +320,167 @@ node_free_p(btree_t t)
 	return nul > t->n;
 }
 
+static inline btree_sum_t
+val_sum(btree_key_t k, btree_val_t v)
+{
+	if (btree_val_nil_p(v) || !(v.q > 0)) {
+		/* doesn't count, nans neither */
+		return btree_sum_nil;
+	}
+	return (btree_sum_t){v.q, (btree_vx_t)k * v.q};
+}
+
+static btree_sum_t
+node_sum(btree_t t)
+{
+	btree_sum_t r = btree_sum_nil;
+
+	if (!t->innerp) {
+		for (size_t i = 0U; i < t->n; i++) {
+			const btree_sum_t x = val_sum(t->key[i], t->val[i].v);
+			r.q += x.q;
+			r.v += x.v;
+		}
+	} else {
+		for (size_t i = 0U; i <= t->n; i++) {
+			r.q += t->sum[i].q;
+			r.v += t->sum[i].v;
+		}
+	}
+	return r;
+}
+
+
+/* node pools, one per tree, nodes are carved out of cache-line aligned
+ * slabs and recycled through a freelist (threaded through the first
+ * word of the node), slabs double in size up to NSLAB_MAX nodes so
+ * small trees stay small, and they go when the tree goes
+ * a tree is only ever used by one thread at a time so there's no
+ * locking, and nodes never wander off to another thread's pool */
+#if defined btree_c_once
+# define NODE_ALIGN	64U
+# define NSLAB_MAX	64U
+
+struct node_pool_s {
+	void *free;
+	size_t nfree;
+	/* slabs, linked through their first NODE_ALIGN bytes */
+	void *slab;
+	size_t nslab;
+};
+#endif	/* btree_c_once */
+
+static int
+node_slab(struct node_pool_s *p, size_t n)
+{
+	const size_t z = (sizeof(struct btree_s) + NODE_ALIGN - 1U) & -NODE_ALIGN;
+	uint8_t *s;
+
+	if (UNLIKELY(posix_memalign((void**)&s, NODE_ALIGN,
+				    NODE_ALIGN + n * z))) {
+		return -1;
+	}
+	*(void**)s = p->slab;
+	p->slab = s;
+	p->nslab++;
+	/* thread them on the freelist back to front so the pool hands
+	 * them out in address order */
+	for (size_t i = n; i-- > 0U;) {
+		*(void**)(s + NODE_ALIGN + i * z) = p->free;
+		p->free = s + NODE_ALIGN + i * z;
+	}
+	p->nfree += n;
+	return 0;
+}
+
+static btree_t
+make_node(struct node_pool_s *p, bool descp)
+{
+	btree_t r;
+
+	if (UNLIKELY(p->free == NULL) &&
+	    node_slab(p, p->nslab < 6U ? 1U << p->nslab : NSLAB_MAX) < 0) {
+		return NULL;
+	}
+	r = p->free;
+	p->free = *(void**)r;
+	p->nfree--;
+	memset(r, 0, sizeof(*r));
+	r->pool = p;
+	r->descp = descp;
+	memset(r->ikey, -1, sizeof(r->ikey));
+	memset(r->key, -1, sizeof(r->key));
+	return r;
+}
+
+static void
+free_node(btree_t t)
+{
+	struct node_pool_s *p = t->pool;
+
+	*(void**)t = p->free;
+	p->free = t;
+	p->nfree++;
+	return;
+}
+
+static void
+free_nodes(btree_t t)
+{
+/* like free_btree() but leave the values alone */
+	if (t->innerp) {
+		for (size_t i = 0U; i <= t->n; i++) {
+			free_nodes(t->val[i].t);
+		}
+	}
+	free_node(t);
+	return;
+}
+
+
 static void
 root_split(btree_t root)
 {
 	/* root got split, bollocks */
-	const btree_t left = make_btree(root->descp);
-	const btree_t rght = make_btree(root->descp);
+	const btree_t left = make_node(root->pool, root->descp);
+	const btree_t rght = make_node(root->pool, root->descp);
 	const size_t piv = countof(root->key) / 2U - 1U;
 
 	/* T will become the new root so push stuff to LEFT ... */
+	memcpy(left->ikey, root->ikey, (piv + 1U) * sizeof(*root->ikey));
 	memcpy(left->key, root->key, (piv + 1U) * sizeof(*root->key));
 	memcpy(left->val, root->val, (piv + 1U) * sizeof(*root->val));
+	memcpy(left->sum, root->sum, (piv + 1U) * sizeof(*root->sum));
 	left->innerp = root->innerp;
 	left->n = piv + !root->innerp;
 	left->next = rght;
+	/* the pivot of inner nodes goes up, not left */
+	left->ikey[left->n] = -1ULL;
+	memset(left->key + left->n, -1, sizeof(*left->key));
 	/* ... and RGHT */
+	memcpy(rght->ikey, root->ikey + piv + 1U,
+	       (piv + 0U) * sizeof(*root->ikey));
 	memcpy(rght->key, root->key + piv + 1U, (piv + 0U) * sizeof(*root->key));
 	memcpy(rght->val, root->val + piv + 1U, (piv + 1U) * sizeof(*root->val));
+	memcpy(rght->sum, root->sum + piv + 1U, (piv + 1U) * sizeof(*root->sum));
 	rght->innerp = root->innerp;
 	rght->n = piv;
 	rght->next = NULL;
+	/* used bits go with the values */
+	left->used = root->used & ((2ULL << piv) - 1ULL);
+	rght->used = root->used >> (piv + 1U);
 	/* and now massage T */
+	root->ikey[0U] = root->ikey[piv];
+	memset(root->ikey + 1U, -1, sizeof(root->ikey) - sizeof(*root->ikey));
 	root->key[0U] = root->key[piv];
 	memset(root->key + 1U, -1, sizeof(root->key) - sizeof(*root->key));
 	root->val[0U].t = left;
 	root->val[1U].t = rght;
+	root->sum[0U] = node_sum(left);
+	root->sum[1U] = node_sum(rght);
 	root->n = 1U;
 	root->innerp = 1U;
+	root->used = 0U;
 	root->next = NULL;
 	return;
 }
@@ -158,78 +494,111 @@ node_split(btree_t prnt, size_t idx)
 	btree_t rght;
 	size_t nul;
 
-	/* do a scan to see if we have spare items */
-	for (nul = 0U; nul <= prnt->n && !node_free_p(prnt->val[nul].t); nul++);
+	/* do a scan to see if we have spare items, the first cell is
+	 * off limits because the next pointer pointing to it belongs
+	 * to a cousin of ours */
+	for (nul = 1U; nul <= prnt->n && !node_free_p(prnt->val[nul].t); nul++);
 
 	if (nul > prnt->n) {
 		/* no cell to prune, create one */
-		rght = make_btree(chld->descp);
+		rght = make_node(chld->pool, chld->descp);
 	} else {
 		/* hijack the value cell */
 		rght = prnt->val[nul].t;
 		/* adjust next pointers */
-		if (nul) {
-			prnt->val[nul - 1U].t->next = rght->next;
+		prnt->val[nul - 1U].t->next = rght->next;
+		if (rght->innerp) {
+			/* unlink its leaves as well */
+			btree_t l = prnt->val[nul - 1U].t, r = rght;
+
+			for (; l->innerp; l = l->val[l->n].t);
+			for (; r->innerp; r = r->val[r->n].t);
+			l->next = r->next;
+			/* and get rid of its (free) children */
+			for (size_t i = 0U; i <= rght->n; i++) {
+				free_nodes(rght->val[i].t);
+			}
 		}
 	}
 
 	if (nul > idx) {
 		/* spare item is far to the right */
+		memmove(prnt->ikey + idx + 1U,
+			prnt->ikey + idx + 0U,
+			(nul - idx) * sizeof(*prnt->ikey));
 		memmove(prnt->key + idx + 1U,
 			prnt->key + idx + 0U,
 			(nul - idx) * sizeof(*prnt->key));
 		memmove(prnt->val + idx + 1U,
 			prnt->val + idx + 0U,
 			(nul - idx) * sizeof(*prnt->val));
+		memmove(prnt->sum + idx + 1U,
+			prnt->sum + idx + 0U,
+			(nul - idx) * sizeof(*prnt->sum));
 	} else if (nul < idx) {
 		/* spare item to the left, good job */
+		memmove(prnt->ikey + nul + 0U,
+			prnt->ikey + nul + 1U,
+			(idx - nul) * sizeof(*prnt->ikey));
 		memmove(prnt->key + nul + 0U,
 			prnt->key + nul + 1U,
 			(idx - nul) * sizeof(*prnt->key));
 		memmove(prnt->val + nul + 0U,
 			prnt->val + nul + 1U,
 			(idx - nul) * sizeof(*prnt->val));
+		memmove(prnt->sum + nul + 0U,
+			prnt->sum + nul + 1U,
+			(idx - nul) * sizeof(*prnt->sum));
 		/* whole to the left, adjust index */
 		idx--;
 	}
 
 	/* massage PaReNT */
 	prnt->n += nul > prnt->n;
+	prnt->ikey[idx + 0U] = chld->ikey[piv];
 	prnt->key[idx + 0U] = chld->key[piv];
 	prnt->val[idx + 1U].t = rght;
+	/* hijacking the last cell shifts a key beyond N, undo that */
+	prnt->ikey[prnt->n] = -1ULL;
+	memset(prnt->key + prnt->n, -1, sizeof(*prnt->key));
 
 	/* then shift things to RGHT */
+	memcpy(rght->ikey, chld->ikey + piv + 1U,
+	       (piv + 0U) * sizeof(*chld->ikey));
 	memcpy(rght->key, chld->key + piv + 1U, (piv + 0U) * sizeof(*chld->key));
 	memcpy(rght->val, chld->val + piv + 1U, (piv + 1U) * sizeof(*chld->val));
+	memcpy(rght->sum, chld->sum + piv + 1U, (piv + 1U) * sizeof(*chld->sum));
+	memset(rght->ikey + piv, -1,
+	       (countof(rght->ikey) - piv) * sizeof(*rght->ikey));
 	memset(rght->key + piv, -1,
 	       (countof(rght->key) - piv) * sizeof(*rght->key));
 	rght->innerp = chld->innerp;
 	rght->next = chld->next;
 	rght->n = piv;
+	rght->used = chld->used >> (piv + 1U);
 	/* and CHLD (the left one) */
 	chld->n = piv + !chld->innerp;
 	chld->next = rght;
+	chld->used &= (2ULL << piv) - 1ULL;
+	memset(chld->ikey + chld->n, -1,
+	       (countof(chld->ikey) - chld->n) * sizeof(*chld->ikey));
 	memset(chld->key + chld->n, -1,
 	       (countof(chld->key) - chld->n) * sizeof(*chld->key));
+	/* and finally the sums of the two halves */
+	prnt->sum[idx + 0U] = node_sum(chld);
+	prnt->sum[idx + 1U] = node_sum(rght);
 	return;
 }
 
 
 static btree_val_t*
-leaf_get(btree_t t, btree_key_t k)
+leaf_get(btree_t t, uint64_t ik)
 {
 	size_t i;
 
-	switch (t->descp) {
-	case 0U:
-		for (i = 0U; i < t->n && k > t->key[i]; i++);
-		break;
-	case 1U:
-		for (i = 0U; i < t->n && k < t->key[i]; i++);
-		break;
-	}
+	i = ikey_rank(t->ikey, t->n, ik);
 
-	if (k != t->key[i]) {
+	if (ik != t->ikey[i]) {
 		/* key isn't home today */
 		return NULL;
 	}
@@ -237,52 +606,39 @@ leaf_get(btree_t t, btree_key_t k)
 }
 
 static btree_val_t*
-twig_get(btree_t t, btree_key_t k)
+twig_get(btree_t t, uint64_t ik)
 {
 	btree_val_t *vp;
 	btree_t c;
 	size_t i;
 
-	switch (t->descp) {
-	case 0U:
-		for (i = 0U; i < t->n && k > t->key[i]; i++);
-		break;
-	case 1U:
-		for (i = 0U; i < t->n && k < t->key[i]; i++);
-		break;
-	}
+	i = ikey_rank(t->ikey, t->n, ik);
 
 	/* descent */
 	c = t->val[i].t;
 
 	if (!c->innerp) {
 		/* oh, we're in the leaves again */
-		vp = leaf_get(c, k);
+		vp = leaf_get(c, ik);
 	} else {
 		/* got to go deeper, isn't it? */
-		vp = twig_get(c, k);
+		vp = twig_get(c, ik);
 	}
 	return vp;
 }
 
 
 static btree_val_t*
-leaf_add(btree_t t, btree_key_t k, bool *splitp)
+leaf_add(btree_t t, btree_key_t k, uint64_t ik, bool *splitp)
 {
 	size_t nul;
 	size_t i;
 
-	switch (t->descp) {
-	case 0U:
-		for (i = 0U; i < t->n && k > t->key[i]; i++);
-		break;
-	case 1U:
-		for (i = 0U; i < t->n && k < t->key[i]; i++);
-		break;
-	}
+	i = ikey_rank(t->ikey, t->n, ik);
 
-	if (k == t->key[i]) {
-		/* got him */
+	if (ik == t->ikey[i]) {
+		/* got him, if he's dead he's reborn in K's cohort */
+		t->key[i] = btree_val_nil_p(t->val[i].v) ? k : t->key[i];
 		goto out;
 	}
 	/* otherwise do a scan to see if we have spare items */
@@ -290,12 +646,14 @@ leaf_add(btree_t t, btree_key_t k, bool *splitp)
 
 	if (nul > i) {
 		/* spare item is far to the right */
-		uint64_t msk =
-			((t->used >> i) & ((1ULL << (nul - i)) - 1U)) << i;
-		t->used ^= msk;
-		msk <<= 1ULL;
-		t->used ^= msk;
+		const uint64_t msk = ((1ULL << (nul - i)) - 1U) << i;
+		/* move the used bits of [I, NUL) one up, NUL itself is nil */
+		t->used = (t->used & ~msk & ~(1ULL << nul)) |
+			(t->used & msk) << 1U;
 
+		memmove(t->ikey + i + 1U,
+			t->ikey + i + 0U,
+			(nul - i) * sizeof(*t->ikey));
 		memmove(t->key + i + 1U,
 			t->key + i + 0U,
 			(nul - i) * sizeof(*t->key));
@@ -304,14 +662,16 @@ leaf_add(btree_t t, btree_key_t k, bool *splitp)
 			(nul - i) * sizeof(*t->val));
 	} else if (nul < i) {
 		/* spare item to the left, good job */
-		uint64_t msk =
-			((t->used >> nul) & ((1ULL << (i - nul)) - 1U)) << nul;
-		t->used ^= msk;
-		msk >>= 1ULL;
-		t->used ^= msk;
+		const uint64_t msk = ((1ULL << (i - nul - 1U)) - 1U) << (nul + 1U);
+		/* move the used bits of (NUL, I) one down, NUL itself is nil */
+		t->used = (t->used & ~msk & ~(1ULL << nul)) |
+			(t->used & msk) >> 1U;
 
 		/* go down with the index as the hole will be to our left */
 		i--;
+		memmove(t->ikey + nul + 0U,
+			t->ikey + nul + 1U,
+			(i - nul) * sizeof(*t->ikey));
 		memmove(t->key + nul + 0U,
 			t->key + nul + 1U,
 			(i - nul) * sizeof(*t->key));
@@ -321,6 +681,7 @@ leaf_add(btree_t t, btree_key_t k, bool *splitp)
 	}
 
 	t->n += !(nul < t->n);
+	t->ikey[i] = ik;
 	t->key[i] = k;
 	t->val[i].v = btree_val_nil;
 
@@ -332,81 +693,99 @@ out:
 }
 
 static btree_val_t*
-twig_add(btree_t t, btree_key_t k, bool *splitp)
+twig_add(btree_t t, btree_key_t k, uint64_t ik, bool *splitp)
 {
 	btree_val_t *r;
 	btree_t c;
 	size_t i;
 
-	switch (t->descp) {
-	case 0U:
-		for (i = 0U; i < t->n && k > t->key[i]; i++);
-		break;
-	case 1U:
-		for (i = 0U; i < t->n && k < t->key[i]; i++);
-		break;
-	}
+	i = ikey_rank(t->ikey, t->n, ik);
 
 	/* descent */
 	c = t->val[i].t;
 
 	if (!c->innerp) {
 		/* oh, we're in the leaves again */
-		r = leaf_add(c, k, splitp);
+		r = leaf_add(c, k, ik, splitp);
 	} else {
 		/* got to go deeper, isn't it? */
-		r = twig_add(c, k, splitp);
+		r = twig_add(c, k, ik, splitp);
 	}
 
 	if (UNLIKELY(*splitp)) {
 		/* C needs splitting, not again */
 		node_split(t, i);
+		if (!c->innerp && (btree_ual_t*)r >= c->val + c->n) {
+			/* our value moved house to the right sibling */
+			r = &c->next->val[(btree_ual_t*)r - (c->val + c->n)].v;
+		}
 	}
 	*splitp = t->n >= countof(t->key) - 1U;
 	return r;
 }
 
 
+int
+btree_prealloc(btree_t t, size_t n)
+{
+	struct node_pool_s *p = t->pool;
+
+	if (p->nfree >= n) {
+		/* plenty */
+		return 0;
+	}
+	n -= p->nfree;
+	return node_slab(p, n > NSLAB_MAX ? n : NSLAB_MAX);
+}
+
 btree_t
 make_btree(bool descp)
 {
-	btree_t r = calloc(1U, sizeof(*r));
+	struct node_pool_s *p = calloc(1U, sizeof(*p));
+	btree_t r;
 
-	r->descp = descp;
-	memset(r->key, -1, sizeof(r->key));
+	if (UNLIKELY(p == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((r = make_node(p, descp)) == NULL)) {
+		free(p);
+		return NULL;
+	}
 	return r;
 }
 
 void
 free_btree(btree_t t)
 {
-	if (t->innerp) {
-		/* descend and free */
-		for (size_t i = 0U; i <= t->n; i++) {
-			/* descend */
-			free_btree(t->val[i].t);
-		}
-	} else {
-		/* free values */
+	struct node_pool_s *p = t->pool;
+
+	/* free values, the leaves have them all */
+	for (; t->innerp; t = t->val->t);
+	do {
 		for (size_t i = 0U; i < t->n; i++) {
 			if (!btree_val_nil_p(t->val[i].v)) {
 				free_btree_val(t->val[i].v);
 			}
 		}
+	} while ((t = t->next));
+	/* and the nodes go with their slabs */
+	for (void *s = p->slab, *nxt; s != NULL; s = nxt) {
+		nxt = *(void**)s;
+		free(s);
 	}
-	free(t);
+	free(p);
 	return;
 }
 
 btree_val_t*
 btree_get(btree_t t, btree_key_t k)
 {
+	const uint64_t ik = key_ikey(t, k);
 	btree_val_t *vp;
 
 	if (!t->innerp) {
-		vp = leaf_get(t, k);
+		vp = leaf_get(t, ik);
 	} else {
-		vp = twig_get(t, k);
+		vp = twig_get(t, ik);
 	}
 	return vp;
 }
@@ -414,6 +793,7 @@ btree_get(btree_t t, btree_key_t k)
 btree_val_t*
 btree_put(btree_t t, btree_key_t k)
 {
+	const uint64_t ik = key_ikey(t, k);
 	btree_val_t *vp;
 	bool splitp;
 
@@ -424,34 +804,91 @@ btree_put(btree_t t, btree_key_t k)
 
 	/* check if root has leaves */
 	if (!t->innerp) {
-		vp = leaf_add(t, k, &splitp);
+		vp = leaf_add(t, k, ik, &splitp);
 	} else {
-		vp = twig_add(t, k, &splitp);
+		vp = twig_add(t, k, ik, &splitp);
 	}
 
 	t->splitp = splitp;
+	/* new (or resurrected) keys count towards the next compaction */
+	t->nput += btree_val_nil_p(*vp);
 	return vp;
 }
 
+static void
+sum_upd(btree_t t, uint64_t ik, btree_sum_t d)
+{
+/* add D to the sums on the way down to IK */
+	while (t->innerp) {
+		const size_t i = ikey_rank(t->ikey, t->n, ik);
+
+		t->sum[i].q += d.q;
+		t->sum[i].v += d.v;
+		t = t->val[i].t;
+	}
+	return;
+}
+
+static btree_val_t
+val_set(btree_t t, uint64_t ik, btree_key_t k, btree_val_t *vp, btree_val_t v)
+{
+/* set *VP, the value for K in T, to V and keep track of the sums
+ * dead values are gone for good no matter if they're still around */
+	const btree_val_t o = !btree_val_nil_p(*vp) ? *vp : btree_val_nil;
+	const btree_sum_t so = val_sum(k, o);
+	const btree_sum_t sn = val_sum(k, v);
+
+	*vp = v;
+	if (t->innerp && (so.q != sn.q || so.v != sn.v)) {
+		sum_upd(t, ik, (btree_sum_t){sn.q - so.q, sn.v - so.v});
+	}
+	return o;
+}
+
 btree_val_t
-btree_rem(btree_t t, btree_key_t k)
+btree_set(btree_t t, btree_key_t k, btree_val_t v)
 {
-	btree_val_t *vp, w;
+	btree_val_t *vp = btree_put(t, k);
 
-	if ((vp = btree_get(t, k)) != NULL) {
-		w = *vp;
-		*vp = btree_val_nil;
-	} else {
-		w = btree_val_nil;
+	return val_set(t, key_ikey(t, k), k, vp, v);
+}
+
+btree_val_t
+btree_add(btree_t t, btree_key_t k, btree_val_t v)
+{
+	btree_val_t *vp = btree_put(t, k);
+	const btree_val_t o = !btree_val_nil_p(*vp) ? *vp : btree_val_nil;
+
+	return val_set(t, key_ikey(t, k), k, vp, btree_val_add(o, v));
+}
+
+btree_val_t
+btree_upd(btree_t t, btree_key_t k, btree_val_t v)
+{
+	btree_val_t *vp;
+
+	if ((vp = btree_get(t, k)) == NULL) {
+		return btree_val_nil;
 	}
-	return w;
+	return val_set(t, key_ikey(t, k), k, vp, v);
+}
+
+btree_val_t
+btree_rem(btree_t t, btree_key_t k)
+{
+	return btree_upd(t, k, btree_val_nil);
 }
 
 void
 btree_clr(btree_t t)
 {
 /* bit like an optimised iterator */
-	for (; t->innerp; t = t->val->t);
+	for (; t->innerp; t = t->val->t) {
+		/* no sums anymore */
+		for (btree_t c = t; c; c = c->next) {
+			memset(c->sum, 0, (c->n + 1U) * sizeof(*c->sum));
+		}
+	}
 	do {
 		for (size_t i = 0U; i < t->n; i++) {
 			t->val[i].v = btree_val_nil;
@@ -460,6 +897,156 @@ btree_clr(btree_t t)
 	return;
 }
 
+btree_val_t*
+btree_find(btree_t t, btree_sum_t lim, btree_key_t *k, btree_sum_t *s)
+{
+	btree_sum_t r = *s;
+
+	/* skip whole subtrees while we can */
+	while (t->innerp) {
+		size_t i;
+
+		for (i = 0U; i < t->n; i++) {
+			const btree_sum_t x = t->sum[i];
+
+			if (r.q + x.q >= lim.q || r.v + x.v >= lim.v) {
+				break;
+			}
+			r.q += x.q;
+			r.v += x.v;
+		}
+		t = t->val[i].t;
+	}
+	/* then walk the leaves, normally it's just the one */
+	do {
+		for (size_t i = 0U; i < t->n; i++) {
+			const btree_sum_t x = val_sum(t->key[i], t->val[i].v);
+
+			if (!(x.q > 0)) {
+				continue;
+			} else if (r.q + x.q >= lim.q || r.v + x.v >= lim.v) {
+				/* got him */
+				*k = t->key[i];
+				*s = r;
+				return &t->val[i].v;
+			}
+			r.q += x.q;
+			r.v += x.v;
+		}
+	} while ((t = t->next));
+	return NULL;
+}
+
+static btree_t
+node_last(btree_t t)
+{
+/* return the right-most leaf below T */
+	for (; t->innerp; t = t->val[t->n].t);
+	return t;
+}
+
+size_t
+btree_compact(btree_t t)
+{
+/* rebuild T bottom-up from its live values, nodes are filled evenly and
+ * to 3/4 so the next few puts don't split them right away
+ * the root cell stays where it is as callers hang on to it */
+	const size_t fill = 48U;
+	btree_t l, lvl = NULL, *tail = &lvl;
+	size_t n = 0U, m;
+
+	/* count survivors */
+	for (l = t; l->innerp; l = l->val->t);
+	for (btree_t x = l; x; x = x->next) {
+		for (size_t i = 0U; i < x->n; i++) {
+			n += !btree_val_nil_p(x->val[i].v);
+		}
+	}
+
+	/* leaves first, spread N values evenly over M leaves */
+	m = (n + fill - 1U) / fill;
+	for (size_t k = 0U, i = 0U; k < m; k++) {
+		const size_t z = n / m + (k < n % m);
+		btree_t c = make_node(t->pool, t->descp);
+
+		for (size_t j = 0U; j < z; i++) {
+			for (; i >= l->n; l = l->next, i = 0U);
+			if (btree_val_nil_p(l->val[i].v)) {
+				continue;
+			}
+			c->ikey[j] = l->ikey[i];
+			c->key[j] = l->key[i];
+			c->val[j] = l->val[i];
+			j++;
+		}
+		c->n = z;
+		c->used = (2ULL << (z - 1U)) - 1ULL;
+		*tail = c;
+		tail = &c->next;
+	}
+	/* twigs on top until there's only one node left */
+	for (size_t nlvl = m; nlvl > 1U; nlvl = m) {
+		btree_t c = lvl;
+
+		lvl = NULL;
+		tail = &lvl;
+		m = (nlvl + fill - 1U) / fill;
+		for (size_t k = 0U; k < m; k++) {
+			const size_t z = nlvl / m + (k < nlvl % m);
+			btree_t p = make_node(t->pool, t->descp);
+
+			for (size_t j = 0U; j < z; j++, c = c->next) {
+				p->val[j].t = c;
+				p->sum[j] = node_sum(c);
+				if (j + 1U < z) {
+					/* pivot is the largest key below C */
+					const btree_t x = node_last(c);
+
+					p->ikey[j] = x->ikey[x->n - 1U];
+					p->key[j] = x->key[x->n - 1U];
+				}
+			}
+			p->n = z - 1U;
+			p->innerp = 1U;
+			*tail = p;
+			tail = &p->next;
+		}
+	}
+
+	/* out with the old */
+	if (t->innerp) {
+		for (size_t i = 0U; i <= t->n; i++) {
+			free_nodes(t->val[i].t);
+		}
+	}
+	/* in with the new */
+	if (LIKELY(lvl != NULL)) {
+		*t = *lvl;
+		free_node(lvl);
+	} else {
+		const bool descp = t->descp;
+		struct node_pool_s *pool = t->pool;
+
+		memset(t, 0, sizeof(*t));
+		t->descp = descp;
+		t->pool = pool;
+		memset(t->ikey, -1, sizeof(t->ikey));
+		memset(t->key, -1, sizeof(t->key));
+	}
+	t->nput = 0U;
+	t->nlive = n;
+	return n;
+}
+
+bool
+btree_sparse_p(btree_t t)
+{
+/* we don't know how many of the keys put since the last compaction
+ * are still alive, but if there's more of them than there were live
+ * keys back then, a compaction costs no more than the puts did */
+	return t->nput >= t->nlive + 256U;
+}
+
 btree_val_t*
 btree_top(btree_t t, btree_key_t *k)
 {
@@ -477,6 +1064,30 @@ btree_top(btree_t t, btree_key_t *k)
 	return NULL;
 }
 
+btree_iter_t
+btree_seek(btree_t t, btree_key_t k)
+{
+	const uint64_t ik = key_ikey(t, k);
+	btree_iter_t r = {.r = t};
+
+	for (; t->innerp; t = t->val[ikey_rank(t->ikey, t->n, ik)].t);
+	r.t = t;
+	r.i = ikey_rank(t->ikey, t->n, ik);
+	return r;
+}
+
+btree_iter_t
+btree_last(btree_t t)
+{
+	btree_iter_t r = {.r = t};
+
+	/* twigs have one more child than keys */
+	for (; t->innerp; t = t->val[t->n].t);
+	r.t = t;
+	r.i = t->n;
+	return r;
+}
+
 bool
 btree_iter_next(btree_iter_t *iter)
 {
@@ -485,12 +1096,15 @@ btree_iter_next(btree_iter_t *iter)
 	}
 	for (; iter->t->innerp; iter->t = iter->t->val->t, iter->i = 0U);
 	do {
-		uint64_t u = iter->t->used >> iter->i;
-		unsigned int sh = __builtin_ctzll(u);
+		uint64_t u = iter->i < 64U ? iter->t->used >> iter->i : 0U;
 
-		for (size_t i = iter->i + sh, n = iter->t->n;
-		     i < n; sh = __builtin_ctzll(u >>= sh + 1U), i += sh + 1U) {
-			if (LIKELY(!btree_val_nil_p(iter->t->val[i].v))) {
+		for (size_t i = iter->i, n = iter->t->n; u; u >>= 1U, i++) {
+			const unsigned int sh = __builtin_ctzll(u);
+
+			u >>= sh, i += sh;
+			if (UNLIKELY(i >= n)) {
+				break;
+			} else if (LIKELY(!btree_val_nil_p(iter->t->val[i].v))) {
 				/* good one */
 				iter->k = iter->t->key[i];
 				iter->v = &iter->t->val[i].v;
@@ -498,8 +1112,7 @@ btree_iter_next(btree_iter_t *iter)
 				return true;
 			}
 			/* mark unused */
-			iter->t->used |= (1ULL << i);
-			iter->t->used ^= (1ULL << i);
+			iter->t->used &= ~(1ULL << i);
 		}
 		/* reset index */
 		iter->i = 0U;
@@ -510,11 +1123,76 @@ inv:
 	return false;
 }
 
+static btree_t
+leaf_prev(btree_t r, btree_t t)
+{
+/* find the leaf before T, leaves are only chained forwards so go down
+ * from the root R and remember where we last could have gone left */
+	btree_t b = NULL;
+	size_t bi = 0U;
+
+	if (UNLIKELY(!t->n)) {
+		return NULL;
+	}
+	for (btree_t c = r; c->innerp;) {
+		const size_t i = ikey_rank(c->ikey, c->n, t->ikey[0U]);
+
+		if (i) {
+			b = c, bi = i - 1U;
+		}
+		c = c->val[i].t;
+	}
+	if (b == NULL) {
+		/* T is the first leaf */
+		return NULL;
+	}
+	for (b = b->val[bi].t; b->innerp; b = b->val[b->n].t);
+	return b;
+}
+
+bool
+btree_iter_prev(btree_iter_t *iter)
+{
+	if (UNLIKELY(iter->t == NULL)) {
+		goto inv;
+	}
+	do {
+		const size_t n = iter->i < iter->t->n ? iter->i : iter->t->n;
+		uint64_t u = iter->t->used & (n < 64U ? (1ULL << n) - 1U : -1ULL);
+
+		while (u) {
+			const size_t i = 63U - __builtin_clzll(u);
+
+			if (LIKELY(!btree_val_nil_p(iter->t->val[i].v))) {
+				/* good one */
+				iter->k = iter->t->key[i];
+				iter->v = &iter->t->val[i].v;
+				iter->i = i;
+				return true;
+			}
+			/* mark unused */
+			iter->t->used &= ~(1ULL << i);
+			u &= ~(1ULL << i);
+		}
+		/* reset index */
+		iter->i = -1ULL;
+	} while ((iter->t = leaf_prev(iter->r, iter->t)));
+inv:
+	/* invalidate */
+	iter->v = NULL;
+	return false;
+}
+
+#undef btree_c_once
 #if defined BTREE_MULTI
 # if defined BOOKSD64 && !defined BOOKSD32
 #  define BOOKSD32
 #  undef INCLUDED_btree_h_
 #  include __FILE__
+# elif defined BOOKSD32 && !defined BOOKSI64
+#  define BOOKSI64
+#  undef INCLUDED_btree_h_
+#  include __FILE__
 # endif
 #endif
 
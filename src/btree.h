@@ -40,10 +40,10 @@
 /* defines btree_val_t, hopefully */
 #include "btree_val.h"
 
-#if !defined BOOKSD32 && !defined BOOKSD64
+#if !defined BOOKSD32 && !defined BOOKSD64 && !defined BOOKSI64
 /* a sane default */
 # define BOOKSD64
-#endif	/* !BOOKSD32 && !BOOKSD64 */
+#endif	/* !BOOKSD32 && !BOOKSD64 && !BOOKSI64 */
 
 #undef btree_key_t
 #undef btree_s
@@ -51,16 +51,49 @@
 #undef btree_iter_t
 #undef make_btree
 #undef free_btree
+#undef btree_prealloc
 #undef btree_get
 #undef btree_put
+#undef btree_set
+#undef btree_add
+#undef btree_upd
+#undef btree_find
 #undef btree_rem
 #undef btree_clr
+#undef btree_compact
+#undef btree_sparse_p
 #undef btree_top
+#undef btree_seek
+#undef btree_last
 #undef btree_iter_next
+#undef btree_iter_prev
 
 /* keys are prices */
 #if 0
 
+#elif defined BOOKSI64
+# define btree_key_t	int64_t
+# define btree_s	btreei64_s
+# define btree_t	btreei64_t
+# define btree_iter_t	btreei64_iter_t
+# define make_btree	make_btreei64
+# define free_btree	free_btreei64
+# define btree_prealloc	btreei64_prealloc
+# define btree_get	btreei64_get
+# define btree_put	btreei64_put
+# define btree_set	btreei64_set
+# define btree_add	btreei64_add
+# define btree_upd	btreei64_upd
+# define btree_find	btreei64_find
+# define btree_rem	btreei64_rem
+# define btree_clr	btreei64_clr
+# define btree_compact	btreei64_compact
+# define btree_sparse_p	btreei64_sparse_p
+# define btree_top	btreei64_top
+# define btree_seek	btreei64_seek
+# define btree_last	btreei64_last
+# define btree_iter_next	btreei64_iter_next
+# define btree_iter_prev	btreei64_iter_prev
 #elif defined BOOKSD32
 # define btree_key_t	_Decimal32
 # define btree_s	btreed32_s
@@ -68,12 +101,22 @@
 # define btree_iter_t	btreed32_iter_t
 # define make_btree	make_btreed32
 # define free_btree	free_btreed32
+# define btree_prealloc	btreed32_prealloc
 # define btree_get	btreed32_get
 # define btree_put	btreed32_put
+# define btree_set	btreed32_set
+# define btree_add	btreed32_add
+# define btree_upd	btreed32_upd
+# define btree_find	btreed32_find
 # define btree_rem	btreed32_rem
 # define btree_clr	btreed32_clr
+# define btree_compact	btreed32_compact
+# define btree_sparse_p	btreed32_sparse_p
 # define btree_top	btreed32_top
+# define btree_seek	btreed32_seek
+# define btree_last	btreed32_last
 # define btree_iter_next	btreed32_iter_next
+# define btree_iter_prev	btreed32_iter_prev
 #elif defined BOOKSD64
 # define btree_key_t	_Decimal64
 # define btree_s	btreed64_s
@@ -81,13 +124,23 @@
 # define btree_iter_t	btreed64_iter_t
 # define make_btree	make_btreed64
 # define free_btree	free_btreed64
+# define btree_prealloc	btreed64_prealloc
 # define btree_get	btreed64_get
 # define btree_put	btreed64_put
+# define btree_set	btreed64_set
+# define btree_add	btreed64_add
+# define btree_upd	btreed64_upd
+# define btree_find	btreed64_find
 # define btree_rem	btreed64_rem
 # define btree_clr	btreed64_clr
+# define btree_compact	btreed64_compact
+# define btree_sparse_p	btreed64_sparse_p
 # define btree_top	btreed64_top
+# define btree_seek	btreed64_seek
+# define btree_last	btreed64_last
 # define btree_iter_next	btreed64_iter_next
-#endif	/* BOOKSD32 || BOOKSD64 */
+# define btree_iter_prev	btreed64_iter_prev
+#endif	/* BOOKSI64 || BOOKSD32 || BOOKSD64 */
 
 typedef struct btree_s *btree_t;
 
@@ -96,19 +149,78 @@ typedef struct {
 	size_t i;
 	btree_key_t k;
 	btree_val_t *v;
+	/* root, for going backwards */
+	btree_t r;
 } btree_iter_t;
 
 
 extern btree_t make_btree(bool descp);
 extern void free_btree(btree_t);
 
+/**
+ * Make sure T's node pool holds at least N spare nodes.
+ * Return 0 on success, -1 if the pool couldn't be grown. */
+extern int btree_prealloc(btree_t t, size_t n);
+
 extern btree_val_t *btree_get(btree_t, btree_key_t);
+/**
+ * Return a pointer to K's value in T, creating K if need be.
+ * Values written through this pointer go unnoticed by the sums,
+ * use btree_set() or btree_add() for that. */
 extern btree_val_t *btree_put(btree_t, btree_key_t);
+
+/**
+ * Set K's value in T to V, return the old value. */
+extern btree_val_t btree_set(btree_t, btree_key_t, btree_val_t);
+
+/**
+ * Add V to K's value in T, see btree_val_add(), return the old value. */
+extern btree_val_t btree_add(btree_t, btree_key_t, btree_val_t);
+
+/**
+ * Like btree_set() but never create K, for use during iteration. */
+extern btree_val_t btree_upd(btree_t, btree_key_t, btree_val_t);
+
 extern btree_val_t btree_rem(btree_t, btree_key_t);
 extern void btree_clr(btree_t);
+
+/**
+ * Physically remove nil values from T and rebalance it.
+ * Return the number of keys left. */
+extern size_t btree_compact(btree_t);
+
+/**
+ * Return true if T has probably accumulated enough nil values
+ * to make a btree_compact() worthwhile. */
+extern bool btree_sparse_p(btree_t);
+
 extern btree_val_t *btree_top(btree_t, btree_key_t*);
 
+/**
+ * Find the first value in T at which the running sums of quantities
+ * or of price times quantity reach LIM.q or LIM.v respectively.
+ * Running sums start out at S, on success K is set to the value's key
+ * and S to the running sums before it.
+ * Sums are exact, so S doesn't depend on the order values came in. */
+extern btree_val_t*
+btree_find(btree_t, btree_sum_t lim, btree_key_t *k, btree_sum_t *s);
+
+/**
+ * Return an iterator over T whose btree_iter_next() starts at the first
+ * key not before K, and whose btree_iter_prev() starts at the last key
+ * before K. */
+extern btree_iter_t btree_seek(btree_t, btree_key_t k);
+
+/**
+ * Return an iterator over T for btree_iter_prev() to start at the last key. */
+extern btree_iter_t btree_last(btree_t);
+
 extern bool btree_iter_next(btree_iter_t*);
 
+/**
+ * Like btree_iter_next() but backwards, ITER must come from
+ * btree_seek() or btree_last(). */
+extern bool btree_iter_prev(btree_iter_t*);
+
 #define INCLUDED_btree_h_
 #endif	/* INCLUDED_btree_h_ */
@@ -1,27 +1,115 @@
 /*** btree_val.h -- values and keys of btrees ***/
 #if !defined INCLUDED_btree_val_h_
 #define INCLUDED_btree_val_h_
+#include <stdint.h>
 #include <stdbool.h>
 
 /* values are plqu's and a plqu_val_t for the sum */
 typedef struct {
 	_Decimal64 q;
 	long long unsigned int t;
-} btree_val_t;
+} btreed_val_t;
 
-#define btree_val_nil	((btree_val_t){0.dd})
+/* sums of quantities and of price times quantity, twice as wide as
+ * the values so they stay exact, a _Decimal64 sum would round and
+ * come out differently depending on the order things were added in */
+typedef struct {
+	_Decimal128 q;
+	_Decimal128 v;
+} btreed_sum_t;
 
 static inline bool
-btree_val_nil_p(btree_val_t v)
+btreed_val_nil_p(btreed_val_t v)
 {
 	return v.q <= 0.dd;
 }
 
+static inline btreed_val_t
+btreed_val_add(btreed_val_t o, btreed_val_t v)
+{
+/* quantities add up but never go negative, time stamps get replaced */
+	v.q += o.q;
+	v.q = v.q >= 0.dd ? v.q : 0.dd;
+	return v;
+}
+
 static inline void
-free_btree_val(btree_val_t v)
+free_btreed_val(btreed_val_t v)
 {
 	(void)v;
 	return;
 }
 
+/* the fixed-point flavour counts lots, and since ticks times lots
+ * soon exceed 64 bits the value sums are twice as wide */
+typedef struct {
+	int64_t q;
+	long long unsigned int t;
+	/* the key is a multiple of 10^pe ticks and Q one of 10^qe lots,
+	 * that's how far they came in, like the decimal flavours' quanta */
+	unsigned char pe;
+	unsigned char qe;
+} btreei_val_t;
+
+typedef struct {
+	int64_t q;
+	__int128 v;
+} btreei_sum_t;
+
+static inline bool
+btreei_val_nil_p(btreei_val_t v)
+{
+	return v.q <= 0;
+}
+
+static inline btreei_val_t
+btreei_val_add(btreei_val_t o, btreei_val_t v)
+{
+/* the sum is as fine as the finer of the two, and a live level
+ * keeps its key as it was, empty levels don't count */
+	if (o.q > 0) {
+		v.pe = o.pe;
+		v.qe = o.qe < v.qe ? o.qe : v.qe;
+	}
+	v.q += o.q;
+	v.q = v.q >= 0 ? v.q : 0;
+	return v;
+}
+
+static inline void
+free_btreei_val(btreei_val_t v)
+{
+	(void)v;
+	return;
+}
 #endif	/* INCLUDED_btree_val_h_ */
+
+/* the rest depends on the flavour */
+#undef btree_val_t
+#undef btree_sum_t
+#undef btree_vx_t
+#undef btree_val_nil
+#undef btree_sum_nil
+#undef btree_val_nil_p
+#undef btree_val_add
+#undef free_btree_val
+
+#if defined BOOKSI64
+# define btree_val_t	btreei_val_t
+# define btree_sum_t	btreei_sum_t
+# define btree_vx_t	__int128
+# define btree_val_nil	((btree_val_t){.q = 0})
+# define btree_sum_nil	((btree_sum_t){0, 0})
+# define btree_val_nil_p	btreei_val_nil_p
+# define btree_val_add	btreei_val_add
+# define free_btree_val	free_btreei_val
+#else  /* !BOOKSI64 */
+# define btree_val_t	btreed_val_t
+# define btree_sum_t	btreed_sum_t
+# define btree_vx_t	_Decimal128
+# define btree_val_nil	((btree_val_t){.q = 0.dd})
+# define btree_sum_nil	((btree_sum_t){0.dl, 0.dl})
+# define btree_val_nil_p	btreed_val_nil_p
+# define btree_val_add	btreed_val_add
+# define free_btree_val	free_btreed_val
+#endif	/* BOOKSI64 */
@@ -0,0 +1,311 @@
+/*** ckpt.c -- checkpoints of books
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ckpt.h"
+#include "bq.h"
+#include "nifty.h"
+
+/* books on disk, followed by the name, padded to 8 bytes, and levels */
+typedef struct {
+	uint32_t inz;
+	xscl_t scl;
+	uint16_t pad;
+	uint32_t nbid;
+	uint32_t nask;
+} ckbk_t;
+
+#define PAD8(x)		(((x) + 7U) & ~(size_t)7U)
+
+struct ckout_s {
+	FILE *f;
+	ckhdr_t h;
+	uint64_t off;
+	/* start of the current checkpoint */
+	uint64_t beg;
+	ckpt_t *idx;
+	size_t zidx;
+	/* levels of the book at hand */
+	cklvl_t *lvl;
+	size_t zlvl;
+};
+
+struct ckin_s {
+	char *m;
+	size_t mz;
+	const ckpt_t *idx;
+	size_t nckp;
+};
+
+
+static char*
+sidecar(const char *fn)
+{
+	const size_t fz = strlen(fn);
+	char *r = malloc(fz + sizeof(CKPT_SUFFIX));
+
+	if (LIKELY(r != NULL)) {
+		memcpy(r, fn, fz);
+		memcpy(r + fz, CKPT_SUFFIX, sizeof(CKPT_SUFFIX));
+	}
+	return r;
+}
+
+
+ckout_t
+make_ckout(const char *fn)
+{
+	struct ckout_s *r;
+	struct stat st;
+	char *sfn;
+
+	if (UNLIKELY(stat(fn, &st) < 0)) {
+		return NULL;
+	} else if (UNLIKELY((sfn = sidecar(fn)) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((r = calloc(1U, sizeof(*r))) == NULL)) {
+		free(sfn);
+		return NULL;
+	}
+	r->f = fopen(sfn, "w");
+	free(sfn);
+	if (UNLIKELY(r->f == NULL)) {
+		free(r);
+		return NULL;
+	}
+	memcpy(r->h.magic, CKPT_MAGIC, sizeof(r->h.magic));
+	memcpy(r->h.flav, BQ_FLAV, sizeof(r->h.flav));
+	r->h.lvlz = sizeof(cklvl_t);
+	r->h.fz = st.st_size;
+	/* header's written last */
+	fwrite(&r->h, sizeof(r->h), 1U, r->f);
+	r->off = r->beg = sizeof(r->h);
+	return r;
+}
+
+int
+free_ckout(ckout_t c)
+{
+	int rc = 0;
+
+	c->h.idx = c->off;
+	if (UNLIKELY(fwrite(c->idx, sizeof(*c->idx), c->h.nckp, c->f) <
+		     c->h.nckp ||
+		     fseek(c->f, 0, SEEK_SET) < 0 ||
+		     fwrite(&c->h, sizeof(c->h), 1U, c->f) < 1U)) {
+		rc = -1;
+	}
+	if (UNLIKELY(fclose(c->f) < 0)) {
+		rc = -1;
+	}
+	free(c->idx);
+	free(c->lvl);
+	free(c);
+	return rc;
+}
+
+void
+ckout_book(ckout_t c, const char *ins, size_t inz, xscl_t scl, book_t book)
+{
+	static const char pad[8U];
+	ckbk_t bk = {(uint32_t)inz, scl, .nbid = 0U};
+	size_t n = 0U;
+
+	for (book_side_t s = BOOK_SIDE_BID;; s = BOOK_SIDE_ASK) {
+		for (book_iter_t i = book_iter(book, s);
+		     book_iter_next(&i); n++) {
+			if (UNLIKELY(n >= c->zlvl)) {
+				c->zlvl = 2U * c->zlvl ?: 256U;
+				c->lvl = realloc(
+					c->lvl, c->zlvl * sizeof(*c->lvl));
+			}
+			memset(c->lvl + n, 0, sizeof(*c->lvl));
+			c->lvl[n].p = i.p;
+			c->lvl[n].q = i.q;
+			c->lvl[n].t = i.t;
+		}
+		if (s == BOOK_SIDE_ASK) {
+			break;
+		}
+		bk.nbid = (uint32_t)n;
+	}
+	bk.nask = (uint32_t)n - bk.nbid;
+
+	fwrite(&bk, sizeof(bk), 1U, c->f);
+	fwrite(ins, 1U, inz, c->f);
+	fwrite(pad, 1U, PAD8(inz) - inz, c->f);
+	fwrite(c->lvl, sizeof(*c->lvl), n, c->f);
+	c->off += sizeof(bk) + PAD8(inz) + n * sizeof(*c->lvl);
+	return;
+}
+
+void
+ckout_mark(ckout_t c, tv_t t, size_t pos)
+{
+	if (UNLIKELY(c->h.nckp >= c->zidx)) {
+		c->zidx = 2U * c->zidx ?: 64U;
+		c->idx = realloc(c->idx, c->zidx * sizeof(*c->idx));
+	}
+	c->idx[c->h.nckp++] = (ckpt_t){t, pos, c->beg, c->off - c->beg};
+	c->beg = c->off;
+	return;
+}
+
+
+ckin_t
+make_ckin(const char *fn)
+{
+	struct ckin_s *r;
+	struct stat st;
+	ckhdr_t h;
+	uint64_t fz;
+	char *sfn;
+	int fd;
+
+	if (UNLIKELY(stat(fn, &st) < 0)) {
+		return NULL;
+	}
+	fz = st.st_size;
+	if (UNLIKELY((sfn = sidecar(fn)) == NULL)) {
+		return NULL;
+	}
+	fd = open(sfn, O_RDONLY);
+	free(sfn);
+	if (fd < 0) {
+		return NULL;
+	} else if (pread(fd, &h, sizeof(h), 0) < (ssize_t)sizeof(h) ||
+		   memcmp(h.magic, CKPT_MAGIC, sizeof(h.magic)) ||
+		   memcmp(h.flav, BQ_FLAV, sizeof(h.flav)) ||
+		   h.lvlz != sizeof(cklvl_t) || h.fz != fz ||
+		   fstat(fd, &st) < 0 ||
+		   h.idx > (uint64_t)st.st_size ||
+		   h.nckp > ((uint64_t)st.st_size - h.idx) / sizeof(ckpt_t)) {
+		/* stale or not for us */
+		close(fd);
+		return NULL;
+	} else if (UNLIKELY((r = calloc(1U, sizeof(*r))) == NULL)) {
+		close(fd);
+		return NULL;
+	}
+	r->m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (UNLIKELY(r->m == MAP_FAILED)) {
+		free(r);
+		return NULL;
+	}
+	r->mz = st.st_size;
+	r->idx = (const ckpt_t*)(r->m + h.idx);
+	r->nckp = h.nckp;
+	return r;
+}
+
+void
+free_ckin(ckin_t c)
+{
+	munmap(c->m, c->mz);
+	free(c);
+	return;
+}
+
+size_t
+ckin_count(ckin_t c)
+{
+	return c->nckp;
+}
+
+const ckpt_t*
+ckin_nth(ckin_t c, size_t i)
+{
+	return i < c->nckp ? c->idx + i : NULL;
+}
+
+const ckpt_t*
+ckin_find(ckin_t c, tv_t t)
+{
+	/* checkpoints are in time order, bisect */
+	size_t lo = 0U, hi = c->nckp;
+
+	while (lo < hi) {
+		const size_t mid = (lo + hi) / 2U;
+
+		if (c->idx[mid].t < t) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo ? c->idx + lo - 1U : NULL;
+}
+
+size_t
+ckin_book(ckin_t c, const ckpt_t *p, size_t off, ckbook_t *bk)
+{
+	const char *b;
+	ckbk_t h;
+	size_t z;
+
+	if (UNLIKELY(p->off > c->mz || p->len > c->mz - p->off)) {
+		return 0U;
+	} else if (off + sizeof(h) > p->len) {
+		/* that's it */
+		return 0U;
+	}
+	b = c->m + p->off + off;
+	memcpy(&h, b, sizeof(h));
+	z = sizeof(h) + PAD8(h.inz) + ((size_t)h.nbid + h.nask) * sizeof(cklvl_t);
+	if (UNLIKELY(z > p->len - off)) {
+		return 0U;
+	}
+	bk->ins = b + sizeof(h);
+	bk->inz = h.inz;
+	bk->scl = h.scl;
+	bk->lvl = (const cklvl_t*)(b + sizeof(h) + PAD8(h.inz));
+	bk->nbid = h.nbid;
+	bk->nask = h.nask;
+	return off + z;
+}
+
+/* ckpt.c ends here */
@@ -0,0 +1,135 @@
+/*** ckpt.h -- checkpoints of books
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_ckpt_h_
+#define INCLUDED_ckpt_h_
+#include <stdint.h>
+#include "xquo.h"
+
+/**
+ * Checkpoints hold the books of a run as of some point in time along
+ * with the position in the input to pick up from.  They're kept in
+ * sidecar files next to the input, named like it plus CKPT_SUFFIX.
+ * Sidecars are a header, the checkpoints' books and an index of the
+ * checkpoints, in native byte order, and like binary quote files they
+ * can only be read by the flavour that wrote them. */
+#define CKPT_MAGIC	"books\0ck"
+#define CKPT_SUFFIX	".ckp"
+
+typedef struct {
+	char magic[8U];
+	char flav[4U];
+	/* size of a level, for sanity */
+	uint32_t lvlz;
+	/* size of the input when the sidecar was written */
+	uint64_t fz;
+	/* offset and number of entries of the index */
+	uint64_t idx;
+	uint64_t nckp;
+} ckhdr_t;
+
+typedef struct {
+	/* books are as of T, all quotes before POS have gone in */
+	tv_t t;
+	uint64_t pos;
+	/* offset and size of the books */
+	uint64_t off;
+	uint64_t len;
+} ckpt_t;
+
+typedef struct {
+	px_t p;
+	qx_t q;
+	tv_t t;
+} cklvl_t;
+
+typedef struct {
+	const char *ins;
+	size_t inz;
+	xscl_t scl;
+	/* levels, NBID bids first, then NASK asks */
+	const cklvl_t *lvl;
+	size_t nbid;
+	size_t nask;
+} ckbook_t;
+
+typedef struct ckout_s *ckout_t;
+typedef struct ckin_s *ckin_t;
+
+/**
+ * Prepare writing checkpoints for input FN. */
+extern ckout_t make_ckout(const char *fn);
+
+/**
+ * Write the index and close the sidecar, return 0 on success. */
+extern int free_ckout(ckout_t);
+
+/**
+ * Put BOOK, named INS and of SCL decimal places, into the current
+ * checkpoint. */
+extern void
+ckout_book(ckout_t, const char *ins, size_t inz, xscl_t scl, book_t book);
+
+/**
+ * Finish the current checkpoint, its books being as of T and the next
+ * quote being at position POS. */
+extern void ckout_mark(ckout_t, tv_t t, size_t pos);
+
+/**
+ * Open the sidecar of input FN, return NULL if there is none or if FN
+ * has changed since. */
+extern ckin_t make_ckin(const char *fn);
+
+extern void free_ckin(ckin_t);
+
+/**
+ * Return the number of checkpoints. */
+extern size_t ckin_count(ckin_t);
+
+/**
+ * Return the I-th checkpoint, they're in time order, or NULL. */
+extern const ckpt_t *ckin_nth(ckin_t, size_t i);
+
+/**
+ * Return the last checkpoint before T, or NULL. */
+extern const ckpt_t *ckin_find(ckin_t, tv_t t);
+
+/**
+ * Put the book at offset OFF of checkpoint C into BK, start with OFF 0.
+ * Return the offset of the book thereafter or 0 if there are no more. */
+extern size_t ckin_book(ckin_t, const ckpt_t *c, size_t off, ckbook_t *bk);
+
+#endif	/* INCLUDED_ckpt_h_ */
@@ -702,8 +702,7 @@ d32tostr(char *restrict buf, size_t bsz, _Decimal32 x)
 		return z;
 	} else if (UNLIKELY(isinfd32(x))) {
 		const size_t z = min_z(3U + (x < 0.df), bsz);
-		buf[0U] = '-';
-		memcpy(buf + (x < 0.df), "inf", z);
+		memcpy(buf, x < 0.df ? "-inf" : "inf", z);
 		return z;
 	}
 #if defined HAVE_DFP754_BID_LITERALS
@@ -89,6 +89,12 @@ inline __attribute__((pure, const)) _Decimal32 nand32(char *__tagp);
 #if !defined HAVE_ISNAND32
 # define isnand32		__builtin_isnand32
 #endif	/* !HAVE_ISNAND32 */
+#if !defined HAVE_ISINFD32
+# define isinfd32		__builtin_isinfd32
+#elif !defined HAVE_DFP754_H && !defined HAVE_DFP_STDLIB_H
+/* the library has it but no header to say so */
+extern int isinfd32(_Decimal32);
+#endif	/* !HAVE_ISINFD32 */
 
 inline __attribute__((pure, const)) uint32_t
 bits32(_Decimal32 x)
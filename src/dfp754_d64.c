@@ -374,7 +374,7 @@ round_bcd64(uint_least64_t mant, int roff)
 		mant >>= 4U;
 		sh += 4U;
 	}
-	mant = (mant & ~0b1111U) ^ x;
+	mant = (mant & ~(uint_least64_t)0b1111U) ^ x;
 	mant <<= sh;
 	return mant;
 }
@@ -409,8 +409,11 @@ strtobcd64(const char *src, char **on)
 	for (; *sp >= '0' && *sp <= '9'; sp++, expo++);
 	if (*sp == '.' && nd > 0) {
 		/* less than 15 digits, read more from the right side */
-		for (sp++;
-		     *sp >= '0' && *sp <= '9' && nd > 0; sp++, expo--, nd--) {
+		if (*++sp == '0' && nd == 15U) {
+			/* no digits yet, zeros aren't significant */
+			for (; *sp == '0'; sp++, expo--);
+		}
+		for (; *sp >= '0' && *sp <= '9' && nd > 0; sp++, expo--, nd--) {
 			mant <<= 4U;
 			mant |= U(*sp);
 		}
@@ -418,13 +421,21 @@ strtobcd64(const char *src, char **on)
 		roff += (*sp >= '5' && *sp <= '9');
 		for (; *sp >= '0' && *sp <= '9'; sp++);
 	} else if (*sp == '.') {
-		/* more than 15 digits already, just consume */
-		roff += (*sp >= '5' && *sp <= '9');
-		for (sp++; *sp >= '0' && *sp <= '9'; sp++);
+		/* 15 digits or more already, just consume, the round-off
+		 * digit is right of the point if none were dropped so far */
+		sp++;
+		roff += !expo && *sp >= '5' && *sp <= '9';
+		for (; *sp >= '0' && *sp <= '9'; sp++);
 	}
 
 	if (UNLIKELY(roff)) {
-		mant = round_bcd64(mant, sign ? -1 : 1);
+		/* MANT is the magnitude, round it up regardless of SIGN */
+		mant = round_bcd64(mant, 1);
+		if (UNLIKELY(mant >> 60U)) {
+			/* carried into a 16th digit, drop a 0 */
+			mant >>= 4U;
+			expo++;
+		}
 	}
 
 	if (LIKELY(on != NULL)) {
@@ -625,8 +636,39 @@ strtobid64(const char *src, char **on)
 /* d64s look like s??eeeeee mm..23..mm
  * and the decimal is (-1 * s) * m * 10^(e - 101),
  * this implementation is very minimal serving only the cattle use cases */
-	bcd64_t b = strtobcd64(src, on);
-	return bcd64tobid(b);
+	const char *sp = src;
+	uint64_t m = 0U;
+	uint64_t s = 0U;
+	unsigned int nd = 0U;
+	unsigned int nf = 0U;
+
+	/* fast path first, up to 15 digits go straight into the mantissa
+	 * which is what strtobcd64() would do, without rounding */
+	if (UNLIKELY(*sp == '-')) {
+		s = 1U;
+		sp++;
+	} else if (UNLIKELY(*sp == '+')) {
+		sp++;
+	}
+	for (; *sp == '0'; sp++);
+	for (; (unsigned char)(*sp ^ '0') < 10U && nd <= 15U; sp++, nd++) {
+		m = m * 10U + (*sp ^ '0');
+	}
+	if (*sp == '.') {
+		for (sp++; (unsigned char)(*sp ^ '0') < 10U && nd + nf <= 15U;
+		     sp++, nf++) {
+			m = m * 10U + (*sp ^ '0');
+		}
+	}
+	if (UNLIKELY(nd + nf > 15U)) {
+		/* too many digits, let the slow path round them off */
+		bcd64_t b = strtobcd64(src, on);
+		return bcd64tobid(b);
+	}
+	if (LIKELY(on != NULL)) {
+		*on = deconst(sp);
+	}
+	return assemble_bid(m, 398U - nf, s);
 }
 #elif defined HAVE_DFP754_DPD_LITERALS
 static _Decimal64
@@ -654,6 +696,18 @@ strtod64(const char *src, char **on)
 
 
 #if defined HAVE_DFP754_BID_LITERALS
+static const char dig2[200U] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
 static int
 bid64tostr(char *restrict buf, size_t bsz, _Decimal64 x)
 {
@@ -669,6 +723,52 @@ bid64tostr(char *restrict buf, size_t bsz, _Decimal64 x)
 	m = mant_bid64(x);
 	s = m ? sign_bid64(x) : 0/*no stinking signed naughts*/;
 
+	if (LIKELY(m < 10000000000000000ULL && e >= -16 && e <= 16 &&
+		   bsz >= 40U)) {
+		/* fast path, digits right to left, two at a time */
+		char tmp[16U];
+		char *tp = tmp + sizeof(tmp);
+		char *bp = buf;
+		size_t nd;
+
+		for (; m >= 100U; m /= 100U) {
+			tp -= 2U;
+			memcpy(tp, dig2 + 2U * (m % 100U), 2U);
+		}
+		if (m >= 10U) {
+			tp -= 2U;
+			memcpy(tp, dig2 + 2U * m, 2U);
+		} else {
+			*--tp = (char)(m ^ '0');
+		}
+		nd = tmp + sizeof(tmp) - tp;
+
+		if (s) {
+			*bp++ = '-';
+		}
+		if (e >= 0) {
+			memcpy(bp, tp, nd);
+			bp += nd;
+			memset(bp, '0', e);
+			bp += e;
+		} else if (nd > (size_t)-e) {
+			memcpy(bp, tp, nd + e);
+			bp += nd + e;
+			*bp++ = '.';
+			memcpy(bp, tp + nd + e, -e);
+			bp += -e;
+		} else {
+			*bp++ = '0';
+			*bp++ = '.';
+			memset(bp, '0', -e - nd);
+			bp += -e - nd;
+			memcpy(bp, tp, nd);
+			bp += nd;
+		}
+		*bp = '\0';
+		return bp - buf;
+	}
+
 	/* reencode m as bcd */
 	with (uint_least64_t bcdm = 0U) {
 		for (size_t i = 0; i < 16U; i++) {
@@ -729,8 +829,7 @@ d64tostr(char *restrict buf, size_t bsz, _Decimal64 x)
 		return z;
 	} else if (UNLIKELY(isinfd64(x))) {
 		const size_t z = min_z(3U + (x < 0.df), bsz);
-		buf[0U] = '-';
-		memcpy(buf + (x < 0.df), "inf", z);
+		memcpy(buf, x < 0.df ? "-inf" : "inf", z);
 		return z;
 	}
 #if defined HAVE_DFP754_BID_LITERALS
@@ -740,6 +839,55 @@ d64tostr(char *restrict buf, size_t bsz, _Decimal64 x)
 #endif	 /* HAVE_DFP754_*_LITERALS */
 }
 
+size_t
+strtod64s(_Decimal64 *restrict tgt, size_t n, const char *src, char **on)
+{
+	const char *sp = src;
+	size_t i;
+
+	for (i = 0U; i < n; i++) {
+		char *ep;
+
+		tgt[i] = strtod64(sp, &ep);
+		if (UNLIKELY(ep == sp)) {
+			break;
+		}
+		sp = ep;
+		if (*sp == '\0' || *sp == '\n') {
+			i++;
+			break;
+		} else if (i + 1U < n) {
+			/* skip the separator */
+			sp++;
+		}
+	}
+	if (LIKELY(on != NULL)) {
+		*on = deconst(sp);
+	}
+	return i;
+}
+
+size_t
+d64tostrs(char *restrict buf, size_t bsz,
+	  const _Decimal64 *src, size_t n, char sep)
+{
+	size_t len = 0U;
+
+	for (size_t i = 0U; i < n; i++) {
+		/* need room for a separator and at least one digit */
+		if (UNLIKELY(len + (i > 0U) >= bsz)) {
+			break;
+		} else if (i) {
+			buf[len++] = sep;
+		}
+		len += d64tostr(buf + len, bsz - len, src[i]);
+	}
+	if (len < bsz) {
+		buf[len] = '\0';
+	}
+	return len;
+}
+
 /* always use our own version,
  * the official version would return NAN in case the significand's
  * capacity is exceeded, we do fuckall in that case. */
@@ -65,6 +65,21 @@ extern _Decimal64 strtod64(const char*, char**);
 #if defined HAVE_DFP754_BID_LITERALS || defined HAVE_DFP754_DPD_LITERALS
 extern int d64tostr(char *restrict buf, size_t bsz, _Decimal64);
 
+/**
+ * Read up to N decimals from SRC into TGT, values are separated by
+ * exactly one character, e.g. a tab, and end at a newline or \0.
+ * Return the number of values read, ON is set past the last one. */
+extern size_t
+strtod64s(_Decimal64 *restrict tgt, size_t n, const char *src, char **on);
+
+/**
+ * Write N decimals from SRC to BUF separated by SEP, never more than
+ * BSZ bytes, the result is \0-terminated if there's room.
+ * Return the number of bytes written, sans the terminator. */
+extern size_t
+d64tostrs(char *restrict buf, size_t bsz,
+	  const _Decimal64 *src, size_t n, char sep);
+
 /**
  * Round X to the quantum of R. */
 extern _Decimal64 quantized64(_Decimal64 x, _Decimal64 r);
@@ -89,6 +104,12 @@ inline __attribute__((pure, const)) _Decimal64 nand64(char *__tagp);
 #if !defined HAVE_ISNAND64
 # define isnand64		__builtin_isnand64
 #endif	/* !HAVE_ISNAND64 */
+#if !defined HAVE_ISINFD64
+# define isinfd64		__builtin_isinfd64
+#elif !defined HAVE_DFP754_H && !defined HAVE_DFP_STDLIB_H
+/* the library has it but no header to say so */
+extern int isinfd64(_Decimal64);
+#endif	/* !HAVE_ISINFD64 */
 
 inline __attribute__((pure, const)) uint64_t
 bits64(_Decimal64 x)
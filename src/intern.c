@@ -0,0 +1,290 @@
+/*** intern.c -- interned instrument names
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "intern.h"
+#include "hash.h"
+#include "nifty.h"
+
+/* arena chunks, strings are never moved once in here */
+struct chnk_s {
+	struct chnk_s *prev;
+	size_t n;
+	size_t z;
+	char d[];
+};
+
+struct slot_s {
+	hx_t hx;
+	/* id + 1, 0 means free */
+	uint32_t id;
+};
+
+struct intern_s {
+	/* number of strings */
+	size_t n;
+	size_t zstr;
+	struct {
+		const char *s;
+		size_t z;
+	} *str;
+	/* open-addressing table, always a power of 2 */
+	size_t zslot;
+	struct slot_s *slot;
+	/* bloom front to the table, 4 bits per slot, so strings that
+	 * aren't interned are mostly turned away without probing */
+	uint64_t *blm;
+	/* arena */
+	struct chnk_s *c;
+};
+
+#define CHNKZ	(65536U - sizeof(struct chnk_s))
+
+
+static const char*
+arena_add(intern_t tbl, const char *str, size_t len)
+{
+	struct chnk_s *c = tbl->c;
+	char *r;
+
+	if (UNLIKELY(c == NULL || c->n + len + 1U > c->z)) {
+		const size_t z = len + 1U > CHNKZ ? len + 1U : CHNKZ;
+
+		if (UNLIKELY((c = malloc(sizeof(*c) + z)) == NULL)) {
+			return NULL;
+		}
+		c->prev = tbl->c;
+		c->n = 0U;
+		c->z = z;
+		tbl->c = c;
+	}
+	r = memcpy(c->d + c->n, str, len);
+	r[len] = '\0';
+	c->n += len + 1U;
+	return r;
+}
+
+static inline size_t
+blm_bit(const struct intern_s *tbl, hx_t hx)
+{
+	return hx & (tbl->zslot * 4U - 1U);
+}
+
+static inline void
+blm_set(struct intern_s *tbl, hx_t hx)
+{
+	const hx_t hy = hx >> 16U | hx << 16U;
+
+	tbl->blm[blm_bit(tbl, hx) / 64U] |= 1ULL << (blm_bit(tbl, hx) % 64U);
+	tbl->blm[blm_bit(tbl, hy) / 64U] |= 1ULL << (blm_bit(tbl, hy) % 64U);
+	return;
+}
+
+static inline bool
+blm_tst(const struct intern_s *tbl, hx_t hx)
+{
+	const hx_t hy = hx >> 16U | hx << 16U;
+
+	return (tbl->blm[blm_bit(tbl, hx) / 64U] >> (blm_bit(tbl, hx) % 64U) &
+		tbl->blm[blm_bit(tbl, hy) / 64U] >> (blm_bit(tbl, hy) % 64U) &
+		1U);
+}
+
+static size_t
+slot_seek(intern_t tbl, hx_t hx, const char *str, size_t len)
+{
+/* return slot index of STR or the free slot it would go into */
+	const size_t msk = tbl->zslot - 1U;
+
+	for (size_t i = hx & msk;; i = (i + 1U) & msk) {
+		const struct slot_s s = tbl->slot[i];
+
+		if (!s.id) {
+			return i;
+		} else if (s.hx == hx &&
+			   tbl->str[s.id - 1U].z == len &&
+			   !memcmp(tbl->str[s.id - 1U].s, str, len)) {
+			return i;
+		}
+	}
+}
+
+static int
+rehash(intern_t tbl)
+{
+	const size_t nuz = tbl->zslot * 2U;
+	const size_t msk = nuz - 1U;
+	struct slot_s *nu = calloc(nuz, sizeof(*nu));
+	uint64_t *blm = calloc(nuz / 16U, sizeof(*blm));
+
+	if (UNLIKELY(nu == NULL || blm == NULL)) {
+		free(nu);
+		free(blm);
+		return -1;
+	}
+	for (size_t i = 0U; i < tbl->zslot; i++) {
+		const struct slot_s s = tbl->slot[i];
+		size_t j;
+
+		if (!s.id) {
+			continue;
+		}
+		for (j = s.hx & msk; nu[j].id; j = (j + 1U) & msk);
+		nu[j] = s;
+	}
+	free(tbl->slot);
+	free(tbl->blm);
+	tbl->slot = nu;
+	tbl->blm = blm;
+	tbl->zslot = nuz;
+	for (size_t i = 0U; i < nuz; i++) {
+		if (nu[i].id) {
+			blm_set(tbl, nu[i].hx);
+		}
+	}
+	return 0;
+}
+
+
+intern_t
+make_intern(void)
+{
+	intern_t r = calloc(1U, sizeof(*r));
+
+	if (UNLIKELY(r == NULL)) {
+		return NULL;
+	}
+	r->zslot = 64U;
+	r->slot = calloc(r->zslot, sizeof(*r->slot));
+	r->blm = calloc(r->zslot / 16U, sizeof(*r->blm));
+	if (UNLIKELY(r->slot == NULL || r->blm == NULL)) {
+		free(r->slot);
+		free(r->blm);
+		free(r);
+		return NULL;
+	}
+	return r;
+}
+
+void
+free_intern(intern_t tbl)
+{
+	for (struct chnk_s *c = tbl->c, *p; c != NULL; c = p) {
+		p = c->prev;
+		free(c);
+	}
+	free(tbl->str);
+	free(tbl->slot);
+	free(tbl->blm);
+	free(tbl);
+	return;
+}
+
+size_t
+intern(intern_t tbl, const char *str, size_t len)
+{
+	const hx_t hx = hash(str, len);
+	size_t i = slot_seek(tbl, hx, str, len);
+	const char *s;
+
+	if (LIKELY(tbl->slot[i].id)) {
+		return (size_t)tbl->slot[i].id - 1U;
+	}
+	/* new one, keep the load factor below 1/2 */
+	if (UNLIKELY(2U * (tbl->n + 1U) > tbl->zslot)) {
+		if (UNLIKELY(rehash(tbl) < 0)) {
+			return NOT_AN_ID;
+		}
+		i = slot_seek(tbl, hx, str, len);
+	}
+	if (UNLIKELY(tbl->n >= tbl->zstr)) {
+		const size_t nuz = (tbl->zstr * 2U) ?: 64U;
+		typeof(tbl->str) nu = realloc(tbl->str, nuz * sizeof(*nu));
+
+		if (UNLIKELY(nu == NULL)) {
+			return NOT_AN_ID;
+		}
+		tbl->str = nu;
+		tbl->zstr = nuz;
+	}
+	if (UNLIKELY((s = arena_add(tbl, str, len)) == NULL)) {
+		return NOT_AN_ID;
+	}
+	tbl->str[tbl->n].s = s;
+	tbl->str[tbl->n].z = len;
+	tbl->slot[i] = (struct slot_s){hx, (uint32_t)++tbl->n};
+	blm_set(tbl, hx);
+	return tbl->n - 1U;
+}
+
+size_t
+intern_get(intern_t tbl, const char *str, size_t len)
+{
+	const hx_t hx = hash(str, len);
+	size_t i;
+
+	if (!blm_tst(tbl, hx)) {
+		return NOT_AN_ID;
+	}
+	i = slot_seek(tbl, hx, str, len);
+	return (size_t)tbl->slot[i].id - 1U;
+}
+
+const char*
+intern_str(intern_t tbl, size_t id)
+{
+	return id < tbl->n ? tbl->str[id].s : NULL;
+}
+
+size_t
+intern_len(intern_t tbl, size_t id)
+{
+	return id < tbl->n ? tbl->str[id].z : 0U;
+}
+
+size_t
+intern_cnt(intern_t tbl)
+{
+	return tbl->n;
+}
+
+/* intern.c ends here */
@@ -0,0 +1,75 @@
+/*** intern.h -- interned instrument names
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_intern_h_
+#define INCLUDED_intern_h_
+#include <stddef.h>
+
+/**
+ * Intern tables map strings to dense ids 0, 1, 2, ... in order of
+ * first appearance.  Interned strings live in an arena owned by the
+ * table, are nul-terminated, and stay put until the table is freed. */
+typedef struct intern_s *intern_t;
+
+/**
+ * Id returned by intern_get() for strings not in the table. */
+#define NOT_AN_ID	((size_t)-1ULL)
+
+
+extern intern_t make_intern(void);
+extern void free_intern(intern_t);
+
+/**
+ * Return the id of STR of length LEN in the table, add it if need be. */
+extern size_t intern(intern_t, const char *str, size_t len);
+
+/**
+ * Return the id of STR of length LEN or NOT_AN_ID if not interned. */
+extern size_t intern_get(intern_t, const char *str, size_t len);
+
+/**
+ * Return the interned string with id ID. */
+extern const char *intern_str(intern_t, size_t id);
+
+/**
+ * Return the length of the interned string with id ID. */
+extern size_t intern_len(intern_t, size_t id);
+
+/**
+ * Return the number of interned strings. */
+extern size_t intern_cnt(intern_t);
+
+#endif	/* INCLUDED_intern_h_ */
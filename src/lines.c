@@ -0,0 +1,217 @@
+/*** lines.c -- reading lines off files and pipes
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lines.h"
+#include "nifty.h"
+
+/* read buffer size for pipes, must be a multiple of the page size */
+#define BLKZ	(1U << 20U)
+
+struct lines_s {
+	int fd;
+	/* whether BUF is a mapping of the file */
+	bool mmp;
+	/* whether we've seen the end of file */
+	bool eof;
+	/* mapping or read buffer of size BSZ, data is in [BIX, BEND) */
+	char *buf;
+	size_t bsz;
+	size_t bix;
+	size_t bend;
+	/* file offset of BUF */
+	size_t boff;
+	/* nul-terminated copy of a last line without newline */
+	char *tail;
+};
+
+
+lines_t
+make_lines(const char *fn)
+{
+	struct lines_s *r;
+	struct stat st;
+	int fd;
+
+	if (fn[0U] == '-' && fn[1U] == '\0') {
+		fd = STDIN_FILENO;
+	} else if (UNLIKELY((fd = open(fn, O_RDONLY)) < 0)) {
+		return NULL;
+	}
+	if (UNLIKELY((r = calloc(1U, sizeof(*r))) == NULL)) {
+		goto clo;
+	}
+	r->fd = fd;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+	    /* mind the current offset, stdin might have been read from */
+	    (r->bix = lseek(fd, 0, SEEK_CUR)) != (size_t)-1 &&
+	    (r->buf = mmap(NULL, st.st_size, PROT_READ,
+			   MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+		(void)posix_madvise(r->buf, st.st_size, POSIX_MADV_SEQUENTIAL);
+		r->mmp = true;
+		r->eof = true;
+		r->bsz = r->bend = st.st_size;
+		r->bix = r->bix < r->bend ? r->bix : r->bend;
+		return r;
+	}
+	/* read in blocks then, plus one for a terminating nul */
+	r->bix = 0U;
+	r->bsz = BLKZ;
+	if (UNLIKELY(posix_memalign((void**)&r->buf, 4096U, r->bsz + 1U))) {
+		free(r);
+		goto clo;
+	}
+	return r;
+
+clo:
+	if (fd != STDIN_FILENO) {
+		close(fd);
+	}
+	return NULL;
+}
+
+void
+free_lines(lines_t l)
+{
+	if (l->mmp) {
+		munmap(l->buf, l->bsz);
+	} else {
+		free(l->buf);
+	}
+	free(l->tail);
+	if (l->fd != STDIN_FILENO) {
+		close(l->fd);
+	}
+	free(l);
+	return;
+}
+
+ssize_t
+next_line(lines_t l, const char **ln)
+{
+	const char *s, *eol;
+	size_t z;
+
+again:
+	s = l->buf + l->bix;
+	z = l->bend - l->bix;
+	if (LIKELY((eol = memchr(s, '\n', z)) != NULL)) {
+		z = eol + 1U - s;
+		l->bix += z;
+		*ln = s;
+		return z;
+	} else if (!l->eof) {
+		ssize_t nrd;
+
+		/* move the rest to the front and fill up */
+		memmove(l->buf, s, z);
+		l->boff += l->bix;
+		l->bix = 0U;
+		l->bend = z;
+		if (UNLIKELY(z >= l->bsz)) {
+			/* line's longer than the buffer */
+			char *nu = realloc(l->buf, 2U * l->bsz + 1U);
+
+			if (UNLIKELY(nu == NULL)) {
+				return -1;
+			}
+			l->buf = nu;
+			l->bsz *= 2U;
+		}
+		for (size_t tot = l->bsz - l->bend; tot;) {
+			if ((nrd = read(l->fd, l->buf + l->bend, tot)) <= 0) {
+				l->eof = true;
+				break;
+			}
+			l->bend += nrd;
+			tot -= nrd;
+			if (memchr(l->buf + l->bend - nrd, '\n', nrd)) {
+				break;
+			}
+		}
+		goto again;
+	} else if (z) {
+		/* last line without newline, nul-terminate it */
+		l->bix = l->bend;
+		if (!l->mmp) {
+			l->buf[l->bend] = '\0';
+		} else if (LIKELY((l->tail = malloc(z + 1U)) != NULL)) {
+			memcpy(l->tail, s, z);
+			l->tail[z] = '\0';
+			s = l->tail;
+		} else {
+			return -1;
+		}
+		*ln = s;
+		return z;
+	}
+	return -1;
+}
+
+size_t
+lines_tell(lines_t l)
+{
+	return l->boff + l->bix;
+}
+
+size_t
+lines_size(lines_t l)
+{
+	return l->mmp ? l->bsz : 0U;
+}
+
+int
+lines_seek(lines_t l, size_t off)
+{
+	if (UNLIKELY(!l->mmp)) {
+		/* can't go back on pipes */
+		return -1;
+	}
+	l->bix = off < l->bend ? off : l->bend;
+	return 0;
+}
+
+/* lines.c ends here */
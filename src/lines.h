@@ -0,0 +1,74 @@
+/*** lines.h -- reading lines off files and pipes
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_lines_h_
+#define INCLUDED_lines_h_
+#include <unistd.h>
+
+/**
+ * Line readers hand out lines without copying them, regular files are
+ * mapped into memory, pipes and terminals are read in large blocks. */
+typedef struct lines_s *lines_t;
+
+/**
+ * Open FN for line reading, `-' denotes stdin.
+ * Return NULL if FN cannot be opened. */
+extern lines_t make_lines(const char *fn);
+
+extern void free_lines(lines_t);
+
+/**
+ * Point LN to the next line and return its length including the
+ * newline character, or -1 if there are no more lines.
+ * Lines are not nul-terminated but end in a newline, except possibly
+ * the last one which is then nul-terminated.
+ * LN stays valid until the next call. */
+extern ssize_t next_line(lines_t, const char **ln);
+
+/**
+ * Return the file offset of the next line. */
+extern size_t lines_tell(lines_t);
+
+/**
+ * Return the size of the file, regular files only, 0 otherwise. */
+extern size_t lines_size(lines_t);
+
+/**
+ * Make the line at file offset OFF the next line, regular files only.
+ * Return 0 on success, -1 otherwise. */
+extern int lines_seek(lines_t, size_t off);
+
+#endif	/* INCLUDED_lines_h_ */
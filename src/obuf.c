@@ -0,0 +1,221 @@
+/*** obuf.c -- buffered output
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "obuf.h"
+#include "spsc.h"
+#include "stage.h"
+#include "nifty.h"
+
+#define OBUFZ	(1U << 20U)
+/* number of buffers in async mode, a power of 2 */
+#define NOBUF	(4U)
+
+struct obuf_s {
+	size_t n;
+	char d[OBUFZ];
+};
+
+static struct obuf_s ob0;
+static struct obuf_s *ob = &ob0;
+/* flush when OB->N exceeds this, 0 for line-by-line */
+static size_t othr = (size_t)-1ULL;
+
+/* async mode, full buffers go to the writer, empty ones come back */
+static spsc_t oful;
+static spsc_t oemp;
+/* buffers we hold on to, and buffers with the writer */
+static struct obuf_s *ofre[NOBUF];
+static size_t nfre;
+static size_t nout;
+static _Atomic int oerr;
+/* per-thread diversion */
+static __thread otap_t *otap;
+
+
+static int
+write_out(const char *buf, size_t z)
+{
+	for (size_t i = 0U; i < z;) {
+		ssize_t nwr = write(STDOUT_FILENO, buf + i, z - i);
+
+		if (UNLIKELY(nwr < 0 && errno == EINTR)) {
+			continue;
+		} else if (UNLIKELY(nwr <= 0)) {
+			return -1;
+		}
+		i += nwr;
+	}
+	return 0;
+}
+
+static void*
+writer(void *UNUSED(clo))
+{
+	for (struct obuf_s *b; (b = spsc_get(oful)) != NULL;) {
+		if (UNLIKELY(write_out(b->d, b->n) < 0)) {
+			oerr = -1;
+		}
+		b->n = 0U;
+		spsc_put(oemp, b);
+	}
+	return NULL;
+}
+
+static int
+obuf_push(void)
+{
+/* hand the current buffer over, without waiting */
+	if (oful == NULL) {
+		const int rc = write_out(ob->d, ob->n);
+		ob->n = 0U;
+		return rc;
+	}
+	spsc_put(oful, ob);
+	nout++;
+	if (nfre) {
+		ob = ofre[--nfre];
+	} else {
+		ob = spsc_get(oemp);
+		nout--;
+	}
+	return 0;
+}
+
+
+int
+obuf_async(int cpu)
+{
+	static pthread_t thr;
+
+	if (oful != NULL) {
+		return 0;
+	} else if (UNLIKELY((oful = make_spsc(NOBUF)) == NULL)) {
+		return -1;
+	} else if (UNLIKELY((oemp = make_spsc(NOBUF)) == NULL)) {
+		goto nope;
+	}
+	for (; nfre < NOBUF - 1U; nfre++) {
+		if (UNLIKELY((ofre[nfre] = malloc(sizeof(*ob))) == NULL)) {
+			goto nope;
+		}
+		ofre[nfre]->n = 0U;
+	}
+	if (UNLIKELY(run_stage(&thr, writer, NULL, cpu) < 0)) {
+		goto nope;
+	}
+	return 0;
+
+nope:
+	for (; nfre > 0U; free(ofre[--nfre]));
+	free_spsc(oemp);
+	free_spsc(oful);
+	oemp = oful = NULL;
+	return -1;
+}
+
+int
+obuf_flush(void)
+{
+	int rc = 0;
+
+	if (ob->n) {
+		rc = obuf_push();
+	}
+	/* wait for the writer to finish */
+	for (; nout; nout--) {
+		ofre[nfre++] = spsc_get(oemp);
+	}
+	return rc | oerr;
+}
+
+void
+obuf_write(const char *buf, size_t z)
+{
+	if (UNLIKELY(otap != NULL)) {
+		if (UNLIKELY(otap->n + z > otap->z)) {
+			const size_t nuz = otap->n + z > 2U * otap->z
+				? otap->n + z : 2U * otap->z;
+			char *nu = realloc(otap->d, nuz);
+
+			if (UNLIKELY(nu == NULL)) {
+				oerr = -1;
+				return;
+			}
+			otap->d = nu;
+			otap->z = nuz;
+		}
+		memcpy(otap->d + otap->n, buf, z);
+		otap->n += z;
+		return;
+	}
+	if (UNLIKELY(othr == (size_t)-1ULL)) {
+		/* first call, see where we're going */
+		othr = isatty(STDOUT_FILENO) ? 0U : OBUFZ;
+	}
+	if (UNLIKELY(ob->n + z > OBUFZ)) {
+		obuf_push();
+		if (UNLIKELY(z > OBUFZ)) {
+			/* too big, push it through in buffer-sized bites */
+			memcpy(ob->d, buf, OBUFZ);
+			ob->n = OBUFZ;
+			obuf_push();
+			obuf_write(buf + OBUFZ, z - OBUFZ);
+			return;
+		}
+	}
+	memcpy(ob->d + ob->n, buf, z);
+	ob->n += z;
+	if (UNLIKELY(ob->n > othr && ob->d[ob->n - 1U] == '\n')) {
+		obuf_flush();
+	}
+	return;
+}
+
+void
+obuf_tap(otap_t *tap)
+{
+	otap = tap;
+	return;
+}
+
+/* obuf.c ends here */
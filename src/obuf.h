@@ -0,0 +1,69 @@
+/*** obuf.h -- buffered output
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_obuf_h_
+#define INCLUDED_obuf_h_
+#include <stddef.h>
+
+/* growable buffer that catches a thread's output, see obuf_tap() */
+typedef struct {
+	char *d;
+	size_t n;
+	size_t z;
+} otap_t;
+
+/**
+ * Append BUF of size Z to the output buffer, which goes to stdout
+ * in large write()s when full, or line by line on terminals. */
+extern void obuf_write(const char *buf, size_t z);
+
+/**
+ * Hand full buffers to a writer thread, pinned to CPU if non-negative,
+ * instead of writing them out in the caller's thread.
+ * Return 0 on success or -1 if the thread couldn't be started. */
+extern int obuf_async(int cpu);
+
+/**
+ * Write out everything buffered so far.
+ * Return 0 on success or -1 if stdout refused. */
+extern int obuf_flush(void);
+
+/**
+ * Divert the calling thread's obuf_write()s into TAP, or stop doing
+ * so if TAP is NULL.  Other threads' output is unaffected. */
+extern void obuf_tap(otap_t *tap);
+
+#endif	/* INCLUDED_obuf_h_ */
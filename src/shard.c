@@ -0,0 +1,420 @@
+/*** shard.c -- books spread over worker threads
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "shard.h"
+#include "obuf.h"
+#include "spsc.h"
+#include "stage.h"
+#include "nifty.h"
+
+/* rounds in flight, a power of 2, and how many events make a round,
+ * events about all books count once per book */
+#define NROUND	(8U)
+#define ROUNDW	(4096U)
+
+struct part_s {
+	/* a shard's output for a round */
+	otap_t out;
+	/* and where each of its spans ends */
+	size_t *end;
+	size_t nend;
+	size_t zend;
+	/* set when a span end couldn't be recorded */
+	bool errp;
+};
+
+struct round_s {
+	struct {
+		shev_t e;
+		/* shard, or NOT_AN_ID for all of them */
+		size_t w;
+		/* offset of E.LN in BUF */
+		size_t lo;
+	} *ev;
+	size_t nev;
+	size_t zev;
+	size_t wgt;
+	/* event bytes */
+	char *buf;
+	size_t bn;
+	size_t bz;
+	/* one per shard */
+	struct part_s *p;
+};
+
+struct wrk_s {
+	shard_t s;
+	size_t w;
+	pthread_t thr;
+};
+
+struct shard_s {
+	size_t n;
+	void(*fn)(size_t, const shev_t*);
+	/* the round being filled */
+	struct round_s *cur;
+	/* rounds we hold on to */
+	struct round_s *idle[NROUND];
+	size_t nidle;
+	struct round_s r[NROUND];
+	/* per shard, rounds to do and rounds done, the merger takes
+	 * rounds done by all shards and sends them back via FREE */
+	spsc_t *todo;
+	spsc_t *done;
+	spsc_t free;
+	struct wrk_s *wrk;
+	size_t nwrk;
+	pthread_t mrgr;
+	bool mrgp;
+	/* events or output lost, set by us or the merger */
+	_Atomic int err;
+};
+
+/* the part of the round the calling shard is working on */
+static __thread struct part_s *wpart;
+
+
+static void*
+worker(void *clo)
+{
+	const shard_t s = ((struct wrk_s*)clo)->s;
+	const size_t w = ((struct wrk_s*)clo)->w;
+
+	for (struct round_s *r; (r = spsc_get(s->todo[w])) != NULL;) {
+		wpart = r->p + w;
+		obuf_tap(&wpart->out);
+		for (size_t i = 0U; i < r->nev; i++) {
+			if (r->ev[i].w == w) {
+				s->fn(w, &r->ev[i].e);
+				shard_span();
+			} else if (r->ev[i].w == NOT_AN_ID) {
+				s->fn(w, &r->ev[i].e);
+			}
+		}
+		obuf_tap(NULL);
+		wpart = NULL;
+		spsc_put(s->done[w], r);
+	}
+	s->fn(w, NULL);
+	/* tell the merger */
+	spsc_put(s->done[w], NULL);
+	return NULL;
+}
+
+static void
+merge(shard_t s, struct round_s *r)
+{
+/* write out R's spans in event order */
+	size_t at[s->n];
+	size_t ie[s->n];
+
+	memset(at, 0, sizeof(at));
+	memset(ie, 0, sizeof(ie));
+	for (size_t i = 0U; i < r->nev; i++) {
+		size_t w = r->ev[i].w;
+		size_t nb = 1U;
+
+		if (w == NOT_AN_ID) {
+			w = 0U;
+			nb = r->ev[i].e.nb;
+		}
+		for (size_t b = 0U; b < nb; b++) {
+			struct part_s *p = r->p + w;
+
+			if (UNLIKELY(p->errp)) {
+				/* spans are off, don't make it worse */
+				s->err = -1;
+				goto out;
+			}
+			if (LIKELY(ie[w] < p->nend)) {
+				const size_t e = p->end[ie[w]++];
+
+				if (e > at[w]) {
+					obuf_write(p->out.d + at[w], e - at[w]);
+				}
+				at[w] = e;
+			}
+			if (++w >= s->n) {
+				w = 0U;
+			}
+		}
+	}
+out:
+	/* ready for reuse */
+	r->nev = r->wgt = r->bn = 0U;
+	for (size_t w = 0U; w < s->n; w++) {
+		r->p[w].out.n = r->p[w].nend = 0U;
+		r->p[w].errp = false;
+	}
+	return;
+}
+
+static void*
+merger(void *clo)
+{
+	const shard_t s = clo;
+
+	for (struct round_s *r; (r = spsc_get(s->done[0U])) != NULL;) {
+		/* every shard sends it back, in order */
+		for (size_t w = 1U; w < s->n; w++) {
+			(void)spsc_get(s->done[w]);
+		}
+		merge(s, r);
+		spsc_put(s->free, r);
+	}
+	for (size_t w = 1U; w < s->n; w++) {
+		(void)spsc_get(s->done[w]);
+	}
+	return NULL;
+}
+
+static struct round_s*
+next_round(shard_t s)
+{
+	if (s->nidle) {
+		return s->idle[--s->nidle];
+	}
+	return spsc_get(s->free);
+}
+
+static void
+seal(shard_t s)
+{
+	struct round_s *r = s->cur;
+
+	if (r == NULL || !r->nev) {
+		return;
+	}
+	/* BUF has stopped moving */
+	for (size_t i = 0U; i < r->nev; i++) {
+		r->ev[i].e.ln = r->buf + r->ev[i].lo;
+	}
+	for (size_t w = 0U; w < s->n; w++) {
+		spsc_put(s->todo[w], r);
+	}
+	s->cur = NULL;
+	return;
+}
+
+
+shard_t
+make_shard(size_t n, void(*fn)(size_t, const shev_t*), int cpu)
+{
+	shard_t r = calloc(1U, sizeof(*r));
+
+	if (UNLIKELY(r == NULL)) {
+		return NULL;
+	}
+	r->n = n;
+	r->fn = fn;
+	r->todo = calloc(n, sizeof(*r->todo));
+	r->done = calloc(n, sizeof(*r->done));
+	r->wrk = calloc(n, sizeof(*r->wrk));
+	if (UNLIKELY(r->todo == NULL || r->done == NULL || r->wrk == NULL)) {
+		goto nope;
+	}
+	for (size_t w = 0U; w < n; w++) {
+		/* room for all rounds and the stop sign */
+		r->todo[w] = make_spsc(2U * NROUND);
+		r->done[w] = make_spsc(2U * NROUND);
+		if (UNLIKELY(r->todo[w] == NULL || r->done[w] == NULL)) {
+			goto nope;
+		}
+	}
+	if (UNLIKELY((r->free = make_spsc(NROUND)) == NULL)) {
+		goto nope;
+	}
+	for (size_t i = 0U; i < NROUND; i++) {
+		if (UNLIKELY((r->r[i].p = calloc(n, sizeof(*r->r[i].p))) == NULL)) {
+			goto nope;
+		}
+		r->idle[r->nidle++] = r->r + i;
+	}
+	if (UNLIKELY(run_stage(&r->mrgr, merger, r,
+			       cpu >= 0 ? cpu + (int)n : -1) < 0)) {
+		goto nope;
+	}
+	r->mrgp = true;
+	for (; r->nwrk < n; r->nwrk++) {
+		r->wrk[r->nwrk].s = r;
+		r->wrk[r->nwrk].w = r->nwrk;
+		if (UNLIKELY(run_stage(&r->wrk[r->nwrk].thr,
+				       worker, r->wrk + r->nwrk,
+				       cpu >= 0 ? cpu + (int)r->nwrk : -1) < 0)) {
+			goto nope;
+		}
+	}
+	return r;
+
+nope:
+	free_shard(r);
+	return NULL;
+}
+
+int
+free_shard(shard_t s)
+{
+	int rc;
+
+	seal(s);
+	/* send the shards home, they tell the merger */
+	for (size_t w = 0U; w < s->nwrk; w++) {
+		spsc_put(s->todo[w], NULL);
+	}
+	for (size_t w = s->nwrk; s->mrgp && w < s->n; w++) {
+		/* stand in for shards that never started */
+		spsc_put(s->done[w], NULL);
+	}
+	for (size_t w = 0U; w < s->nwrk; w++) {
+		pthread_join(s->wrk[w].thr, NULL);
+	}
+	if (s->mrgp) {
+		pthread_join(s->mrgr, NULL);
+	}
+
+	for (size_t i = 0U; i < NROUND; i++) {
+		struct round_s *r = s->r + i;
+
+		for (size_t w = 0U; r->p != NULL && w < s->n; w++) {
+			free(r->p[w].out.d);
+			free(r->p[w].end);
+		}
+		free(r->p);
+		free(r->ev);
+		free(r->buf);
+	}
+	for (size_t w = 0U; w < s->n; w++) {
+		if (s->todo != NULL) {
+			free_spsc(s->todo[w]);
+		}
+		if (s->done != NULL) {
+			free_spsc(s->done[w]);
+		}
+	}
+	free_spsc(s->free);
+	free(s->todo);
+	free(s->done);
+	free(s->wrk);
+	rc = s->err;
+	free(s);
+	return rc;
+}
+
+int
+shard_send(shard_t s, shev_t ev)
+{
+	struct round_s *r = s->cur;
+
+	if (r == NULL) {
+		r = s->cur = next_round(s);
+	}
+	if (UNLIKELY(r->nev >= r->zev)) {
+		const size_t nuz = 2U * r->zev ?: ROUNDW;
+		void *nu = realloc(r->ev, nuz * sizeof(*r->ev));
+
+		if (UNLIKELY(nu == NULL)) {
+			goto nope;
+		}
+		r->ev = nu;
+		r->zev = nuz;
+	}
+	if (UNLIKELY(r->bn + ev.lz > r->bz)) {
+		const size_t nuz = r->bn + ev.lz > 2U * r->bz
+			? r->bn + ev.lz : 2U * r->bz ?: 64U * ROUNDW;
+		char *nu = realloc(r->buf, nuz);
+
+		if (UNLIKELY(nu == NULL)) {
+			goto nope;
+		}
+		r->buf = nu;
+		r->bz = nuz;
+	}
+	if (ev.lz) {
+		memcpy(r->buf + r->bn, ev.ln, ev.lz);
+	}
+	r->ev[r->nev].e = ev;
+	r->ev[r->nev].lo = r->bn;
+	r->bn += ev.lz;
+	if (LIKELY(ev.k != NOT_AN_ID)) {
+		r->ev[r->nev].w = ev.k % s->n;
+		r->wgt++;
+	} else {
+		r->ev[r->nev].w = NOT_AN_ID;
+		r->wgt += ev.nb ?: 1U;
+	}
+	if (++r->nev >= ROUNDW || r->wgt >= ROUNDW) {
+		seal(s);
+	}
+	return 0;
+
+nope:
+	/* EV is lost, say so when we're done */
+	s->err = -1;
+	return -1;
+}
+
+void
+shard_span(void)
+{
+	struct part_s *p = wpart;
+
+	if (p == NULL) {
+		/* not in a shard */
+		return;
+	}
+	if (UNLIKELY(p->nend >= p->zend)) {
+		const size_t nuz = 2U * p->zend ?: 256U;
+		size_t *nu = realloc(p->end, nuz * sizeof(*p->end));
+
+		if (UNLIKELY(nu == NULL)) {
+			/* the merger will give up on this round */
+			p->errp = true;
+			return;
+		}
+		p->end = nu;
+		p->zend = nuz;
+	}
+	p->end[p->nend++] = p->out.n;
+	return;
+}
+
+/* shard.c ends here */
@@ -0,0 +1,88 @@
+/*** shard.h -- books spread over worker threads
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_shard_h_
+#define INCLUDED_shard_h_
+#include <stddef.h>
+#include "xquo.h"
+#include "intern.h"
+
+/**
+ * Shards own the books whose id is congruent to their index modulo
+ * the number of shards and run in threads of their own.  Events are
+ * handed to the shard owning their book, or to all shards, and
+ * whatever the shards obuf_write() is put back into event order by
+ * a merger thread, so the caller can get on with the next events.
+ * Until free_shard() the caller itself mustn't obuf_write(). */
+typedef struct shard_s *shard_t;
+
+typedef struct {
+	/* book id, or NOT_AN_ID for events that concern all books */
+	size_t k;
+	/* for the latter, the number of books concerned */
+	size_t nb;
+	xquo_t q;
+	/* bytes to go with the event, only valid during the call */
+	const char *ln;
+	size_t lz;
+} shev_t;
+
+/**
+ * Start N shards, pinned to CPU, CPU+1, ..., and their merger, pinned
+ * to CPU+N, unless CPU is negative.  Shards pass the events they're
+ * given to FN along with their index.
+ * FN must write its output for an event about book K in one go,
+ * for an event about all books it must call shard_span() after
+ * each of its books, in order of their ids.
+ * Before a shard stops FN is called with a NULL event. */
+extern shard_t
+make_shard(size_t n, void(*fn)(size_t, const shev_t*), int cpu);
+
+/**
+ * Write out what's pending and stop the shards.
+ * Return 0 on success or -1 if events or output were lost on the way. */
+extern int free_shard(shard_t);
+
+/**
+ * Hand EV to its shard or shards, the LZ bytes at EV.LN are copied.
+ * Return 0 on success or -1 if EV couldn't be queued. */
+extern int shard_send(shard_t, shev_t ev);
+
+/**
+ * Inside FN, finish the output for the current book. */
+extern void shard_span(void);
+
+#endif	/* INCLUDED_shard_h_ */
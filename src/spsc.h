@@ -0,0 +1,138 @@
+/*** spsc.h -- single-producer single-consumer rings
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_spsc_h_
+#define INCLUDED_spsc_h_
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+
+/**
+ * Bounded ring of pointers between exactly one producer thread and
+ * exactly one consumer thread, no locks involved.
+ * Waiting sides spin for a bit, then yield, then nap. */
+typedef struct spsc_s {
+	/* next slot to write, only ever stored by the producer */
+	_Atomic size_t head;
+	char pad1[64U - sizeof(size_t)];
+	/* next slot to read, only ever stored by the consumer */
+	_Atomic size_t tail;
+	char pad2[64U - sizeof(size_t)];
+	size_t msk;
+	void *r[];
+} *spsc_t;
+
+static inline spsc_t
+make_spsc(size_t z)
+{
+/* Z must be a power of 2 */
+	spsc_t r;
+
+	if ((r = calloc(1U, sizeof(*r) + z * sizeof(*r->r))) != NULL) {
+		r->msk = z - 1U;
+	}
+	return r;
+}
+
+static inline void
+free_spsc(spsc_t q)
+{
+	free(q);
+	return;
+}
+
+static inline bool
+spsc_push(spsc_t q, void *p)
+{
+	const size_t h = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	if (h - atomic_load_explicit(&q->tail, memory_order_acquire) > q->msk) {
+		/* full */
+		return false;
+	}
+	q->r[h & q->msk] = p;
+	atomic_store_explicit(&q->head, h + 1U, memory_order_release);
+	return true;
+}
+
+static inline bool
+spsc_pop(spsc_t q, void **p)
+{
+	const size_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	if (t == atomic_load_explicit(&q->head, memory_order_acquire)) {
+		/* empty */
+		return false;
+	}
+	*p = q->r[t & q->msk];
+	atomic_store_explicit(&q->tail, t + 1U, memory_order_release);
+	return true;
+}
+
+static inline void
+spsc_wait(unsigned int *n)
+{
+/* back off a little more on every call */
+	if (*n < 64U) {
+		;
+	} else if (*n < 128U) {
+		sched_yield();
+	} else {
+		nanosleep(&(struct timespec){0, 50000L}, NULL);
+	}
+	++*n;
+	return;
+}
+
+static inline void
+spsc_put(spsc_t q, void *p)
+{
+	for (unsigned int n = 0U; !spsc_push(q, p); spsc_wait(&n));
+	return;
+}
+
+static inline void*
+spsc_get(spsc_t q)
+{
+	void *p;
+
+	for (unsigned int n = 0U; !spsc_pop(q, &p); spsc_wait(&n));
+	return p;
+}
+
+#endif	/* INCLUDED_spsc_h_ */
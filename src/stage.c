@@ -0,0 +1,101 @@
+/*** stage.c -- pipeline stages in threads
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#if defined HAVE_PTHREAD_SETAFFINITY_NP
+# define _GNU_SOURCE
+#endif	/* HAVE_PTHREAD_SETAFFINITY_NP */
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "stage.h"
+#include "nifty.h"
+
+
+int
+pin_stage(int cpu)
+{
+#if defined HAVE_PTHREAD_SETAFFINITY_NP
+	cpu_set_t set;
+
+	if (cpu < 0) {
+		return 0;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(
+		pthread_self(), sizeof(set), &set) ? -1 : 0;
+#else  /* !HAVE_PTHREAD_SETAFFINITY_NP */
+	(void)cpu;
+	return 0;
+#endif	/* HAVE_PTHREAD_SETAFFINITY_NP */
+}
+
+struct stage_s {
+	void*(*fn)(void*);
+	void *arg;
+	int cpu;
+};
+
+static void*
+stage(void *clo)
+{
+	struct stage_s s = *(struct stage_s*)clo;
+
+	free(clo);
+	pin_stage(s.cpu);
+	return s.fn(s.arg);
+}
+
+int
+run_stage(pthread_t *thr, void*(*fn)(void*), void *arg, int cpu)
+{
+	struct stage_s *clo = malloc(sizeof(*clo));
+
+	if (UNLIKELY(clo == NULL)) {
+		return -1;
+	}
+	*clo = (struct stage_s){fn, arg, cpu};
+	if (UNLIKELY(pthread_create(thr, NULL, stage, clo))) {
+		free(clo);
+		return -1;
+	}
+	return 0;
+}
+
+/* stage.c ends here */
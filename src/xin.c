@@ -0,0 +1,658 @@
+/*** xin.c -- reading quotes, serially or in a pipeline
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#if defined HAVE_DFP754_H
+# include <dfp754.h>
+#endif	/* HAVE_DFP754_H */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "dfp754_d32.h"
+#include "dfp754_d64.h"
+#include "xin.h"
+#include "lines.h"
+#include "bq.h"
+#include "spsc.h"
+#include "stage.h"
+#include "nifty.h"
+
+/* batches in flight, at least, and per parser, and their initial
+ * line buffer size */
+#define NBATCH	(8U)
+#define PBATCH	(4U)
+#define BATCHZ	(256U * 1024U)
+
+struct batch_s {
+	/* whole lines, each ending in a newline */
+	char *buf;
+	size_t bn;
+	size_t bz;
+	/* the quotes on those lines, IQ is the next one to hand out */
+	struct {
+		xquo_t q;
+		const char *ln;
+		size_t k;
+	} *q;
+	size_t nq;
+	size_t zq;
+	size_t iq;
+	/* whether the quotes came parsed, from a binary file, BUF then
+	 * holds their lines' stamps and instruments */
+	bool prsd;
+	/* or whether they're to be decoded from block BLK of archive BIN,
+	 * the last of its batches takes BIN with it */
+	bqin_t bin;
+	size_t blk;
+	size_t rec;
+	bool bfin;
+	/* name of the file that couldn't be opened after these lines */
+	const char *err;
+	int errnum;
+	bool eof;
+};
+
+struct xin_s {
+	size_t nfn;
+	char *const *fn;
+	_Atomic(intern_t) flt;
+	_Atomic(tv_t) from;
+	_Atomic(tv_t) till;
+	/* where to start in the first file */
+	size_t seek;
+
+	/* serial mode, POS is where the last quote was */
+	size_t ifn;
+	lines_t in;
+	bqin_t bin;
+	size_t pos;
+
+	/* pipeline mode, batches go from EMP to RAW (reader),
+	 * from RAW to PRS (parsers, taking turns), and back to EMP
+	 * (consumer, taking the same turns) */
+	size_t nprs;
+	size_t nbat;
+	spsc_t emp;
+	spsc_t *raw;
+	spsc_t *prs;
+	size_t iprs;
+	struct batch_s *cur;
+	struct batch_s *b;
+	pthread_t rdr;
+	struct prsr_s {
+		xin_t x;
+		size_t i;
+		pthread_t thr;
+	} *prsr;
+	size_t nthr;
+	bool runp;
+	/* whether the reader's been given batches */
+	bool gop;
+	/* whether the consumer's had enough */
+	_Atomic(bool) stop;
+};
+
+
+static const char*
+xin_fn(xin_t x, size_t i)
+{
+	return x->nfn ? x->fn[i] : "-";
+}
+
+static int
+bat_add(struct batch_s *b, const char *ln, size_t z)
+{
+/* append line LN of length Z to B, with a newline if need be */
+	if (UNLIKELY(b->bn + z + 1U > b->bz)) {
+		const size_t nuz = b->bn + z + 1U > 2U * b->bz
+			? b->bn + z + 1U : 2U * b->bz;
+		char *nu = realloc(b->buf, nuz);
+
+		if (UNLIKELY(nu == NULL)) {
+			return -1;
+		}
+		b->buf = nu;
+		b->bz = nuz;
+	}
+	memcpy(b->buf + b->bn, ln, z);
+	b->bn += z;
+	if (UNLIKELY(ln[z - 1U] != '\n')) {
+		b->buf[b->bn++] = '\n';
+	}
+	return 0;
+}
+
+static void
+bat_quo(struct batch_s *b, xquo_t q, const char *ln, size_t k)
+{
+/* append quote Q on line LN to B */
+	if (UNLIKELY(b->nq >= b->zq)) {
+		const size_t nuz = 2U * b->zq ?: 4096U;
+
+		b->q = realloc(b->q, nuz * sizeof(*b->q));
+		b->zq = nuz;
+	}
+	b->q[b->nq].q = q;
+	b->q[b->nq].ln = ln;
+	b->q[b->nq].k = k;
+	b->nq++;
+	return;
+}
+
+static int
+bat_fit(struct batch_s *b, size_t z)
+{
+/* make sure an empty B has room for Z bytes */
+	if (UNLIKELY(b->bz < z)) {
+		char *nu = realloc(b->buf, z);
+
+		if (UNLIKELY(nu == NULL)) {
+			return -1;
+		}
+		b->buf = nu;
+		b->bz = z;
+	}
+	return 0;
+}
+
+static void*
+reader(void *clo)
+{
+	xin_t x = clo;
+	struct batch_s *b = spsc_get(x->emp);
+	/* parser whose turn it is */
+	size_t ip = 0U;
+#define ship(b)						\
+	(spsc_put(x->raw[ip], b), ip = (ip + 1U) % x->nprs)
+#define stopp()						\
+	atomic_load_explicit(&x->stop, memory_order_relaxed)
+
+	for (size_t i = 0U; i < (x->nfn ?: 1U) && !stopp(); i++) {
+		const char *ln;
+		lines_t in;
+		bqin_t bi;
+
+		if ((bi = make_bqin(xin_fn(x, i))) != NULL && bq_nblk(bi)) {
+			/* archives go by the block, to be decoded by the
+			 * parsers, we just skip what isn't wanted */
+			const size_t j0 = !i ? x->seek / BQ_BLKN : 0U;
+			const size_t r0 = !i ? x->seek % BQ_BLKN : 0U;
+			intern_t flt = NULL;
+			size_t j = NOT_AN_ID;
+
+			if (b->bn) {
+				ship(b);
+				b = spsc_get(x->emp);
+			}
+			for (size_t nxt = j0;
+			     nxt < bq_nblk(bi) && !stopp(); nxt++) {
+				const intern_t nuf = atomic_load_explicit(
+					&x->flt, memory_order_acquire);
+
+				if (UNLIKELY(nuf != flt)) {
+					bq_filter(bi, flt = nuf);
+				}
+				bq_window(bi, atomic_load_explicit(
+						  &x->from, memory_order_relaxed),
+					  atomic_load_explicit(
+						  &x->till, memory_order_relaxed));
+				if (!bq_blkp(bi, nxt)) {
+					continue;
+				} else if (j != NOT_AN_ID) {
+					b->bin = bi;
+					b->blk = j;
+					b->rec = j == j0 ? r0 : 0U;
+					ship(b);
+					b = spsc_get(x->emp);
+				}
+				j = nxt;
+			}
+			if (j != NOT_AN_ID) {
+				b->bin = bi;
+				b->blk = j;
+				b->rec = j == j0 ? r0 : 0U;
+				b->bfin = true;
+				ship(b);
+				b = spsc_get(x->emp);
+			} else {
+				free_bqin(bi);
+			}
+			continue;
+		} else if (bi != NULL) {
+			/* binary quotes go in batches of their own, as is,
+			 * BUF mustn't move while we fill it */
+			const size_t lz = bq_maxln(bi);
+			size_t k = NOT_AN_ID;
+			xquo_t q;
+
+			if (b->bn) {
+				ship(b);
+				b = spsc_get(x->emp);
+			}
+			if (!i && x->seek) {
+				bq_seek(bi, x->seek);
+			}
+			b->prsd = true;
+			bat_fit(b, lz);
+			for (ssize_t z;
+			     !stopp() &&
+			     (z = next_bq(bi, &q, &ln, atomic_load_explicit(
+						  &x->flt, memory_order_acquire),
+					  &k)) >= 0; k = NOT_AN_ID) {
+				if (b->bn + lz > b->bz) {
+					/* full, off you go */
+					ship(b);
+					b = spsc_get(x->emp);
+					b->prsd = true;
+					bat_fit(b, lz);
+				}
+				memcpy(b->buf + b->bn, ln, z);
+				q.ins = b->buf + b->bn + (q.ins - ln);
+				bat_quo(b, q, b->buf + b->bn, k);
+				b->bn += z;
+			}
+			free_bqin(bi);
+			ship(b);
+			b = spsc_get(x->emp);
+			continue;
+		} else if (UNLIKELY(errno ||
+				    (in = make_lines(xin_fn(x, i))) == NULL)) {
+			goto err;
+		} else if (!i && x->seek &&
+			   UNLIKELY(lines_seek(in, x->seek) < 0)) {
+			free_lines(in);
+			errno = ESPIPE;
+		err:
+			/* ship what we've got along with the error */
+			b->err = xin_fn(x, i);
+			b->errnum = errno;
+			ship(b);
+			b = spsc_get(x->emp);
+			continue;
+		}
+		for (ssize_t nrd;
+		     !stopp() && (nrd = next_line(in, &ln)) > 0;) {
+			if (b->bn + nrd >= b->bz && b->bn) {
+				/* full, off you go */
+				ship(b);
+				b = spsc_get(x->emp);
+			}
+			bat_add(b, ln, nrd);
+		}
+		free_lines(in);
+	}
+	b->eof = true;
+	ship(b);
+#undef stopp
+#undef ship
+	/* send the parsers home */
+	for (size_t i = 0U; i < x->nprs; i++) {
+		spsc_put(x->raw[i], NULL);
+	}
+	return NULL;
+}
+
+static void*
+parser(void *clo)
+{
+	const xin_t x = ((struct prsr_s*)clo)->x;
+	const size_t i = ((struct prsr_s*)clo)->i;
+
+	/* archive blocks are unpacked here */
+	bq_t *r = NULL;
+
+	for (struct batch_s *b; (b = spsc_get(x->raw[i])) != NULL;) {
+		if (b->prsd) {
+			/* nothing to do */
+			goto ship;
+		} else if (b->bin != NULL) {
+			const intern_t flt = atomic_load_explicit(
+				&x->flt, memory_order_acquire);
+			const size_t lz = bq_maxln(b->bin);
+			ssize_t n;
+
+			if (UNLIKELY(r == NULL &&
+				     (r = malloc(BQ_BLKN * sizeof(*r))) == NULL ||
+				     (n = bq_unpack(b->bin, b->blk, r)) <= 0 ||
+				     bat_fit(b, n * lz) < 0)) {
+				goto ship;
+			}
+			for (ssize_t j = b->rec; j < n; j++) {
+				char *ln = b->buf + b->bn;
+				size_t k = NOT_AN_ID;
+				size_t z;
+				xquo_t q;
+
+				z = bq_line(b->bin, r + j, &q, ln);
+				if (flt != NULL &&
+				    (k = intern_get(flt, q.ins, q.inz)) ==
+				    NOT_AN_ID) {
+					continue;
+				}
+				bat_quo(b, q, ln, k);
+				b->bn += z;
+			}
+			goto ship;
+		}
+		for (const char *s = b->buf, *const ep = s + b->bn; s < ep;) {
+			const char *eol = memchr(s, '\n', ep - s);
+			const size_t z = eol + 1U - s;
+			const intern_t flt = atomic_load_explicit(
+				&x->flt, memory_order_acquire);
+			size_t k = NOT_AN_ID;
+			xquo_t q;
+
+			if (!NOT_A_XQUO_P(q = read_xquo_ins(s, z, flt, &k))) {
+				bat_quo(b, q, s, k);
+			}
+			s += z;
+		}
+	ship:
+		spsc_put(x->prs[i], b);
+	}
+	free(r);
+	return NULL;
+}
+
+
+xin_t
+make_xin(size_t nfn, char *const *fn, size_t nprs, int cpu)
+{
+	xin_t r = calloc(1U, sizeof(*r));
+
+	if (UNLIKELY(r == NULL)) {
+		return NULL;
+	}
+	r->nfn = nfn;
+	r->fn = fn;
+	r->till = NATV;
+	if (!(r->nprs = nprs)) {
+		return r;
+	}
+	/* set up rings and batches */
+	for (r->nbat = NBATCH; r->nbat < PBATCH * nprs; r->nbat *= 2U);
+	r->emp = make_spsc(r->nbat);
+	r->raw = calloc(nprs, sizeof(*r->raw));
+	r->prs = calloc(nprs, sizeof(*r->prs));
+	r->b = calloc(r->nbat, sizeof(*r->b));
+	r->prsr = calloc(nprs, sizeof(*r->prsr));
+	if (UNLIKELY(r->emp == NULL || r->raw == NULL || r->prs == NULL ||
+		     r->b == NULL || r->prsr == NULL)) {
+		goto nope;
+	}
+	for (size_t i = 0U; i < nprs; i++) {
+		/* room for all batches and the stop sign */
+		r->raw[i] = make_spsc(2U * r->nbat);
+		r->prs[i] = make_spsc(r->nbat);
+		if (UNLIKELY(r->raw[i] == NULL || r->prs[i] == NULL)) {
+			goto nope;
+		}
+	}
+	for (size_t i = 0U; i < r->nbat; i++) {
+		if (UNLIKELY((r->b[i].buf = malloc(BATCHZ)) == NULL)) {
+			goto nope;
+		}
+		r->b[i].bz = BATCHZ;
+	}
+	for (; r->nthr < nprs; r->nthr++) {
+		r->prsr[r->nthr].x = r;
+		r->prsr[r->nthr].i = r->nthr;
+		if (UNLIKELY(run_stage(&r->prsr[r->nthr].thr,
+				       parser, r->prsr + r->nthr,
+				       cpu >= 0 ? cpu + 1 + (int)r->nthr : -1) < 0)) {
+			goto stop;
+		}
+	}
+	if (UNLIKELY(run_stage(&r->rdr, reader, r, cpu) < 0)) {
+		goto stop;
+	}
+	r->runp = true;
+	return r;
+
+stop:
+	/* send the parsers home */
+	for (size_t i = 0U; i < r->nthr; i++) {
+		spsc_put(r->raw[i], NULL);
+		pthread_join(r->prsr[i].thr, NULL);
+	}
+nope:
+	free_xin(r);
+	return NULL;
+}
+
+void
+free_xin(xin_t x)
+{
+	if (x->runp) {
+		/* the reader may be waiting for batches, or still be
+		 * going, tell it to stop and see it through */
+		const char *ln;
+		size_t k;
+		xquo_t q;
+
+		atomic_store_explicit(&x->stop, true, memory_order_relaxed);
+		while (next_xquo(x, &q, &ln, &k));
+	}
+	if (x->runp) {
+		/* all stages return after the eof batch */
+		pthread_join(x->rdr, NULL);
+		for (size_t i = 0U; i < x->nthr; i++) {
+			pthread_join(x->prsr[i].thr, NULL);
+		}
+	}
+	for (size_t i = 0U; x->b != NULL && i < x->nbat; i++) {
+		free(x->b[i].buf);
+		free(x->b[i].q);
+	}
+	for (size_t i = 0U; i < x->nprs; i++) {
+		if (x->raw != NULL) {
+			free_spsc(x->raw[i]);
+		}
+		if (x->prs != NULL) {
+			free_spsc(x->prs[i]);
+		}
+	}
+	free_spsc(x->emp);
+	free(x->raw);
+	free(x->prs);
+	free(x->b);
+	free(x->prsr);
+	if (x->in != NULL) {
+		free_lines(x->in);
+	}
+	if (x->bin != NULL) {
+		free_bqin(x->bin);
+	}
+	free(x);
+	return;
+}
+
+void
+xin_filter(xin_t x, intern_t ins)
+{
+	atomic_store_explicit(&x->flt, ins, memory_order_release);
+	return;
+}
+
+void
+xin_seek(xin_t x, size_t pos)
+{
+	x->seek = pos;
+	return;
+}
+
+size_t
+xin_tell(xin_t x)
+{
+	return x->pos;
+}
+
+size_t
+xin_size(xin_t x)
+{
+	return x->bin != NULL ? bq_size(x->bin)
+		: x->in != NULL ? lines_size(x->in) : 0U;
+}
+
+void
+xin_window(xin_t x, tv_t from, tv_t till)
+{
+	atomic_store_explicit(&x->from, from, memory_order_relaxed);
+	atomic_store_explicit(&x->till, till, memory_order_relaxed);
+	return;
+}
+
+static inline bool
+xin_inwinp(xin_t x, tv_t t)
+{
+	return t >= atomic_load_explicit(&x->from, memory_order_relaxed) &&
+		t <= atomic_load_explicit(&x->till, memory_order_relaxed);
+}
+
+int
+next_xquo(xin_t x, xquo_t *q, const char **ln, size_t *k)
+{
+	if (x->nprs) {
+		struct batch_s *b;
+
+		if (UNLIKELY(!x->gop)) {
+			/* xin_seek() has had its chance, off we go */
+			for (size_t i = 0U; i < x->nbat; i++) {
+				spsc_put(x->emp, x->b + i);
+			}
+			x->gop = true;
+		}
+	more:
+		if ((b = x->cur) == NULL) {
+			b = x->cur = spsc_get(x->prs[x->iprs]);
+			x->iprs = (x->iprs + 1U) % x->nprs;
+		}
+		while (LIKELY(b->iq < b->nq)) {
+			*q = b->q[b->iq].q;
+			*ln = b->q[b->iq].ln;
+			*k = b->q[b->iq].k;
+			b->iq++;
+			if (LIKELY(xin_inwinp(x, q->q.t))) {
+				return 1;
+			}
+		}
+		if (UNLIKELY(b->err != NULL)) {
+			*ln = b->err;
+			errno = b->errnum;
+			b->err = NULL;
+			return -1;
+		} else if (UNLIKELY(b->eof)) {
+			return 0;
+		}
+		/* recycle */
+		b->bn = b->nq = b->iq = 0U;
+		b->prsd = false;
+		if (b->bfin) {
+			free_bqin(b->bin);
+		}
+		b->bin = NULL;
+		b->rec = 0U;
+		b->bfin = false;
+		spsc_put(x->emp, b);
+		x->cur = NULL;
+		goto more;
+	}
+
+	/* serial mode then */
+	for (ssize_t nrd;;) {
+		if (x->bin != NULL) {
+			if (LIKELY(next_bq(x->bin, q, ln, atomic_load_explicit(
+						   &x->flt, memory_order_relaxed),
+					   k) >= 0)) {
+				if (LIKELY(xin_inwinp(x, q->q.t))) {
+					x->pos = bq_tell(x->bin);
+					return 1;
+				}
+				continue;
+			}
+			free_bqin(x->bin);
+			x->bin = NULL;
+			x->ifn++;
+			continue;
+		} else if (x->in == NULL) {
+			if (x->ifn >= (x->nfn ?: 1U)) {
+				return 0;
+			} else if ((x->bin = make_bqin(
+					    xin_fn(x, x->ifn))) != NULL) {
+				bq_window(x->bin, atomic_load_explicit(
+						  &x->from, memory_order_relaxed),
+					  atomic_load_explicit(
+						  &x->till, memory_order_relaxed));
+				if (!x->ifn && x->seek &&
+				    UNLIKELY(bq_seek(x->bin, x->seek) < 0)) {
+					free_bqin(x->bin);
+					x->bin = NULL;
+					errno = EINVAL;
+					*ln = xin_fn(x, x->ifn++);
+					return -1;
+				}
+				continue;
+			} else if (UNLIKELY(errno || (x->in = make_lines(
+						     xin_fn(x, x->ifn))) == NULL)) {
+				*ln = xin_fn(x, x->ifn++);
+				return -1;
+			} else if (!x->ifn && x->seek &&
+				   UNLIKELY(lines_seek(x->in, x->seek) < 0)) {
+				free_lines(x->in);
+				x->in = NULL;
+				errno = ESPIPE;
+				*ln = xin_fn(x, x->ifn++);
+				return -1;
+			}
+		}
+		if (UNLIKELY((nrd = next_line(x->in, ln)) <= 0)) {
+			free_lines(x->in);
+			x->in = NULL;
+			x->ifn++;
+			continue;
+		}
+		*q = read_xquo_ins(*ln, nrd, atomic_load_explicit(
+					   &x->flt, memory_order_relaxed), k);
+		if (LIKELY(!NOT_A_XQUO_P(*q) && xin_inwinp(x, q->q.t))) {
+			x->pos = lines_tell(x->in) - nrd;
+			return 1;
+		}
+	}
+}
+
+/* xin.c ends here */
@@ -0,0 +1,94 @@
+/*** xin.h -- reading quotes, serially or in a pipeline
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of books.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_xin_h_
+#define INCLUDED_xin_h_
+#include <stdbool.h>
+#include "xquo.h"
+#include "intern.h"
+
+/**
+ * Quote inputs go through a list of files and hand out the quotes
+ * therein in order.  Pipelined inputs read lines and parse them in
+ * threads of their own, ahead of the caller. */
+typedef struct xin_s *xin_t;
+
+/**
+ * Prepare reading quotes off the NFN files FN, `-' denoting stdin,
+ * or off stdin if NFN is 0.
+ * If NPRS is non-zero, lines are read in a separate thread, pinned
+ * to CPU, and parsed in chunks by NPRS threads, pinned to CPU+1 to
+ * CPU+NPRS, if CPU is non-negative. */
+extern xin_t make_xin(size_t nfn, char *const *fn, size_t nprs, int cpu);
+
+/**
+ * Let go of X, whether or not its input has run dry. */
+extern void free_xin(xin_t);
+
+/**
+ * From now on, drop quotes whose instrument is not in INS,
+ * or keep everything if INS is NULL. */
+extern void xin_filter(xin_t, intern_t ins);
+
+/**
+ * Start reading the first file at position POS, that is a byte offset
+ * in text files and a quote's position in binary ones, see bq_tell().
+ * Must be called before the first next_xquo(). */
+extern void xin_seek(xin_t, size_t pos);
+
+/**
+ * Return the position of the last quote in its file, serial mode only. */
+extern size_t xin_tell(xin_t);
+
+/**
+ * Return the position past the end of the file being read, serial mode
+ * only, or 0 if it isn't known. */
+extern size_t xin_size(xin_t);
+
+/**
+ * From now on, drop quotes stamped before FROM or after TILL,
+ * archives skip whole blocks then. */
+extern void xin_window(xin_t, tv_t from, tv_t till);
+
+/**
+ * Put the next quote into Q and its line into LN, if a filter is in
+ * place the instrument's id goes to K.
+ * Return 1 for a quote, 0 if there are no more quotes, or -1 if a file
+ * could not be opened in which case LN is set to its name and errno
+ * is set. */
+extern int next_xquo(xin_t, xquo_t *q, const char **ln, size_t *k);
+
+#endif	/* INCLUDED_xin_h_ */
@@ -40,32 +40,26 @@
 #if defined HAVE_DFP754_H
 # include <dfp754.h>
 #endif	/* HAVE_DFP754_H */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include "dfp754_d32.h"
 #include "dfp754_d64.h"
 #include "xquo.h"
 #include "nifty.h"
 
-#define strtopx		strtod64
-#define pxtostr		d64tostr
-#define strtoqx		strtod64
-#define qxtostr		d64tostr
-
-#if defined __INTEL_COMPILER
-# pragma warning (push)
-# pragma warning (disable: 1419)
-# pragma warning (disable: 2203)
-#endif	/* __INTEL_COMPILER */
-
-extern void *memrchr(void const *s, int c_in, size_t n);
-#include "memrchr.c"
-
-#if defined __INTEL_COMPILER
-# pragma warning (pop)
-#endif	/* __INTEL_COMPILER */
+#if defined BOOKSI64
+# define strtopx	strtoi64
+# define strtoqx	strtoi64
+#else  /* !BOOKSI64 */
+# define strtopx(x, on, s)	strtod64(x, on)
+# define strtoqx(x, on, s)	strtod64(x, on)
+#endif	/* BOOKSI64 */
 
 
-tv_t
-strtotv(const char *ln, char **endptr)
+static tv_t
+strtotv_slow(const char *ln, char **endptr)
 {
 	char *on;
 	tv_t r;
@@ -110,6 +104,139 @@ out:
 	return r;
 }
 
+/* SWAR helpers, 8 bytes at a time, little endian only */
+#define B8(x)	(0x0101010101010101ULL * (x))
+
+static inline size_t
+ndigits(const char *s, const char *eos)
+{
+/* count the digits S starts with, not going beyond EOS */
+	size_t n = 0U;
+
+#if !defined WORDS_BIGENDIAN
+	for (; s + n + 8U <= eos; n += 8U) {
+		uint64_t v, m;
+
+		memcpy(&v, s + n, sizeof(v));
+		/* digits have a high nibble of 3 and a low nibble below 10,
+		 * i.e. adding 6 mustn't spill into the high nibble */
+		m = ((v & B8(0xf0U)) ^ B8(0x30U)) |
+			(((v + B8(0x06U)) & B8(0xf0U)) ^ B8(0x30U));
+		if (m) {
+			return n + (__builtin_ctzll(m) >> 3U);
+		}
+	}
+#endif	/* !WORDS_BIGENDIAN */
+	for (; s + n < eos && (unsigned char)(s[n] ^ '0') < 10U; n++);
+	return n;
+}
+
+static inline uint64_t
+digits(const char *s, size_t n)
+{
+/* turn the N digits at S into a number */
+	uint64_t r = 0U;
+	size_t i = 0U;
+
+#if !defined WORDS_BIGENDIAN
+	for (; i + 8U <= n; i += 8U) {
+		uint64_t v;
+
+		memcpy(&v, s + i, sizeof(v));
+		v -= B8('0');
+		/* pairs, then quads, then the whole lot */
+		v = (v * 10U + (v >> 8U)) & 0x00ff00ff00ff00ffULL;
+		v = (v * 100U + (v >> 16U)) & 0x0000ffff0000ffffULL;
+		v = (v * 10000U + (v >> 32U)) & 0x00000000ffffffffULL;
+		r = r * 100000000U + v;
+	}
+#endif	/* !WORDS_BIGENDIAN */
+	for (; i < n; i++) {
+		r = r * 10U + (s[i] ^ '0');
+	}
+	return r;
+}
+
+static inline size_t
+tabs(size_t *restrict tab, size_t ntab, const char *s, size_t z)
+{
+/* find tabs in S of size Z, the last NTAB of them end up in TAB,
+ * oldest first, return the total number of tabs */
+	size_t n = 0U;
+	size_t i = 0U;
+
+#define PUSH(x)	(tab[n++ % ntab] = (x))
+#if !defined WORDS_BIGENDIAN
+	for (; i + 8U <= z; i += 8U) {
+		uint64_t v, m;
+
+		memcpy(&v, s + i, sizeof(v));
+		v ^= B8('\t');
+		/* high bit set for the naught bytes, no borrows */
+		m = ~(((v & B8(0x7fU)) + B8(0x7fU)) | v) & B8(0x80U);
+		for (; m; m &= m - 1U) {
+			PUSH(i + (__builtin_ctzll(m) >> 3U));
+		}
+	}
+#endif	/* !WORDS_BIGENDIAN */
+	for (; i < z; i++) {
+		if (s[i] == '\t') {
+			PUSH(i);
+		}
+	}
+#undef PUSH
+	return n;
+}
+
+static tv_t
+xstrtotv(const char *ln, const char *eol, char **endptr)
+{
+/* like strtotv() but stay before EOL */
+	static const unsigned int mul[] = {NSECS, 0U, 0U, USECS, 0U, 0U, MSECS};
+	const char *on;
+	size_t n;
+	tv_t s, x = 0U;
+
+	if (UNLIKELY((n = ndigits(ln, eol)) == 0U || n > 19U)) {
+		/* leave the odd cases to strtoul() */
+		goto slow;
+	} else if (UNLIKELY(!(s = digits(ln, n)))) {
+		on = ln + n;
+		s = NATV;
+		goto out;
+	}
+	on = ln + n;
+	if (on < eol && *on == '.') {
+		on++;
+		if (UNLIKELY((n = ndigits(on, eol)) == 0U &&
+			     on < eol && (*on == '-' || *on == '+' || *on == ' ' ||
+					  (unsigned char)(*on - '\t') < 5U))) {
+			/* strtoul() would skip blanks and signs */
+			goto slow;
+		} else if (UNLIKELY(n > 9U || n % 3U)) {
+			return NATV;
+		}
+		x = digits(on, n);
+		x *= n < 9U ? mul[n] : 1U;
+		on += n;
+	}
+	s = s * NSECS + x;
+out:
+	if (LIKELY(endptr != NULL)) {
+		*endptr = deconst(on);
+	}
+	return s;
+
+slow:
+	return strtotv_slow(ln, endptr);
+}
+
+tv_t
+strtotv(const char *ln, char **endptr)
+{
+	return xstrtotv(ln, ln + strnlen(ln, 64U), endptr);
+}
+
 ssize_t
 tvtostr(char *restrict buf, size_t bsz, tv_t t)
 {
@@ -137,46 +264,41 @@ tvtostr(char *restrict buf, size_t bsz, tv_t t)
 }
 
 xquo_t
-read_xquo(const char *line, size_t llen)
+read_xquo_ins(const char *line, size_t llen, intern_t ins, size_t *id)
 {
-/* process one line */
-	char *lp, *on;
+/* process one line, from the end, the fields are
+ * T... INS SIDE+FLAVOUR PRC QTY
+ * the instrument is located first so that unwanted lines can be
+ * dropped before we go anywhere near the decimals */
+	size_t tab[8U];
+	size_t ntab;
+	size_t p, t, f;
+	char *on;
 	xquo_t q;
 
-	/* get timestamp */
-	q.q.t = strtotv(line, NULL);
-
-	/* get qty */
-	if (UNLIKELY((lp = memrchr(line, '\t', llen)) == NULL)) {
-		/* can't do without quantity */
+	if (UNLIKELY((ntab = tabs(tab, countof(tab), line, llen)) < 2U)) {
+		/* can't do without price and quantity */
 		return NOT_A_XQUO;
 	}
-	llen = lp - line;
-	q.q.q = strtoqx(lp + 1U, NULL);
+/* the I-th last tab, or -1 */
+#define TAB(i)	((i) <= ntab && (i) <= countof(tab)		\
+		 ? tab[(ntab - (i)) % countof(tab)] : (size_t)-1ULL)
 
-	/* get prc */
-	if (UNLIKELY((lp = memrchr(line, '\t', llen)) == NULL)) {
-		/* can't do without price */
+	/* get flavour, should be just before the price */
+	if (UNLIKELY(!(f = p = TAB(2U)))) {
 		return NOT_A_XQUO;
 	}
-	llen = lp - line;
-	q.q.p = strtopx(lp + 1U, &on);
-	if (UNLIKELY(on <= lp + 1U)) {
-		/* invalidate price */
-		q.q.p = NANPX;
-	}
-
-	/* get flavour, should be just before ON */
-	with (unsigned char f = *(unsigned char*)--lp) {
+	with (unsigned char c = line[--f]) {
 		/* map 1, 2, 3 to LVL_{1,2,3}
 		 * everything else goes to LVL_0 */
-		f ^= '0';
-		q.q.f = (typeof(q.q.f))(f & -(f < 4U));
+		c ^= '0';
+		q.q.f = (typeof(q.q.f))(c & -(c < 4U));
 	}
 
-	/* rewind manually */
-	for (; lp > line && lp[-1] != '\t'; lp--);
-	with (unsigned char s = *(unsigned char*)lp) {
+	/* side field starts after the last tab before the flavour */
+	for (size_t i = 3U; (t = TAB(i)) != (size_t)-1ULL && t >= f; i++);
+	t = t != (size_t)-1ULL ? t + 1U : 0U;
+	with (unsigned char s = line[t]) {
 		/* map A or a to ASK and B or b to BID
 		 * map C to CLR, D to DEL (and T for TRA to DEL)
 		 * everything else goes to SIDE_UNK */
@@ -191,19 +313,244 @@ read_xquo(const char *line, size_t llen)
 		}
 	}
 
-	if (LIKELY(lp-- > line)) {
-		llen = lp - line;
-		if (LIKELY((q.ins = memrchr(line, '\t', llen)) != NULL)) {
-			q.ins++;
-		} else {
-			q.ins = line;
+	if (LIKELY(t-- > 0U)) {
+		/* instrument field ends at T */
+		size_t i = 3U;
+
+		for (size_t u; (u = TAB(i)) != (size_t)-1ULL; i++) {
+			if (u < t) {
+				q.ins = line + u + 1U;
+				goto ins;
+			}
 		}
-		q.inz = lp - q.ins;
+		q.ins = line;
+	ins:
+		q.inz = line + t - q.ins;
 	} else {
 		q.ins = line, q.inz = 0U;
 	}
 
+	/* is it for us? */
+	if (ins != NULL &&
+	    (*id = intern_get(ins, q.ins, q.inz)) == NOT_AN_ID) {
+		return NOT_A_XQUO;
+	}
+
+	/* get timestamp */
+	q.q.t = xstrtotv(line, line + llen, NULL);
+
+	/* get qty */
+	q.scl = (xscl_t){0U};
+	q.q.q = strtoqx(line + TAB(1U) + 1U, NULL, &q.scl.q);
+
+	/* get prc */
+	q.q.p = strtopx(line + p + 1U, &on, &q.scl.p);
+	if (UNLIKELY(on <= line + p + 1U)) {
+		/* invalidate price */
+		q.q.p = NANPX;
+	}
+#undef TAB
 	return q;
 }
 
+xquo_t
+read_xquo(const char *line, size_t llen)
+{
+	return read_xquo_ins(line, llen, NULL, NULL);
+}
+
+
+#if defined BOOKSI64
+static const int64_t pow10s[] = {
+	1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL,
+	10000000LL, 100000000LL, 1000000000LL, 10000000000LL,
+	100000000000LL, 1000000000000LL, 10000000000000LL,
+	100000000000000LL, 1000000000000000LL, 10000000000000000LL,
+	100000000000000000LL, 1000000000000000000LL,
+};
+
+int64_t
+strtoi64(const char *str, char **endptr, unsigned char *scl)
+{
+/* like strtod64() but with the decimal point taken out, not more
+ * than 18 digits though, the rest is rounded off */
+	const char *sp = str;
+	int64_t r = 0;
+	unsigned int nd = 18U;
+	unsigned char ns = 0U;
+	bool negp = false;
+	bool roff = false;
+
+	if (UNLIKELY(*sp == '-')) {
+		negp = true;
+		sp++;
+	} else if (UNLIKELY(*sp == '+')) {
+		sp++;
+	}
+	if (UNLIKELY(!(*sp >= '0' && *sp <= '9') &&
+		     !(*sp == '.' && sp[1U] >= '0' && sp[1U] <= '9'))) {
+		/* no digits at all, like nan or a lone sign */
+		if (LIKELY(endptr != NULL)) {
+			*endptr = deconst(str);
+		}
+		*scl = 0U;
+		return NANPX;
+	}
+	/* skip leading zeros */
+	for (; *sp == '0'; sp++);
+	for (; *sp >= '0' && *sp <= '9' && nd > 0U; sp++, nd--) {
+		r = r * 10 + (*sp ^ '0');
+	}
+	if (UNLIKELY(*sp >= '0' && *sp <= '9')) {
+		/* integral part too big, saturate, i.e. +/-inf */
+		for (; *sp >= '0' && *sp <= '9'; sp++);
+		if (*sp == '.') {
+			for (sp++; *sp >= '0' && *sp <= '9'; sp++);
+		}
+		r = INT64_MAX;
+	} else if (*sp == '.') {
+		for (sp++; *sp >= '0' && *sp <= '9' && nd > 0U; sp++, nd--) {
+			r = r * 10 + (*sp ^ '0');
+			ns++;
+		}
+		roff = *sp >= '5' && *sp <= '9';
+		for (; *sp >= '0' && *sp <= '9'; sp++);
+		/* 18 digits at most, so there's room for the round-off */
+		r += roff;
+	}
+	if (LIKELY(endptr != NULL)) {
+		*endptr = deconst(sp);
+	}
+	*scl = ns;
+	return negp ? -r : r;
+}
+
+ssize_t
+i64tostr(char *restrict buf, size_t bsz, int64_t x, size_t scl)
+{
+	char tmp[24U];
+	char *tp = tmp + sizeof(tmp);
+	uint64_t m;
+	size_t z;
+
+	if (UNLIKELY(isnanpx(x))) {
+		z = bsz < 3U ? bsz : 3U;
+		memcpy(buf, "nan", z);
+		return z;
+	} else if (UNLIKELY(isinfpx(x))) {
+		z = bsz < 3U + (x < 0) ? bsz : 3U + (x < 0);
+		memcpy(buf, "-inf" + !(x < 0), z);
+		return z;
+	}
+	/* right to left, decimal places first */
+	m = x < 0 ? -(uint64_t)x : (uint64_t)x;
+	for (size_t i = 0U; i < scl && tp > tmp + 2U; i++, m /= 10U) {
+		*--tp = (char)(m % 10U ^ '0');
+	}
+	if (scl) {
+		*--tp = '.';
+	}
+	do {
+		*--tp = (char)(m % 10U ^ '0');
+	} while ((m /= 10U) && tp > tmp + 1U);
+	if (x < 0) {
+		/* no stinking signed naughts here either */
+		*--tp = '-';
+	}
+	z = tmp + sizeof(tmp) - tp;
+	z = z < bsz ? z : bsz;
+	memcpy(buf, tp, z);
+	if (z < bsz) {
+		buf[z] = '\0';
+	}
+	return z;
+}
+
+int64_t
+xscale(int64_t x, size_t from, size_t to)
+{
+	if (UNLIKELY(isnanpx(x) || isinfpx(x))) {
+		return x;
+	}
+	if (to < from) {
+		/* only meant for values that came up from TO */
+		return x / pow10s[from - to];
+	} else if (UNLIKELY(!x)) {
+		return 0;
+	} else if (UNLIKELY(to - from >= countof(pow10s) ||
+			    x > INT64_MAX / pow10s[to - from] ||
+			    x < -INT64_MAX / pow10s[to - from])) {
+		/* doesn't fit, saturate to +/-inf */
+		return x > 0 ? INT64_MAX : -INT64_MAX;
+	}
+	return x * pow10s[to - from];
+}
+#endif	/* BOOKSI64 */
+
+book_t
+rescale_book(book_t b, px_t tick, xscl_t from, xscl_t to)
+{
+	book_t r = make_book_ladder(tick);
+
+	for (book_side_t s = BOOK_SIDE_ASK; s <= BOOK_SIDE_BID; s++) {
+		for (book_iter_t i = book_iter(b, s); book_iter_next(&i);) {
+			book_quo_t q = {
+				s, BOOK_LVL_2,
+				.p = xscale(i.p, from.p, to.p),
+				.q = xscale(i.q, from.q, to.q),
+				.t = i.t,
+			};
+#if defined BOOKSI64
+			/* levels keep their quanta, in finer ticks and lots */
+			q.pe = (unsigned char)(i.pe + to.p - from.p);
+			q.qe = (unsigned char)(i.qe + to.q - from.q);
+#endif	/* BOOKSI64 */
+			book_add(r, q);
+		}
+	}
+	free_book(b);
+	return r;
+}
+
+book_quo_t
+rescale_quo(xquo_t q, xscl_t to)
+{
+	q.q.p = xscale(q.q.p, q.scl.p, to.p);
+	q.q.q = xscale(q.q.q, q.scl.q, to.q);
+#if defined BOOKSI64
+	/* the digits they didn't come in with */
+	q.q.pe = (unsigned char)(to.p - q.scl.p);
+	q.q.qe = (unsigned char)(to.q - q.scl.q);
+#endif	/* BOOKSI64 */
+	return q.q;
+}
+
+ssize_t
+read_instrs(intern_t ins, const char *fn)
+{
+	char *line = NULL;
+	size_t llen = 0UL;
+	ssize_t nctch = 0;
+	FILE *fp;
+
+	if (UNLIKELY((fp = fopen(fn, "r")) == NULL)) {
+		return -1;
+	}
+	for (ssize_t nrd; (nrd = getline(&line, &llen, fp)) > 0;) {
+		/* chop off line endings */
+		for (; nrd > 0 && (line[nrd - 1] == '\n' ||
+				   line[nrd - 1] == '\r'); nrd--);
+		if (UNLIKELY(!nrd)) {
+			continue;
+		} else if (UNLIKELY(nrd == 1 && *line == '*')) {
+			nctch++;
+			continue;
+		}
+		intern(ins, line, nrd);
+	}
+	free(line);
+	fclose(fp);
+	return nctch;
+}
+
 /* xquo.c ends here */
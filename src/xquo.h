@@ -38,14 +38,23 @@
 #define INCLUDED_xquo_h_
 #include <unistd.h>
 #include "books.h"
+#include "intern.h"
+
+/* decimal places of prices and quantities, for the fixed-point flavour
+ * whose books count ticks and lots, with decimal books they stay 0 */
+typedef struct {
+	unsigned char p;
+	unsigned char q;
+} xscl_t;
 
 typedef struct {
 	book_quo_t q;
 	const char *ins;
 	size_t inz;
+	xscl_t scl;
 } xquo_t;
 
-#define NOT_A_XQUO	((xquo_t){NOT_A_QUO})
+#define NOT_A_XQUO	((xquo_t){.q = NOT_A_QUO})
 #define NOT_A_XQUO_P(x)	(NOT_A_QUO_P((x).q))
 
 
@@ -53,4 +62,48 @@ extern tv_t strtotv(const char *ln, char **endptr);
 extern ssize_t tvtostr(char *restrict buf, size_t bsz, tv_t t);
 extern xquo_t read_xquo(const char *line, size_t llen);
 
+/**
+ * Like read_xquo() but return NOT_A_XQUO for instruments not in INS,
+ * before prices or quantities are read.  The instrument's id in INS
+ * goes to ID. */
+extern xquo_t read_xquo_ins(
+	const char *line, size_t llen, intern_t ins, size_t *id);
+
+#if defined BOOKSI64
+/**
+ * Read a decimal number from STR as integer, its number of decimal places
+ * goes to SCL, e.g. 1.05 is returned as 105 with SCL set to 2.
+ * Strings without digits (nan, -) give NANPX, integral parts of more
+ * than 18 digits saturate to +/-INFPX. */
+extern int64_t strtoi64(const char *str, char **endptr, unsigned char *scl);
+
+/**
+ * Write X with SCL decimal places into BUF, i.e. the inverse of strtoi64(). */
+extern ssize_t i64tostr(char *restrict buf, size_t bsz, int64_t x, size_t scl);
+
+/**
+ * Bring X from FROM decimal places to TO decimal places, going down
+ * (TO < FROM) only works for X that came up from TO in the first place.
+ * Values that don't fit the new scale saturate to +/-INFPX. */
+extern int64_t xscale(int64_t x, size_t from, size_t to);
+#else  /* !BOOKSI64 */
+# define xscale(x, from, to)	((void)(from), (void)(to), (x))
+#endif	/* BOOKSI64 */
+
+/**
+ * Return a copy of BOOK whose prices and quantities went from FROM
+ * to TO decimal places and which uses a ladder of TICK (in TO's terms),
+ * BOOK itself is freed. */
+extern book_t rescale_book(book_t, px_t tick, xscl_t from, xscl_t to);
+
+/**
+ * Return Q's quote in TO decimal places, TO must not be coarser than
+ * Q's, the quote's quanta are those Q came in with. */
+extern book_quo_t rescale_quo(xquo_t q, xscl_t to);
+
+/**
+ * Intern the instruments listed in file FN, one per line, into INS.
+ * Return the number of catch-all entries (`*') or -1 on error. */
+extern ssize_t read_instrs(intern_t ins, const char *fn);
+
 #endif	/* INCLUDED_xquo_h_ */
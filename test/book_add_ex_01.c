@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+
+int
+main(void)
+{
+	book_t b;
+	book_chg_t c;
+	int rc = 0;
+
+	b = make_book();
+
+	book_add_ex(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 100.dd, 1.dd}, 2U, &c);
+	rc |= c.d != 0U || !c.lvlp || !c.topp || !c.topnp;
+	book_add_ex(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 99.dd, 1.dd}, 2U, &c);
+	rc |= c.d != 1U || !c.lvlp || c.topp || !c.topnp;
+	book_add_ex(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 98.dd, 1.dd}, 2U, &c);
+	rc |= c.d != 2U || !c.lvlp || c.topp || c.topnp;
+	/* same again, nothing's changed */
+	book_add_ex(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 99.dd, 1.dd}, 2U, &c);
+	rc |= c.d != 1U || c.lvlp || c.topp || c.topnp;
+	book_add_ex(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_3, 100.dd, -1.dd}, 2U, &c);
+	rc |= c.d != 0U || !c.lvlp || !c.topp || !c.topnp;
+	/* 98 has moved up */
+	book_add_ex(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_3, 98.dd, 2.dd}, 2U, &c);
+	rc |= c.d != 1U || !c.lvlp || c.topp || !c.topnp;
+	book_add_ex(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, 101.dd, 1.dd}, 2U, &c);
+	rc |= c.d != 0U || !c.lvlp || !c.topp || !c.topnp;
+	book_add_ex(b, (book_quo_t){BOOK_SIDE_CLR}, 2U, &c);
+	rc |= c.d != 0U || !c.topp || !c.topnp;
+
+	free_book(b);
+	return rc;
+}
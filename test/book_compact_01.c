@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+#define NSTP	(100000U)
+#define NLIV	(10U)
+
+
+int
+main(void)
+{
+	book_t b;
+	size_t na = 0U, nb = 0U;
+	int rc = 0;
+
+	b = make_book();
+
+	/* drift upwards all day long, only the last NLIV levels survive,
+	 * every step leaves a dead key behind */
+	for (unsigned int i = 0U; i < NSTP; i++) {
+		px_t p = (px_t)(i + 1U) / 100.dd;
+		px_t o = (px_t)(i + 1U - NLIV) / 100.dd;
+
+		book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, p, 1.dd});
+		book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_3, p, 2.dd});
+		if (i >= NLIV) {
+			book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, o});
+			book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_3, o, -2.dd});
+		}
+	}
+	/* one more for good measure */
+	book_compact(b);
+
+	for (book_iter_t i = book_iter(b, BOOK_SIDE_ASK);
+	     book_iter_next(&i); na++) {
+		rc |= i.p != (px_t)(NSTP - NLIV + na + 1U) / 100.dd;
+		rc |= i.q != 1.dd;
+	}
+	for (book_iter_t i = book_iter(b, BOOK_SIDE_BID);
+	     book_iter_next(&i); nb++) {
+		rc |= i.p != (px_t)(NSTP - nb) / 100.dd;
+		rc |= i.q != 2.dd;
+	}
+
+	/* the books must still work after compaction */
+	book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, 0.01dd, 3.dd});
+	rc |= book_top(b, BOOK_SIDE_ASK).p != 0.01dd;
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_1, 0.02dd, 3.dd});
+	book_compact(b);
+	rc |= book_top(b, BOOK_SIDE_BID).p != 0.02dd;
+
+	printf("%zu %zu\n", na, nb);
+
+	free_book(b);
+	return rc || na != NLIV || nb != NLIV;
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+#define NLVL	(1000U)
+
+
+int
+main(void)
+{
+	book_t b;
+	int rc = 0;
+
+	b = make_book();
+
+	/* twice, so the emptied side gets compacted again */
+	for (size_t k = 0U; k < 2U; k++) {
+		for (unsigned int i = 0U; i < NLVL; i++) {
+			book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2,
+						  (px_t)(i + 1U) / 100.dd, 1.dd});
+		}
+		/* and everything's gone again */
+		for (unsigned int i = 0U; i < NLVL; i++) {
+			book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2,
+						  (px_t)(i + 1U) / 100.dd});
+		}
+		book_compact(b);
+		rc |= !NOT_A_QUO_P(book_top(b, BOOK_SIDE_ASK));
+	}
+
+	/* the dead side must take levels again, enough to split */
+	for (unsigned int i = 0U; i < NLVL; i++) {
+		book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2,
+					  (px_t)(NLVL - i) / 100.dd, 2.dd});
+	}
+	rc |= book_top(b, BOOK_SIDE_ASK).p != 0.01dd;
+	rc |= book_top(b, BOOK_SIDE_ASK).q != 2.dd;
+
+	free_book(b);
+	return rc;
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+#define NLVL	(2048U)
+
+
+static size_t
+count(book_t b, book_side_t s, tv_t t)
+{
+	size_t n = 0U;
+
+	for (book_iter_t i = book_iter(b, s); book_iter_next(&i); n++) {
+		/* nothing at or before T should be left */
+		n += (i.t <= t) * NLVL;
+	}
+	return n;
+}
+
+int
+main(void)
+{
+	int rc = 0;
+
+	for (size_t k = 0U; k < 2U; k++) {
+		book_t b = !k ? make_book() : make_book_ladder(0.01dd);
+		size_t na, nb;
+
+		/* level i gets time stamp i + 1 */
+		for (unsigned int i = 0U; i < NLVL; i++) {
+			px_t p = (px_t)(i + 1U) / 100.dd;
+
+			const tv_t t = i + 1U;
+
+			book_add(b, (book_quo_t){
+					BOOK_SIDE_ASK, BOOK_LVL_2, p, 1.dd, t});
+			book_add(b, (book_quo_t){
+					BOOK_SIDE_BID, BOOK_LVL_2, p, 1.dd, t});
+		}
+		book_exp(b, 100U);
+		/* refresh the first 50 asks, they should survive */
+		for (unsigned int i = 100U; i < 150U; i++) {
+			px_t p = (px_t)(i + 1U) / 100.dd;
+
+			book_add(b, (book_quo_t){
+					BOOK_SIDE_ASK, BOOK_LVL_3,
+					p, 1.dd, 5000U});
+		}
+		/* and bring back an old one */
+		book_add(b, (book_quo_t){
+				BOOK_SIDE_BID, BOOK_LVL_2,
+				0.01dd, 1.dd, 6000U});
+		book_exp(b, 1000U);
+
+		na = count(b, BOOK_SIDE_ASK, 1000U);
+		nb = count(b, BOOK_SIDE_BID, 1000U);
+		rc |= (na != NLVL - 1000U + 50U) << k;
+		rc |= (nb != NLVL - 1000U + 1U) << k;
+		rc |= (book_top(b, BOOK_SIDE_ASK).p != 1.01dd) << k;
+		rc |= (book_top(b, BOOK_SIDE_BID).p != 20.48dd) << k;
+		printf("%zu %zu\n", na, nb);
+		free_book(b);
+	}
+	return rc;
+}
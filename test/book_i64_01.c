@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+
+int
+main(void)
+{
+	book_t b;
+	book_quo_t a, c;
+	px_t bp[4U];
+	qx_t bq[4U];
+
+	/* prices in cents */
+	b = make_book();
+
+	book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, 10100, 2});
+	book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, 10000, 3});
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 9800, 5});
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 9900, 1});
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_3, 9700, 4});
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_3, 9700, -4});
+
+	a = book_top(b, BOOK_SIDE_ASK);
+	c = book_ctop(b, BOOK_SIDE_ASK, 4);
+	size_t b4 = book_tops(bp, bq, b, BOOK_SIDE_BID, 4);
+
+	free_book(b);
+	return a.p != 10000 || a.q != 3 ||
+		c.p != 10025 || c.q != 4 ||
+		b4 != 2U || bp[0U] != 9900 || bq[0U] != 1 ||
+		bp[1U] != 9800 || bq[1U] != 5;
+}
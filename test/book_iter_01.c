@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+#define NLVL	(4096U)
+
+
+int
+main(void)
+{
+	book_t b;
+	size_t na = 0U, nb = 0U;
+	px_t lst = 0.dd;
+	int rc = 0;
+
+	b = make_book();
+
+	/* scramble levels 0.01 .. 40.96 so we get a couple of leaves,
+	 * every other level with an extra trailing zero */
+	for (unsigned int i = 0U, j = 0U; i < NLVL; i++) {
+		/* 1021 is coprime to NLVL */
+		px_t p = (px_t)((j = (j + 1021U) % NLVL) + 1U) / 100.dd;
+		p = j % 2U ? p : p * 1.0dd;
+
+		book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, p, 1.dd});
+		book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, p, 1.dd});
+	}
+	/* take out every third level again */
+	for (unsigned int i = 0U; i < NLVL; i += 3U) {
+		px_t p = (px_t)(i + 1U) / 100.dd;
+
+		book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, p, 0.dd});
+		book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, p, 0.dd});
+	}
+	/* and increment every fifth level, in yet another cohort */
+	for (unsigned int i = 1U; i < NLVL; i += 5U) {
+		px_t p = (px_t)(i + 1U) / 10.dd / 10.0dd;
+
+		book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_3, p, 1.dd});
+	}
+
+	for (book_iter_t i = book_iter(b, BOOK_SIDE_ASK);
+	     book_iter_next(&i); lst = i.p, na++) {
+		unsigned int j = (unsigned int)(i.p * 100.dd) - 1U;
+
+		rc |= na && i.p <= lst;
+		rc |= j % 3U == 0U && j % 5U != 1U;
+		rc |= i.q != 1.dd + (j % 5U == 1U && j % 3U);
+	}
+	for (book_iter_t i = book_iter(b, BOOK_SIDE_BID);
+	     book_iter_next(&i); lst = i.p, nb++) {
+		rc |= nb && i.p >= lst;
+	}
+
+	printf("%zu %zu\n", na, nb);
+
+	free_book(b);
+	return rc || nb != NLVL - (NLVL + 2U) / 3U || na != nb + 273U;
+}
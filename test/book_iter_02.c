@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+#define NLVL	(4096U)
+
+
+static int
+check(book_t b)
+{
+	size_t n;
+	px_t lst;
+	int rc = 0;
+
+	/* asks from 20.005 onwards, off the grid */
+	n = 0U, lst = 0.dd;
+	for (book_iter_t i = book_iter_at(b, BOOK_SIDE_ASK, 20.005dd);
+	     book_iter_next(&i); lst = i.p, n++) {
+		rc |= i.p < 20.01dd || n && i.p <= lst;
+	}
+	rc |= n != NLVL / 2U - 1000U;
+	/* bids from 20.00 downwards, on the grid */
+	n = 0U, lst = 0.dd;
+	for (book_iter_t i = book_iter_at(b, BOOK_SIDE_BID, 20.00dd);
+	     book_iter_next(&i); lst = i.p, n++) {
+		rc |= i.p > 20.00dd || n && i.p >= lst;
+	}
+	rc |= n != 1000U;
+	/* asks up to 10.00, i.e. 0.02 .. 10.00 */
+	n = 0U;
+	for (book_iter_t i = book_iter_lmt(book_iter(b, BOOK_SIDE_ASK), 10.dd);
+	     book_iter_next(&i); n++) {
+		rc |= i.p > 10.dd;
+	}
+	rc |= n != 500U;
+	/* asks backwards, the worst first, down to 30.00 */
+	n = 0U, lst = 0.dd;
+	for (book_iter_t i = book_iter_lmt(book_riter(b, BOOK_SIDE_ASK), 30.dd);
+	     book_iter_next(&i); lst = i.p, n++) {
+		rc |= i.p < 30.dd || n && i.p >= lst;
+		rc |= !n && i.p != 40.96dd;
+	}
+	rc |= n != (4096U - 3000U) / 2U + 1U;
+	/* bids backwards, all of them */
+	n = 0U, lst = 0.dd;
+	for (book_iter_t i = book_riter(b, BOOK_SIDE_BID);
+	     book_iter_next(&i); lst = i.p, n++) {
+		rc |= n && i.p <= lst;
+	}
+	rc |= n != NLVL / 2U;
+	return rc;
+}
+
+int
+main(void)
+{
+	int rc = 0;
+
+	/* every even level from 0.02 to 40.96, on both sides,
+	 * with and without a ladder */
+	for (size_t k = 0U; k < 2U; k++) {
+		book_t b = !k ? make_book() : make_book_ladder(0.01dd);
+
+		for (unsigned int i = 0U, j = 0U; i < NLVL / 2U; i++) {
+			/* 1021 is coprime to NLVL / 2 */
+			j = (j + 1021U) % (NLVL / 2U);
+
+			px_t p = (px_t)((j + 1U) * 2U) / 100.dd;
+			book_add(b, (book_quo_t){
+					BOOK_SIDE_ASK, BOOK_LVL_2, p, 1.dd});
+			book_add(b, (book_quo_t){
+					BOOK_SIDE_BID, BOOK_LVL_2, p, 1.dd});
+		}
+		rc |= check(b) << k;
+		free_book(b);
+	}
+	printf("%d\n", rc);
+	return rc;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+#define NLVL	(2000U)
+
+
+static int
+fill(book_t b, size_t n)
+{
+	int rc = 0;
+
+	for (size_t i = 0U; i < n; i++) {
+		book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2,
+					  100.00dd + (px_t)i / 100.dd, 1.dd});
+		book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2,
+					  99.99dd - (px_t)i / 100.dd, 1.dd});
+	}
+	rc |= book_top(b, BOOK_SIDE_ASK).p != 100.00dd;
+	rc |= book_top(b, BOOK_SIDE_BID).p != 99.99dd;
+	return rc;
+}
+
+static int
+drain(book_t b, size_t n)
+{
+/* delete all but the last level on either side */
+	int rc = 0;
+
+	for (size_t i = 0U; i + 1U < n; i++) {
+		book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2,
+					  100.00dd + (px_t)i / 100.dd, 0.dd});
+		book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2,
+					  99.99dd - (px_t)i / 100.dd, 0.dd});
+	}
+	rc |= book_top(b, BOOK_SIDE_ASK).p != 100.00dd + (px_t)(n - 1U) / 100.dd;
+	rc |= book_top(b, BOOK_SIDE_BID).p != 99.99dd - (px_t)(n - 1U) / 100.dd;
+	return rc;
+}
+
+
+int
+main(void)
+{
+	book_t b;
+	int rc = 0;
+
+	b = make_book();
+	rc |= book_prealloc(b, NLVL) < 0;
+	/* once from the preallocated pool, then again from recycled nodes */
+	for (size_t k = 0U; k < 4U; k++) {
+		rc |= fill(b, NLVL);
+		rc |= drain(b, NLVL);
+		book_compact(b);
+		rc |= drain(b, NLVL);
+	}
+	free_book(b);
+
+	/* lots of books, each with its own pool, they must all go */
+	for (size_t k = 0U; k < 256U; k++) {
+		b = make_book();
+		rc |= book_prealloc(b, k) < 0;
+		rc |= fill(b, k + 1U);
+		free_book(b);
+	}
+	return rc;
+}
@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+
+int
+main(void)
+{
+	book_t b;
+	book_quo_t a1, a2, a3, a4, b1;
+	size_t n0, n1, n2, n3;
+	int rc = 0;
+
+	b = make_book();
+
+	n0 = book_ntop(b);
+	book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, 200.0dd, 300.dd, 1U});
+	book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, 198.0dd, 100.dd, 2U});
+	a1 = book_top(b, BOOK_SIDE_ASK);
+	n1 = book_ntop(b);
+	/* deeper levels leave the top alone */
+	book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, 199.0dd, 100.dd, 3U});
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_3, 190.0dd, 100.dd, 4U});
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_3, 180.0dd, 100.dd, 5U});
+	n2 = book_ntop(b);
+	/* take out the top, 199 should come through */
+	book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_3, 198.0dd, -100.dd, 6U});
+	a2 = book_top(b, BOOK_SIDE_ASK);
+	n3 = book_ntop(b);
+	/* expire everything up to 3 */
+	book_exp(b, 3U);
+	a3 = book_top(b, BOOK_SIDE_ASK);
+	b1 = book_top(b, BOOK_SIDE_BID);
+	book_clr(b);
+	a4 = book_top(b, BOOK_SIDE_ASK);
+
+	rc |= a1.p != 198.0dd || a1.q != 100.dd || a1.t != 2U;
+	rc |= n1 == n0;
+	rc |= (n2 - n1) != 1U;
+	rc |= a2.p != 199.0dd || a2.q != 100.dd || a2.t != 3U;
+	rc |= n3 == n2;
+	rc |= !NOT_A_QUO_P(a3);
+	rc |= b1.p != 190.0dd || b1.q != 100.dd || b1.t != 4U;
+	rc |= !NOT_A_QUO_P(a4);
+
+	free_book(b);
+	return rc;
+}
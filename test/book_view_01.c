@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+
+int
+main(void)
+{
+	book_t b;
+	const book_view_t *v;
+	int rc = 0;
+
+	b = make_book();
+
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 100.dd, 1.dd});
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 98.dd, 2.dd});
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 97.dd, 3.dd});
+
+	v = book_view(b, BOOK_SIDE_BID, 2U);
+	rc |= v->n != 2U || v->lo != 0U || v->hi != 2U;
+	rc |= v->p[0U] != 100.dd || v->p[1U] != 98.dd;
+	book_view_ack(b, BOOK_SIDE_BID);
+
+	/* too deep */
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 96.dd, 1.dd});
+	rc |= v->lo < v->hi;
+	/* second row */
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 99.dd, 1.dd});
+	rc |= v->lo != 1U || v->hi != 2U || v->p[1U] != 99.dd;
+	book_view_ack(b, BOOK_SIDE_BID);
+	/* top's gone, 98 moves up */
+	book_add(b, (book_quo_t){BOOK_SIDE_BID, BOOK_LVL_2, 100.dd, 0.dd});
+	rc |= v->lo != 0U || v->hi != 2U;
+	rc |= v->p[0U] != 99.dd || v->p[1U] != 98.dd || v->q[1U] != 2.dd;
+	book_view_ack(b, BOOK_SIDE_BID);
+	/* other side */
+	book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2, 101.dd, 1.dd});
+	rc |= v->lo < v->hi;
+	book_add(b, (book_quo_t){BOOK_SIDE_CLR});
+	rc |= v->n != 0U || v->lo != 0U || v->hi != 2U;
+
+	free_book(b);
+	return rc;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include "books.h"
+#include "nifty.h"
+
+#define NLVL	(200U)
+
+
+int
+main(void)
+{
+	book_t b, f;
+	qx_t q[NLVL] = {0};
+	unsigned int x = 1U;
+	int rc = 0;
+
+	b = make_book();
+	f = make_book();
+
+	/* lots of updates to big levels, price times quantity has
+	 * more digits than a _Decimal64 holds */
+	for (size_t j = 0U; j < 64U * NLVL; j++) {
+		const size_t i = (x = x * 1103515245U + 12345U) % NLVL;
+
+		q[i] = j % 7U
+			? (qx_t)x * 100.dd + (qx_t)(x % 1000U) / 1000.dd
+			: 0.dd;
+		book_add(b, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2,
+					  1000.0000dd + (px_t)i / 10000.dd,
+					  q[i], j + 1U});
+	}
+	/* the same levels, in one go */
+	for (size_t i = 0U; i < NLVL; i++) {
+		book_add(f, (book_quo_t){BOOK_SIDE_ASK, BOOK_LVL_2,
+					  1000.0000dd + (px_t)i / 10000.dd,
+					  q[i], 1U});
+	}
+
+	/* how we got there mustn't matter */
+	for (size_t j = 1U; j < 500U; j++) {
+		const qx_t V = (qx_t)j * 40000000000000.dd + 0.123dd;
+		const book_quo_t vb = book_vtop(b, BOOK_SIDE_ASK, V);
+		const book_quo_t vf = book_vtop(f, BOOK_SIDE_ASK, V);
+		const book_quo_t cb = book_ctop(b, BOOK_SIDE_ASK, V / 1000.dd);
+		const book_quo_t cf = book_ctop(f, BOOK_SIDE_ASK, V / 1000.dd);
+
+		rc |= vb.p != vf.p || vb.q != vf.q;
+		rc |= cb.p != cf.p || cb.q != cf.q;
+	}
+
+	free_book(b);
+	free_book(f);
+	return rc;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <string.h>
+#include "dfp754_d64.h"
+#include "nifty.h"
+
+static const struct {
+	const char *in;
+	const char *out;
+	size_t used;
+} rt[] = {
+	{"0", "0", 1U},
+	{"1", "1", 1U},
+	{"-1", "-1", 2U},
+	{"+1", "1", 2U},
+	{"123.45", "123.45", 6U},
+	{"0.001", "0.001", 5U},
+	{"000100.0100", "100.0100", 11U},
+	/* fast path, up to 15 digits */
+	{"123456789012345", "123456789012345", 15U},
+	{"12345678.9012345", "12345678.9012345", 16U},
+	/* slow path */
+	{"1234567890123456", "1234567890123460", 16U},
+	{"1234567890123449", "1234567890123450", 16U},
+	{"-1234567890123456", "-1234567890123460", 17U},
+	{"123456789012345.7", "123456789012346", 17U},
+	{"9999999999999999", "10000000000000000", 16U},
+	{"0.00000000000000001", "0.00000000000000001", 19U},
+	/* no dot, leading and trailing dots */
+	{"42", "42", 2U},
+	{".5", "0.5", 2U},
+	{"5.", "5", 2U},
+	{"-.25", "-0.25", 4U},
+	/* exponents aren't supported, reading stops at the e */
+	{"1e5", "1", 1U},
+	{"2.5E-3", "2.5", 3U},
+};
+
+
+static int
+check_rt(void)
+{
+	int rc = 0;
+
+	for (size_t i = 0U; i < countof(rt); i++) {
+		char buf[64U];
+		char *on;
+		_Decimal64 x = strtod64(rt[i].in, &on);
+		size_t z = d64tostr(buf, sizeof(buf), x);
+
+		if ((size_t)(on - rt[i].in) != rt[i].used ||
+		    z != strlen(rt[i].out) || memcmp(buf, rt[i].out, z)) {
+			fprintf(stderr, "%s -> %.*s (%zu)\n",
+				rt[i].in, (int)z, buf, (size_t)(on - rt[i].in));
+			rc = 1;
+		}
+	}
+	return rc;
+}
+
+static int
+check_strs(void)
+{
+	static const char ln[] = "1.5\t-2\t.25\t300.\t0.001\n";
+	static const char ex[] = "1.5\t-2\t0.25\t300\t0.001";
+	_Decimal64 v[8U];
+	char buf[64U];
+	char *on;
+	size_t n;
+	int rc = 0;
+
+	n = strtod64s(v, countof(v), ln, &on);
+	rc |= n != 5U || *on != '\n';
+	rc |= d64tostrs(buf, sizeof(buf), v, n, '\t') != strlen(ex);
+	rc |= strcmp(buf, ex) != 0;
+
+	/* only ever read N values */
+	n = strtod64s(v, 2U, ln, &on);
+	rc |= n != 2U || v[0U] != 1.5dd || v[1U] != -2.dd || *on != '\t';
+
+	/* never write beyond BSZ, whatever it is */
+	v[5U] = -INFD64;
+	v[6U] = NAND64;
+	for (size_t bsz = 0U; bsz < sizeof(buf); bsz++) {
+		size_t z;
+
+		memset(buf, '#', sizeof(buf));
+		z = d64tostrs(buf, bsz, v, 7U, ' ');
+		rc |= z > bsz;
+		for (size_t i = bsz; i < sizeof(buf); i++) {
+			rc |= buf[i] != '#';
+		}
+	}
+	return rc;
+}
+
+
+int
+main(void)
+{
+	int rc = 0;
+
+	rc |= check_rt();
+	rc |= check_strs();
+	return rc;
+}
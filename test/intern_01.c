@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <string.h>
+#include "intern.h"
+#include "nifty.h"
+
+
+int
+main(void)
+{
+	intern_t t = make_intern();
+	const char *s0;
+	char buf[16U];
+	int rc = 0;
+
+	rc |= intern(t, "EURUSD", 6U) != 0U;
+	rc |= intern(t, "GBPUSD", 6U) != 1U;
+	/* prefix match only */
+	rc |= intern(t, "EURUSD.X", 6U) != 0U;
+	rc |= intern(t, "EUR", 3U) != 2U;
+	rc |= intern_get(t, "EURUSD", 6U) != 0U;
+	rc |= intern_get(t, "EURUS", 5U) != NOT_AN_ID;
+	rc |= intern_get(t, "USDJPY", 6U) != NOT_AN_ID;
+	rc |= intern_cnt(t) != 3U;
+
+	s0 = intern_str(t, 0U);
+	rc |= strcmp(s0, "EURUSD") != 0;
+	rc |= intern_str(t, 3U) != NULL;
+
+	/* lots of them, ids must stay dense, names must stay put */
+	for (size_t i = 0U; i < 40000U; i++) {
+		size_t z = snprintf(buf, sizeof(buf), "OPT%zu", i);
+		rc |= intern(t, buf, z) != i + 3U;
+	}
+	for (size_t i = 0U; i < 40000U; i++) {
+		size_t z = snprintf(buf, sizeof(buf), "OPT%zu", i);
+		rc |= intern_get(t, buf, z) != i + 3U;
+		rc |= strcmp(intern_str(t, i + 3U), buf) != 0;
+	}
+	rc |= intern_cnt(t) != 40003U;
+	rc |= s0 != intern_str(t, 0U);
+
+	free_intern(t);
+	return rc;
+}
@@ -0,0 +1,10 @@
+100000000.000000000	X	A2	100	267
+100000000.000000000	X	B2	99	346
+100000001.000000000	X	A2	101	59.5
+100000001.000000000	X	B2	98	1.50
+100000002.000000000	X	A2	100	268
+100000002.000000000	X	A3	102	1.5
+100000003.000000000	X	A3	102	1.5
+100000003.000000000	X	B2	99.5	2
+100000004.000000000	X	TRA1	100	0.25
+100000005.000000000	X	B2	99	347